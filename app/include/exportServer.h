@@ -0,0 +1,40 @@
+// exportServer.h
+// Module to serve bulk sample data over TCP, and optionally a Unix socket.
+//
+// This is for pulling long stretches of samples that the UDP `history`
+// command would send as many small, unacknowledged text datagrams. Each
+// connection sends one request line, gets one binary reply and is closed:
+//   samples [FIRST [COUNT]] -- archived samples (see sampleArchive.h) from
+//                              sample number FIRST (default the oldest held);
+//                              COUNT defaults to everything up to the newest.
+//                              Reply: "samples <first> <count> f32le\n", then
+//                              <count> little-endian float32 volts.
+//   trace [OFFSET [LENGTH]] -- bytes of the trace being recorded or replayed
+//                              (format in sampleTrace.h), from byte OFFSET.
+//                              Reply: "trace <offset> <length> <total>\n" then
+//                              the bytes.
+// Errors are answered with a single "error <reason>\n" line.
+// Samples are gather-sent (sendmsg, i.e. writev) straight from the archive ring
+// and traces go out with sendfile(), so no data is formatted or copied in user
+// space. The header
+// gives the range actually served. A reply cut short (a slow client that the
+// archive overtook, or a broken connection) is resumed by asking again from
+// the first sample or byte not received.
+//
+// Listens on TCP 127.0.0.1:EXPORT_SERVER_PORT (LIGHT_SAMPLER_EXPORT_PORT
+// overrides it). If LIGHT_SAMPLER_EXPORT_SOCKET names a path, it also listens
+// on a Unix stream socket there. If neither can listen, the program runs on
+// without the endpoint.
+
+#ifndef _EXPORT_SERVER_H_
+#define _EXPORT_SERVER_H_
+
+#define EXPORT_SERVER_PORT 12347
+#define EXPORT_SERVER_PORT_ENV "LIGHT_SAMPLER_EXPORT_PORT"
+#define EXPORT_SERVER_SOCKET_ENV "LIGHT_SAMPLER_EXPORT_SOCKET"
+
+// Begin/end the background thread which answers export requests.
+void ExportServer_init(void);
+void ExportServer_cleanup(void);
+
+#endif
@@ -0,0 +1,21 @@
+// metricsServer.h
+// Module to serve the metrics registry (hal/metrics.h) to a local scraper
+//
+// Listens on TCP 127.0.0.1:METRICS_SERVER_PORT. Each connection gets one
+// snapshot of every registered metric in the Prometheus text format and is
+// then closed, e.g. `nc 127.0.0.1 12346`. A request starting with "GET " is
+// answered with an HTTP/1.0 response so standard scrapers work unchanged.
+// LIGHT_SAMPLER_METRICS_PORT overrides the port (e.g. for several instances
+// on one host). If the port is unavailable the program runs on without the endpoint.
+
+#ifndef _METRICS_SERVER_H_
+#define _METRICS_SERVER_H_
+
+#define METRICS_SERVER_PORT 12346
+#define METRICS_SERVER_PORT_ENV "LIGHT_SAMPLER_METRICS_PORT"
+
+// Begin/end the background thread which answers scrapes.
+void MetricsServer_init(void);
+void MetricsServer_cleanup(void);
+
+#endif
@@ -1,6 +1,6 @@
 // network.h
 // Module to handle incoming udp packets and reply based on user commands
-// supports commands including help/?, count, length, dips, <enter>, stop
+// supports commands including help/?, count, length, dips, history, windows, window, captures, capture, changes, spectrum, filter, latency, stamp, units, calibration, calibrate, subscribe, unsubscribe, <enter>, stop
 
 #ifndef _NETWORK_H_
 #define _NETWORK_H_
@@ -8,6 +8,10 @@
 #include <stdbool.h>
 #include <pthread.h>
 
+#define NETWORK_PORT 12345
+// Overrides NETWORK_PORT (e.g. for several instances on one host)
+#define NETWORK_PORT_ENV "LIGHT_SAMPLER_PORT"
+
 // Begin/end the background thread which processes user commands
 // Init is passed in a reference to main's condition variable so it can signal when the 'stop' command is received
 void Network_init(pthread_cond_t* stopCondVar);
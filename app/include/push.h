@@ -0,0 +1,43 @@
+// push.h
+// Module to stream sample blocks to subscribed UDP clients as soon as they are taken
+//
+// A background thread wakes whenever the sampler publishes a block (see
+// hal/blockQueue.h) and sends each subscriber one datagram per `blockSamples`
+// samples:
+//   #block seq=<s> first=<sample number> n=<samples> dips=<d> acq_ns=<newest>
+//   v, v, v, ...
+// `seq` counts SAMPLE_BLOCK_SAMPLES-sample blocks since start, so consecutive
+// datagrams differ by n / SAMPLE_BLOCK_SAMPLES; a larger jump means data was
+// dropped because the subscriber (or network) fell behind. Sends never block.
+// A subscription is a lease: it lapses PUSH_LEASE_MS after the client last
+// sent `subscribe`, so a client that goes away cannot hold a slot forever.
+// Clients renew by sending `subscribe` again; the stream carries on unbroken.
+
+#ifndef _PUSH_H_
+#define _PUSH_H_
+
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#define PUSH_MAX_SUBSCRIBERS 8
+// Largest block a subscriber can ask for (a multiple of SAMPLE_BLOCK_SAMPLES)
+#define PUSH_MAX_BLOCK_SAMPLES 100
+#define PUSH_LEASE_MS 30000
+
+// Begin/end the push thread; replies are sent from `socketDescriptor`.
+void Push_init(int socketDescriptor);
+void Push_cleanup(void);
+
+// Add a subscriber, or renew (and resize) an existing one's lease. `blockSamples`
+// is rounded up to a multiple of SAMPLE_BLOCK_SAMPLES. Returns the block size in
+// use, or -1 if the table is full.
+int Push_subscribe(const struct sockaddr_in* addr, int blockSamples);
+
+// Remove a subscriber; returns false if it was not subscribed.
+bool Push_unsubscribe(const struct sockaddr_in* addr);
+
+// Totals since start, for status replies.
+long long Push_getBlocksSent(void);
+long long Push_getBlocksDropped(void);
+
+#endif
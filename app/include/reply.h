@@ -0,0 +1,81 @@
+// reply.h
+// Module to build UDP replies without heap allocation or printf on the hot path
+//
+// A Reply_t is a preallocated pool owned by one session (thread). A reply is
+// built as a list of datagrams; each datagram is a list of iovec segments that
+// point either at caller-owned constant text or at the pool's own storage.
+// Reply_send() hands each datagram to sendmsg() directly from those buffers.
+// Text that does not fit the pool is dropped, and the reply then ends with
+// REPLY_TRUNCATED_MARKER so the client can tell it is incomplete.
+
+#ifndef _REPLY_H_
+#define _REPLY_H_
+
+#include <stdbool.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#define REPLY_MAX_DATAGRAM_LEN 1500
+// Room for the widest `history`: 1000 lux values of "100000.000, " at 1470 bytes a datagram
+#define REPLY_MAX_DATAGRAMS 10
+#define REPLY_MAX_SEGMENTS 8
+#define REPLY_STORAGE_LEN (REPLY_MAX_DATAGRAMS * REPLY_MAX_DATAGRAM_LEN)
+
+// Longest text produced by the number formatters (sign, 19 digits, point, 3 decimals)
+#define REPLY_MAX_NUMBER_LEN 32
+// Longest suffix accepted after a number
+#define REPLY_MAX_SUFFIX_LEN 16
+// Sent as a final datagram after a reply that overflowed the pool
+#define REPLY_TRUNCATED_MARKER "(reply truncated)\n"
+
+typedef struct {
+    struct iovec segments[REPLY_MAX_SEGMENTS];
+    int numSegments;
+    int length;
+} Reply_datagram_t;
+
+typedef struct {
+    char storage[REPLY_STORAGE_LEN];
+    int storageUsed;
+    Reply_datagram_t datagrams[REPLY_MAX_DATAGRAMS];
+    int numDatagrams;
+    int datagramLimit;
+    bool overflowed;
+} Reply_t;
+
+// Start a new reply; datagrams are split so none exceeds `datagramLimit` bytes.
+void Reply_begin(Reply_t* reply, int datagramLimit);
+
+// Close the current datagram; following text starts a new one.
+void Reply_newDatagram(Reply_t* reply);
+
+// Append text that lives outside the pool (e.g. a string literal).
+// The text is referenced, not copied, so it must stay valid until Reply_send().
+void Reply_addStatic(Reply_t* reply, const char* text, int length);
+
+// Append a number followed by a short `suffix` (e.g. ", "), stored in the pool.
+// The number and its suffix are never split across datagrams.
+void Reply_addInt(Reply_t* reply, long long value, const char* suffix);
+void Reply_addFixed3(Reply_t* reply, double value, const char* suffix);
+
+// Append printf-formatted text, stored in the pool (for replies off the hot path).
+// Text longer than the datagram limit or the space left is dropped, not cut,
+// and the reply is marked truncated.
+void Reply_addFormatted(Reply_t* reply, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+// Number of bytes queued in the current (last) datagram.
+int Reply_currentDatagramLength(const Reply_t* reply);
+
+// Send every datagram with sendmsg() (passing `flags`, e.g. MSG_DONTWAIT);
+// returns the number of datagrams sent, counting the truncation marker if any.
+int Reply_send(Reply_t* reply, int socketDescriptor, const struct sockaddr_in* dest, socklen_t destLen, int flags);
+
+// Printf-free formatters; write into `dest` (at least REPLY_MAX_NUMBER_LEN bytes,
+// not null-terminated) and return the number of characters written.
+// Reply_formatFixed3 matches printf("%.3f") for finite values of magnitude below 1e15,
+// apart from values that sit exactly on a rounding tie. NaN and infinities
+// print as "nan", "inf" and "-inf"; larger magnitudes are clamped to 1e15.
+int Reply_formatInt(char* dest, long long value);
+int Reply_formatFixed3(char* dest, double value);
+
+#endif
@@ -0,0 +1,338 @@
+// exportServer.c
+// Bulk binary export of archived samples and trace files (see exportServer.h)
+
+#include "exportServer.h"
+#include "hal/sampler.h"
+#include "hal/sampleArchive.h"
+#include "hal/metrics.h"
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define POLL_TIMEOUT_MS 100
+#define REQUEST_TIMEOUT_MS 1000
+#define SEND_TIMEOUT_S 2
+#define REQUEST_MAX_LEN 128
+#define HEADER_MAX_LEN 128
+// Samples per writev(); the archive is checked for overrun after each chunk
+#define CHUNK_SAMPLES 16384
+#define SENDFILE_CHUNK_BYTES (1024 * 1024)
+#define NUM_LISTENERS 2
+
+static pthread_t thread;
+static atomic_bool isRunning = true;
+static bool is_initialized = false;
+static bool threadStarted = false;
+static struct pollfd listeners[NUM_LISTENERS];
+static int numListeners = 0;
+static char unixPath[sizeof(((struct sockaddr_un*)0)->sun_path)];
+
+static Metrics_counter_t requestsTotal;
+static Metrics_counter_t bytesTotal;
+static Metrics_counter_t truncatedTotal;
+
+static int listenTcp(void);
+static int listenUnix(const char* path);
+static void* serveExports();
+static void answerRequest(int connection);
+static void exportSamples(int connection, long long first, long long count);
+static void exportTrace(int connection, long long offset, long long length);
+static void sendError(int connection, const char* reason);
+static bool sendAll(int connection, struct iovec* iov, int iovCount);
+
+void ExportServer_init(void)
+{
+    assert(!is_initialized);
+    is_initialized = true;
+    atomic_store(&isRunning, true);
+    numListeners = 0;
+    unixPath[0] = 0;
+
+    int tcpSocket = listenTcp();
+    if (tcpSocket >= 0){
+        listeners[numListeners++] = (struct pollfd){tcpSocket, POLLIN, 0};
+    }
+    const char* path = getenv(EXPORT_SERVER_SOCKET_ENV);
+    if (path && path[0]){
+        int unixSocket = listenUnix(path);
+        if (unixSocket >= 0){
+            listeners[numListeners++] = (struct pollfd){unixSocket, POLLIN, 0};
+            snprintf(unixPath, sizeof(unixPath), "%s", path);
+        }
+    }
+    if (numListeners == 0){
+        return;
+    }
+    Metrics_registerCounter(&requestsTotal, "light_sampler_export_requests_total", "Bulk export requests answered.");
+    Metrics_registerCounter(&bytesTotal, "light_sampler_export_bytes_total", "Bulk export payload bytes sent.");
+    Metrics_registerCounter(&truncatedTotal, "light_sampler_export_truncated_total", "Exports cut short by archive overrun or a lost client.");
+    threadStarted = true;
+    pthread_create(&thread, NULL, serveExports, NULL);
+}
+
+void ExportServer_cleanup(void)
+{
+    assert(is_initialized);
+    is_initialized = false;
+    if (!threadStarted){
+        return;
+    }
+    atomic_store(&isRunning, false);
+    pthread_join(thread, NULL);
+    threadStarted = false;
+    for (int i = 0; i < numListeners; i++){
+        close(listeners[i].fd);
+    }
+    if (unixPath[0]){
+        unlink(unixPath);
+    }
+    Metrics_unregister(&requestsTotal);
+    Metrics_unregister(&bytesTotal);
+    Metrics_unregister(&truncatedTotal);
+}
+
+static int listenTcp(void)
+{
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const char* port = getenv(EXPORT_SERVER_PORT_ENV);
+    sin.sin_port = htons(port ? atoi(port) : EXPORT_SERVER_PORT);
+
+    int listenSocket = socket(PF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(listenSocket, (struct sockaddr*) &sin, sizeof(sin)) != 0 || listen(listenSocket, 4) != 0){
+        perror("Export endpoint disabled on TCP: unable to listen");
+        close(listenSocket);
+        return -1;
+    }
+    return listenSocket;
+}
+
+static int listenUnix(const char* path)
+{
+    struct sockaddr_un sun;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sun.sun_path)){
+        printf("Export endpoint disabled on %s: path too long\n", path);
+        return -1;
+    }
+    strcpy(sun.sun_path, path);
+    // A socket file left by an earlier run would make bind() fail; anything else is not ours
+    struct stat info;
+    if (lstat(path, &info) == 0){
+        if (!S_ISSOCK(info.st_mode)){
+            printf("Export endpoint disabled on %s: exists and is not a socket\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+    int listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (bind(listenSocket, (struct sockaddr*) &sun, sizeof(sun)) != 0 || listen(listenSocket, 4) != 0){
+        perror("Export endpoint disabled on Unix socket: unable to listen");
+        close(listenSocket);
+        return -1;
+    }
+    return listenSocket;
+}
+
+// Server thread: one transfer at a time, from either listener
+static void* serveExports()
+{
+    while (atomic_load(&isRunning)){
+        if (poll(listeners, numListeners, POLL_TIMEOUT_MS) <= 0){
+            continue;
+        }
+        for (int i = 0; i < numListeners; i++){
+            if (!(listeners[i].revents & POLLIN)){
+                continue;
+            }
+            int connection = accept(listeners[i].fd, NULL, NULL);
+            if (connection < 0){
+                continue;
+            }
+            // A stalled client gives up its transfer rather than holding the thread
+            struct timeval timeout = {.tv_sec = SEND_TIMEOUT_S, .tv_usec = 0};
+            setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            answerRequest(connection);
+            close(connection);
+        }
+    }
+    pthread_exit(NULL);
+}
+
+static void answerRequest(int connection)
+{
+    char request[REQUEST_MAX_LEN];
+    int requestLen = 0;
+    struct pollfd client = {connection, POLLIN, 0};
+    if (poll(&client, 1, REQUEST_TIMEOUT_MS) > 0){
+        requestLen = recv(connection, request, sizeof(request) - 1, MSG_DONTWAIT);
+    }
+    if (requestLen <= 0){
+        return;
+    }
+    request[requestLen] = 0;
+    Metrics_counterAdd(&requestsTotal, 1);
+
+    long long first = -1;
+    long long count = -1;
+    if (strncmp(request, "samples", strlen("samples")) == 0){
+        sscanf(request + strlen("samples"), "%lld %lld", &first, &count);
+        exportSamples(connection, first, count);
+    } else if (strncmp(request, "trace", strlen("trace")) == 0){
+        sscanf(request + strlen("trace"), "%lld %lld", &first, &count);
+        exportTrace(connection, first, count);
+    } else {
+        sendError(connection, "unknown request (samples [FIRST [COUNT]] or trace [OFFSET [LENGTH]])");
+    }
+}
+
+// Samples first .. first + count - 1, clipped to what the archive holds
+static void exportSamples(int connection, long long first, long long count)
+{
+    SampleArchive_t* archive = Sampler_getArchive();
+    long long written = SampleArchive_getWritten(archive);
+    long long oldest = SampleArchive_getOldest(archive);
+    if (first < oldest){
+        first = oldest;
+    }
+    if (first > written){
+        first = written;
+    }
+    if (count < 0 || count > written - first){
+        count = written - first;
+    }
+
+    char header[HEADER_MAX_LEN];
+    int headerLen = snprintf(header, sizeof(header), "samples %lld %lld f32le\n", first, count);
+    long long sent = 0;
+    do {
+        struct iovec iov[3];
+        int iovCount = 0;
+        // The header goes out with the first chunk
+        if (sent == 0){
+            iov[iovCount++] = (struct iovec){header, headerLen};
+        }
+        long long chunk = count - sent < CHUNK_SAMPLES ? count - sent : CHUNK_SAMPLES;
+        if (chunk > 0){
+            iovCount += SampleArchive_getSpans(archive, first + sent, chunk, iov + iovCount);
+        }
+        if (!sendAll(connection, iov, iovCount)){
+            Metrics_counterAdd(&truncatedTotal, 1);
+            return;
+        }
+        // The kernel has its own copy now; make sure the ring was not overwritten under it
+        if (!SampleArchive_isIntact(archive, first + sent)){
+            Metrics_counterAdd(&truncatedTotal, 1);
+            return;
+        }
+        sent += chunk;
+        Metrics_counterAdd(&bytesTotal, chunk * (long long)sizeof(float));
+    } while (sent < count);
+}
+
+// Bytes offset .. offset + length - 1 of the trace file, clipped to what is written
+static void exportTrace(int connection, long long offset, long long length)
+{
+    long long available = 0;
+    const char* path = Sampler_getTracePath(&available);
+    if (!path){
+        sendError(connection, "no trace (set LIGHT_SAMPLER_TRACE_RECORD or _REPLAY)");
+        return;
+    }
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0){
+        sendError(connection, "unable to open the trace");
+        if (fd >= 0){
+            close(fd);
+        }
+        return;
+    }
+    long long total = available < 0 || available > info.st_size ? info.st_size : available;
+    if (offset < 0){
+        offset = 0;
+    }
+    if (offset > total){
+        offset = total;
+    }
+    if (length < 0 || length > total - offset){
+        length = total - offset;
+    }
+
+    char header[HEADER_MAX_LEN];
+    int headerLen = snprintf(header, sizeof(header), "trace %lld %lld %lld\n", offset, length, total);
+    struct iovec iov = {header, headerLen};
+    bool isSent = sendAll(connection, &iov, 1);
+    off_t position = offset;
+    long long end = offset + length;
+    while (isSent && position < end){
+        size_t chunk = end - position < SENDFILE_CHUNK_BYTES ? end - position : SENDFILE_CHUNK_BYTES;
+        ssize_t bytes = sendfile(connection, fd, &position, chunk);
+        if (bytes < 0 && errno == EINTR){
+            continue;
+        }
+        // EAGAIN here is the send timeout: the client stopped reading
+        if (bytes <= 0){
+            isSent = false;
+        } else {
+            Metrics_counterAdd(&bytesTotal, bytes);
+        }
+    }
+    if (!isSent){
+        Metrics_counterAdd(&truncatedTotal, 1);
+    }
+    close(fd);
+}
+
+static void sendError(int connection, const char* reason)
+{
+    char text[HEADER_MAX_LEN];
+    snprintf(text, sizeof(text), "error %s\n", reason);
+    struct iovec iov = {text, strlen(text)};
+    sendAll(connection, &iov, 1);
+}
+
+// Gather-send until every byte is out, advancing past partial writes. This is
+// writev() with MSG_NOSIGNAL, so a client that hangs up cannot raise SIGPIPE.
+static bool sendAll(int connection, struct iovec* iov, int iovCount)
+{
+    while (iovCount > 0){
+        struct msghdr message = {.msg_iov = iov, .msg_iovlen = iovCount};
+        ssize_t sent = sendmsg(connection, &message, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR){
+            continue;
+        }
+        if (sent <= 0){
+            return false;
+        }
+        while (iovCount > 0 && (size_t)sent >= iov->iov_len){
+            sent -= iov->iov_len;
+            iov++;
+            iovCount--;
+        }
+        if (iovCount > 0){
+            iov->iov_base = (char*)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return true;
+}
@@ -8,7 +8,12 @@
 #include "hal/sampler.h"
 #include "hal/potLed.h"
 #include "hal/sigDisplay.h"
+#include "hal/statusLog.h"
+#include "hal/pinConfig.h"
+#include "hal/calibration.h"
 #include "network.h"
+#include "metricsServer.h"
+#include "exportServer.h"
 
 pthread_mutex_t mutexMain;
 pthread_cond_t condVarFinished;
@@ -22,11 +27,16 @@ int main()
 
     // Initialize all modules; HAL modules first
 
+    StatusLog_init();
+    PinConfig_init();
     Period_init();
+    Calibration_init();
     Sampler_init();
     PotLed_init();
     SigDisplay_init();
     Network_init(&condVarFinished);
+    MetricsServer_init();
+    ExportServer_init();
     
     // Wait on condition variable until signalled by networking thread
 
@@ -36,11 +46,16 @@ int main()
 
     // Cleanup all modules (HAL modules last)
 
+    ExportServer_cleanup();
+    MetricsServer_cleanup();
     Network_cleanup();
     Sampler_cleanup();
+    Calibration_cleanup();
     PotLed_cleanup();
     SigDisplay_cleanup();
+    PinConfig_cleanup();
     Period_cleanup();
+    StatusLog_cleanup();
     
     // Free mutex and cond var 
     
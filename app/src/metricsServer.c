@@ -0,0 +1,119 @@
+// metricsServer.c
+// Local scrape endpoint for the metrics registry (see metricsServer.h)
+
+#include "metricsServer.h"
+#include "hal/metrics.h"
+#include <arpa/inet.h>
+#include <assert.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define POLL_TIMEOUT_MS 100
+#define REQUEST_TIMEOUT_MS 50
+#define REQUEST_MAX_LEN 512
+#define EXPOSITION_MAX_LEN 65536
+#define HTTP_HEADER "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n"
+
+static pthread_t thread;
+static atomic_bool isRunning = true;
+static bool is_initialized = false;
+static int listenSocket = -1;
+
+// Only the server thread formats into this
+static char exposition[EXPOSITION_MAX_LEN];
+
+static void* serveScrapes();
+static void answerScrape(int connection);
+static bool sendAll(int connection, const char* data, int length);
+
+void MetricsServer_init(void)
+{
+    assert(!is_initialized);
+    is_initialized = true;
+    atomic_store(&isRunning, true);
+
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const char* port = getenv(METRICS_SERVER_PORT_ENV);
+    sin.sin_port = htons(port ? atoi(port) : METRICS_SERVER_PORT);
+
+    listenSocket = socket(PF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(listenSocket, (struct sockaddr*) &sin, sizeof(sin)) != 0 || listen(listenSocket, 4) != 0){
+        perror("Metrics endpoint disabled: unable to listen");
+        close(listenSocket);
+        listenSocket = -1;
+        return;
+    }
+    pthread_create(&thread, NULL, serveScrapes, NULL);
+}
+
+void MetricsServer_cleanup(void)
+{
+    assert(is_initialized);
+    is_initialized = false;
+    if (listenSocket < 0){
+        return;
+    }
+    atomic_store(&isRunning, false);
+    pthread_join(thread, NULL);
+    close(listenSocket);
+}
+
+// Server thread: one scrape at a time; a scrape is a snapshot and a close
+static void* serveScrapes()
+{
+    struct pollfd listener = {listenSocket, POLLIN, 0};
+    while (atomic_load(&isRunning)){
+        if (poll(&listener, 1, POLL_TIMEOUT_MS) <= 0){
+            continue;
+        }
+        int connection = accept(listenSocket, NULL, NULL);
+        if (connection < 0){
+            continue;
+        }
+        answerScrape(connection);
+        close(connection);
+    }
+    pthread_exit(NULL);
+}
+
+static void answerScrape(int connection)
+{
+    // Plain clients may send nothing at all, so only wait briefly for a request line
+    char request[REQUEST_MAX_LEN];
+    int requestLen = 0;
+    struct pollfd client = {connection, POLLIN, 0};
+    if (poll(&client, 1, REQUEST_TIMEOUT_MS) > 0){
+        requestLen = recv(connection, request, sizeof(request) - 1, MSG_DONTWAIT);
+    }
+    bool isHttp = requestLen >= 4 && strncmp(request, "GET ", 4) == 0;
+    if (isHttp && !sendAll(connection, HTTP_HEADER, sizeof(HTTP_HEADER) - 1)){
+        return;
+    }
+    int length = Metrics_format(exposition, sizeof(exposition));
+    sendAll(connection, exposition, length);
+}
+
+static bool sendAll(int connection, const char* data, int length)
+{
+    while (length > 0){
+        int sent = send(connection, data, length, MSG_NOSIGNAL);
+        if (sent <= 0){
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
@@ -4,6 +4,7 @@
 
 #include "network.h"
 #include <assert.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -12,26 +13,83 @@
 #include <unistd.h>
 #include <string.h>
 #include "hal/sampler.h"
+#include "hal/statusLog.h"
+#include "hal/histogram.h"
+#include "hal/metrics.h"
+#include "hal/timing.h"
+#include "hal/calibration.h"
+#include "reply.h"
+#include "push.h"
 
-#define HELP_MSG "\nAccepted command examples:\ncount      -- get the total number of samples taken.\nlength     -- get the number of samples taken in the previously completed second.\ndips       -- get the number of dips in the previously completed second.\nhistory    -- get all the samples in the previously completed second.\nstop       -- cause the server program to end.\n<enter>    -- repeat last command.\n"
+#define HELP_MSG "\nAccepted command examples:\ncount      -- get the total number of samples taken.\nlength     -- get the number of samples taken in the previously completed second.\ndips       -- get the number of dips in the previously completed second.\nhistory    -- get all the samples in the previously completed second.\nwindows    -- get the latest stats of every analysis window.\nwindow N   -- get the latest stats of analysis window N.\nwindow add L H -- add a window of L ms sliding every H ms (H = L for tumbling).\ncaptures   -- list the captured waveforms around recent dips.\ncapture N  -- get the samples around dip capture N (newest if N is omitted).\nchanges    -- list recent level steps and fades and their detection delay.\nspectrum   -- get the dominant frequencies of the previous second and the energy at the LED frequency.\nfilter     -- get the filter stages applied before dip detection and their cost.\nlatency    -- get histograms of reply data age and processing time, and status log counters.\nstamp on|off -- append acquisition/send timestamps to data replies.\nunits volts|lux -- report light levels in volts or calibrated lux.\ncalibration -- get the calibration curve and some table entries.\ncalibrate [F] -- rebuild the lux table from curve dir file F (default the board's).\nsubscribe N -- stream every N samples (multiple of 10) to this client as they are taken.\nunsubscribe -- stop streaming to this client.\nstop       -- cause the server program to end.\n<enter>    -- repeat last command.\n"
 #define MAX_LEN 1500
 #define MAX_WRITABLE_HISTORY 1470 //max number of bytes that can be sent for history without causing a line break
-#define PORT 12345
+#define NS_PER_US 1000
+#define REPLY_CACHE_ENV "LIGHT_SAMPLER_REPLY_CACHE"
+
+#define addStaticLiteral(reply, literal) Reply_addStatic((reply), (literal), sizeof(literal) - 1)
 
 static pthread_cond_t* mainCondVar;
-static pthread_mutex_t* sampleHistoryMutex;
 
-static bool isRunning = true;
+static atomic_bool isRunning = true;
 static bool is_initialized = false;
 static struct sockaddr_in sin;
 static int socketDescriptor;
 static bool firstMessage = true;
 static char lastMessage[MAX_LEN];
 
+// Reply pool and history scratch space for the receive thread's session
+static Reply_t replyPool;
+static double historyScratch[SAMPLER_HISTORY_CAPACITY];
+static DipCapture_info_t captureInfos[DIP_CAPTURE_SLOTS];
+static DipCapture_t captureScratch;
+static ChangePoint_event_t changeEvents[CHANGE_POINT_MAX_EVENTS];
+
+// Latency tracing: age of the newest sample in each data reply when it is sent,
+// and time from receiving a request to sending its reply (both in us)
+static Histogram_t dataAgeHistogram;
+static Histogram_t processingHistogram;
+static bool stampReplies = false;
+// Light levels go out in volts, or in lux through the calibration table
+static bool luxUnits = false;
+static Metrics_counter_t requestsTotal;
+static Metrics_counter_t unknownTotal;
+
+// Replies derived only from the history are built once per history epoch
+// (see Sampler_getHistoryEpoch) and resent as-is until the next rollover
+typedef struct {
+    long long epoch;            // -1 when empty
+    bool lux;                   // units it was built in
+    long long calibration;      // generation of the calibration table it was built with
+    Sampler_stamp_t stamp;
+    Reply_t reply;
+} cachedReply_t;
+static cachedReply_t lengthCache;
+static cachedReply_t dipsCache;
+static cachedReply_t historyCache;
+static bool cacheEnabled = true;
+static Metrics_counter_t cacheHits;
+static Metrics_counter_t cacheMisses;
+
 static pthread_t thread;
 
 static void* receiveData();
-static void processRx(char* messageRx, int bytesRx, struct sockaddr_in sinRemote, unsigned int sin_len);
+static void processRx(char* messageRx, int bytesRx, struct sockaddr_in sinRemote, unsigned int sin_len, long long rxNs);
+static bool addWindow(Reply_t* reply, int id);
+static void addHistogram(Reply_t* reply, const char* title, Histogram_t* histogram);
+static void addFilterChain(Reply_t* reply, FilterChain_t* chain);
+static void addSpectrum(Reply_t* reply);
+static void addCaptureList(Reply_t* reply);
+static void addChangePoints(Reply_t* reply);
+static bool addCapture(Reply_t* reply, long long id);
+static void addCalibration(Reply_t* reply);
+static void calibrate(Reply_t* reply, const char* name);
+static double toUnits(const Calibration_table_t* table, double volts);
+static const char* unitName(void);
+static Reply_t* getCachedReply(cachedReply_t* cache, void (*build)(Reply_t*, Sampler_stamp_t*), Sampler_stamp_t* stamp);
+static void buildLength(Reply_t* reply, Sampler_stamp_t* stamp);
+static void buildDips(Reply_t* reply, Sampler_stamp_t* stamp);
+static void buildHistory(Reply_t* reply, Sampler_stamp_t* stamp);
 
 // Begin/end the background thread which processes incoming data.
 void Network_init(pthread_cond_t* stopCondVar)
@@ -40,15 +98,31 @@ void Network_init(pthread_cond_t* stopCondVar)
     is_initialized = true;
 
     mainCondVar = stopCondVar;
-    sampleHistoryMutex = Sampler_getHistoryMutexRef();
+    Metrics_registerHistogram(&dataAgeHistogram, "light_sampler_reply_data_age_us", "Age of the newest sample in a data reply when sent.");
+    Metrics_registerHistogram(&processingHistogram, "light_sampler_reply_processing_us", "Time from receiving a request to sending its reply.");
+    Metrics_registerCounter(&requestsTotal, "light_sampler_requests_total", "UDP commands received.");
+    Metrics_registerCounter(&unknownTotal, "light_sampler_unknown_requests_total", "UDP commands not understood.");
+    Metrics_registerCounter(&cacheHits, "light_sampler_reply_cache_hits_total", "Replies resent from the per-second cache.");
+    Metrics_registerCounter(&cacheMisses, "light_sampler_reply_cache_misses_total", "Cacheable replies that had to be built.");
+    const char* cacheSetting = getenv(REPLY_CACHE_ENV);
+    cacheEnabled = !cacheSetting || strcmp(cacheSetting, "off") != 0;
+    lengthCache.epoch = -1;
+    dipsCache.epoch = -1;
+    historyCache.epoch = -1;
 
     memset(&sin, 0, sizeof(sin));
     sin.sin_family = AF_INET;
     sin.sin_addr.s_addr = htonl(INADDR_ANY);
-    sin.sin_port = htons(PORT);
+    const char* port = getenv(NETWORK_PORT_ENV);
+    sin.sin_port = htons(port ? atoi(port) : NETWORK_PORT);
 
     socketDescriptor = socket(PF_INET, SOCK_DGRAM, 0);
-    bind(socketDescriptor, (struct sockaddr*) &sin, sizeof(sin));
+    if (bind(socketDescriptor, (struct sockaddr*) &sin, sizeof(sin)) != 0){
+        // With several instances per host, a clash must not leave one running deaf
+        perror("Unable to bind command port");
+        exit(-1);
+    }
+    Push_init(socketDescriptor);
     pthread_create(&thread, NULL, receiveData, NULL);
 }
 
@@ -57,9 +131,17 @@ void Network_cleanup(void)
 {
     assert(is_initialized);
     is_initialized = false;
-    isRunning = false;
-    close(socketDescriptor);
+    atomic_store(&isRunning, false);
+    Push_cleanup();
+    // The thread has left its loop after "stop"; join before closing its socket
     pthread_join(thread, NULL);
+    close(socketDescriptor);
+    Metrics_unregister(&dataAgeHistogram);
+    Metrics_unregister(&processingHistogram);
+    Metrics_unregister(&requestsTotal);
+    Metrics_unregister(&unknownTotal);
+    Metrics_unregister(&cacheHits);
+    Metrics_unregister(&cacheMisses);
 }
 
 // main thread loop
@@ -71,11 +153,15 @@ static void* receiveData()
     struct sockaddr_in sinRemote;
     char messageRx[MAX_LEN];
 
-    while(isRunning){
+    while(atomic_load(&isRunning)){
         unsigned int sin_len = sizeof(sinRemote);
         int bytesRx = recvfrom(socketDescriptor, messageRx, MAX_LEN - 1, 0, (struct sockaddr*) &sinRemote, &sin_len);
+        if (bytesRx < 0){
+            continue;
+        }
+        long long rxNs = getTimeInNs();
         messageRx[bytesRx] = 0; //null-terminate
-        processRx(messageRx, bytesRx, sinRemote, sin_len);
+        processRx(messageRx, bytesRx, sinRemote, sin_len, rxNs);
 
     }
 
@@ -83,61 +169,406 @@ static void* receiveData()
 }
 
 // Send a reply to sender based on the incoming command
-static void processRx(char* messageRx, int bytesRx, struct sockaddr_in sinRemote, unsigned int sin_len)
+// Replies are assembled in the preallocated pool and sent straight from it with sendmsg()
+static void processRx(char* messageRx, int bytesRx, struct sockaddr_in sinRemote, unsigned int sin_len, long long rxNs)
 {
-    char messageTx[MAX_LEN];
+    // Stamp of the data the reply carries (left zeroed for replies without sample data)
+    Sampler_stamp_t dataStamp = {0, 0, 0};
 
     if (!firstMessage && bytesRx == 1 && messageRx[0]){
         messageRx = lastMessage;
     }
+    Metrics_counterAdd(&requestsTotal, 1);
+    Reply_t* reply = &replyPool;
+    Reply_begin(&replyPool, MAX_LEN);
     // Generated with some help from chatGPT for efficiency
     if (strncmp(messageRx, "help", strlen("help")) == 0 || strncmp(messageRx, "?", strlen("?")) == 0){
-        snprintf(messageTx, MAX_LEN, HELP_MSG);
+        Reply_addStatic(&replyPool, HELP_MSG, sizeof(HELP_MSG) - 1);
     }
     else if (strncmp(messageRx, "count", strlen("count")) == 0){
-        snprintf(messageTx, MAX_LEN, "# samples taken total: %lld\n", Sampler_getNumSamplesTaken());
+        addStaticLiteral(&replyPool, "# samples taken total: ");
+        Reply_addInt(&replyPool, Sampler_getNumSamplesTaken(), "\n");
+        dataStamp.newestSampleNs = Sampler_getLastSampleNs();
     }
     else if (strncmp(messageRx, "length", strlen("length")) == 0){
-        snprintf(messageTx, MAX_LEN, "# samples taken last second: %d\n", Sampler_getHistorySize());
+        reply = getCachedReply(&lengthCache, buildLength, &dataStamp);
     }
     else if (strncmp(messageRx, "dips", strlen("dips")) == 0){
-        snprintf(messageTx, MAX_LEN, "# Dips: %d\n", Sampler_getHistoryNumDips());
+        reply = getCachedReply(&dipsCache, buildDips, &dataStamp);
     }
     else if (strncmp(messageRx, "history", strlen("history")) == 0){
-        pthread_mutex_lock(sampleHistoryMutex);
-        int historySize = Sampler_getHistorySize();
-        double* history = Sampler_getHistory(&historySize);
-        pthread_mutex_unlock(sampleHistoryMutex);
-        int offset = 0;
-        int bytesWritten = 0;
-        for (int i = 0; i < historySize; i++){
-            if ((i+1) % 10 == 0 || i == historySize - 1){
-                bytesWritten = snprintf(messageTx + offset, MAX_LEN - offset, "%.3f,\n", history[i]);
-            } else {
-                bytesWritten = snprintf(messageTx + offset, MAX_LEN - offset, "%.3f, ", history[i]);
-            }
-            offset += bytesWritten;
-            if (offset == MAX_WRITABLE_HISTORY){
-                sendto(socketDescriptor, messageTx, strlen(messageTx), 0, (struct sockaddr*) &sinRemote, sin_len);
-                memset(messageTx, 0, sizeof(messageTx));
-                offset = 0;
-                bytesWritten = 0;
+        reply = getCachedReply(&historyCache, buildHistory, &dataStamp);
+    }
+    else if (strncmp(messageRx, "windows", strlen("windows")) == 0){
+        int numWindows = Sampler_getNumWindows();
+        for (int i = 0; i < numWindows; i++){
+            addWindow(&replyPool, i);
+            // Report the stalest window so the age is an upper bound
+            Sampler_stamp_t windowStamp;
+            if (Sampler_getWindowStamp(i, &windowStamp) && (i == 0 || windowStamp.newestSampleNs < dataStamp.newestSampleNs)){
+                dataStamp = windowStamp;
             }
         }
-        free(history);
+    }
+    else if (strncmp(messageRx, "window add", strlen("window add")) == 0){
+        int lengthMs = 0;
+        int hopMs = 0;
+        int id = -1;
+        if (sscanf(messageRx + strlen("window add"), "%d %d", &lengthMs, &hopMs) == 2){
+            id = Sampler_addWindow(lengthMs, hopMs);
+        }
+        if (id < 0){
+            Reply_addFormatted(&replyPool, "unable to add window (hop must divide length, at most %d hops, %d windows)\n", SAMPLE_WINDOW_MAX_PANES, SAMPLER_MAX_WINDOWS);
+        } else {
+            Reply_addFormatted(&replyPool, "added window %d\n", id);
+        }
+    }
+    else if (strncmp(messageRx, "window", strlen("window")) == 0){
+        int id = -1;
+        if (sscanf(messageRx + strlen("window"), "%d", &id) != 1 || !addWindow(&replyPool, id)){
+            addStaticLiteral(&replyPool, "unknown window (see 'windows')\n");
+        } else {
+            Sampler_getWindowStamp(id, &dataStamp);
+        }
+    }
+    else if (strncmp(messageRx, "captures", strlen("captures")) == 0){
+        addCaptureList(&replyPool);
+    }
+    else if (strncmp(messageRx, "changes", strlen("changes")) == 0){
+        addChangePoints(&replyPool);
+    }
+    else if (strncmp(messageRx, "capture", strlen("capture")) == 0){
+        long long id = -1;
+        sscanf(messageRx + strlen("capture"), "%lld", &id);
+        if (!addCapture(&replyPool, id)){
+            addStaticLiteral(&replyPool, "no such capture (see 'captures')\n");
+        }
+    }
+    else if (strncmp(messageRx, "spectrum", strlen("spectrum")) == 0){
+        addSpectrum(&replyPool);
+        Sampler_getHistoryStamp(&dataStamp);
+    }
+    else if (strncmp(messageRx, "filter", strlen("filter")) == 0){
+        addFilterChain(&replyPool, Sampler_getFilterChain());
+    }
+    else if (strncmp(messageRx, "latency", strlen("latency")) == 0){
+        addHistogram(&replyPool, "reply data age (us)", &dataAgeHistogram);
+        addHistogram(&replyPool, "reply processing (us)", &processingHistogram);
+        Reply_addFormatted(&replyPool, "status log: written=%lld dropped=%lld\n", StatusLog_getWritten(), StatusLog_getDropped());
+        Reply_addFormatted(&replyPool, "reply cache: %s, hits=%lld misses=%lld\n",
+                cacheEnabled ? "on" : "off", Metrics_counterGet(&cacheHits), Metrics_counterGet(&cacheMisses));
+    }
+    else if (strncmp(messageRx, "stamp", strlen("stamp")) == 0){
+        stampReplies = strstr(messageRx, "off") == NULL;
+        Reply_addFormatted(&replyPool, "timestamps %s\n", stampReplies ? "on" : "off");
+    }
+    else if (strncmp(messageRx, "units", strlen("units")) == 0){
+        luxUnits = strstr(messageRx, "lux") != NULL;
+        Reply_addFormatted(&replyPool, "light levels in %s\n", luxUnits ? "lux" : "volts");
+    }
+    else if (strncmp(messageRx, "calibration", strlen("calibration")) == 0){
+        addCalibration(&replyPool);
+    }
+    else if (strncmp(messageRx, "calibrate", strlen("calibrate")) == 0){
+        char name[CALIBRATION_SOURCE_LEN] = "";
+        sscanf(messageRx + strlen("calibrate"), "%127s", name);
+        calibrate(&replyPool, name);
+    }
+    else if (strncmp(messageRx, "subscribe", strlen("subscribe")) == 0){
+        int blockSamples = SAMPLE_BLOCK_SAMPLES;
+        sscanf(messageRx + strlen("subscribe"), "%d", &blockSamples);
+        blockSamples = Push_subscribe(&sinRemote, blockSamples);
+        if (blockSamples < 0){
+            Reply_addFormatted(&replyPool, "unable to subscribe (at most %d subscribers)\n", PUSH_MAX_SUBSCRIBERS);
+        } else {
+            Reply_addFormatted(&replyPool, "subscribed: %d samples per block, renew within %ds\n",
+                    blockSamples, PUSH_LEASE_MS / 1000);
+        }
+    }
+    else if (strncmp(messageRx, "unsubscribe", strlen("unsubscribe")) == 0){
+        bool wasSubscribed = Push_unsubscribe(&sinRemote);
+        Reply_addFormatted(&replyPool, "%s (blocks sent %lld, dropped %lld)\n",
+                wasSubscribed ? "unsubscribed" : "not subscribed", Push_getBlocksSent(), Push_getBlocksDropped());
     }
     else if (strncmp(messageRx, "stop", strlen("stop")) == 0){
-        snprintf(messageTx, MAX_LEN, "Program terminating.\n");
+        addStaticLiteral(&replyPool, "Program terminating.\n");
     }
     else{
-        snprintf(messageTx, MAX_LEN, "unknown command\n");
+        addStaticLiteral(&replyPool, "unknown command\n");
+        Metrics_counterAdd(&unknownTotal, 1);
     }
 
-    sendto(socketDescriptor, messageTx, strlen(messageTx), 0, (struct sockaddr*) &sinRemote, sin_len);
+    if (dataStamp.newestSampleNs > 0){
+        long long txNs = getTimeInNs();
+        long long ageUs = (txNs - dataStamp.newestSampleNs) / NS_PER_US;
+        Histogram_record(&dataAgeHistogram, ageUs);
+        if (stampReplies){
+            Reply_addFormatted(reply, "#stamp acq_oldest_ns=%lld acq_newest_ns=%lld published_ns=%lld tx_ns=%lld age_us=%lld\n",
+                    dataStamp.oldestSampleNs, dataStamp.newestSampleNs, dataStamp.publishedNs, txNs, ageUs);
+        }
+    }
+    Reply_send(reply, socketDescriptor, &sinRemote, sin_len, 0);
+    Histogram_record(&processingHistogram, (getTimeInNs() - rxNs) / NS_PER_US);
     if (strncmp(messageRx, "stop", strlen("stop")) == 0){
         pthread_cond_signal(mainCondVar);
-        isRunning = false;
+        atomic_store(&isRunning, false);
     }
     firstMessage = false;
-    memcpy(lastMessage, messageRx, sizeof(char) * bytesRx);
-}
\ No newline at end of file
+    // Keep the terminator so a shorter command does not inherit the tail of a longer one
+    memmove(lastMessage, messageRx, sizeof(char) * (bytesRx + 1));
+}
+
+// Get the reply for the current history epoch from `cache`, building it with
+// `build` on the first request of the epoch. A reply built while the history
+// rolled over, or carrying a per-request #stamp line, is not kept.
+static Reply_t* getCachedReply(cachedReply_t* cache, void (*build)(Reply_t*, Sampler_stamp_t*), Sampler_stamp_t* stamp)
+{
+    long long epoch = Sampler_getHistoryEpoch();
+    long long calibration = Calibration_getTable()->generation;
+    if (cacheEnabled && !stampReplies && cache->epoch == epoch && cache->lux == luxUnits && cache->calibration == calibration){
+        Metrics_counterAdd(&cacheHits, 1);
+        *stamp = cache->stamp;
+        return &cache->reply;
+    }
+    Metrics_counterAdd(&cacheMisses, 1);
+    build(&cache->reply, &cache->stamp);
+    bool stable = Sampler_getHistoryEpoch() == epoch;
+    cache->epoch = cacheEnabled && !stampReplies && stable ? epoch : -1;
+    cache->lux = luxUnits;
+    cache->calibration = calibration;
+    *stamp = cache->stamp;
+    return &cache->reply;
+}
+
+static void buildLength(Reply_t* reply, Sampler_stamp_t* stamp)
+{
+    Reply_begin(reply, MAX_LEN);
+    addStaticLiteral(reply, "# samples taken last second: ");
+    Reply_addInt(reply, Sampler_getHistorySize(), "\n");
+    Sampler_getHistoryStamp(stamp);
+}
+
+static void buildDips(Reply_t* reply, Sampler_stamp_t* stamp)
+{
+    Reply_begin(reply, MAX_LEN);
+    addStaticLiteral(reply, "# Dips: ");
+    Reply_addInt(reply, Sampler_getHistoryNumDips(), "\n");
+    Sampler_getHistoryStamp(stamp);
+}
+
+static void buildHistory(Reply_t* reply, Sampler_stamp_t* stamp)
+{
+    int historySize = Sampler_copyHistory(historyScratch, SAMPLER_HISTORY_CAPACITY);
+    Sampler_getHistoryStamp(stamp);
+    const Calibration_table_t* table = Calibration_holdTable();
+    Reply_begin(reply, MAX_WRITABLE_HISTORY);
+    for (int i = 0; i < historySize; i++){
+        bool endOfLine = (i+1) % 10 == 0 || i == historySize - 1;
+        Reply_addFixed3(reply, toUnits(table, historyScratch[i]), endOfLine ? ",\n" : ", ");
+    }
+    Calibration_releaseTable(table);
+}
+
+// Append one line describing the latest completed instance of window `id`
+// Returns false if there is no such window
+static bool addWindow(Reply_t* reply, int id)
+{
+    SampleWindow_stats_t stats;
+    if (!Sampler_getWindowStats(id, &stats)){
+        return false;
+    }
+    // In lux the average is the lux at the average voltage (the curve is not linear)
+    const Calibration_table_t* table = Calibration_holdTable();
+    double avg = stats.count > 0 ? stats.sum / stats.count : 0;
+    Reply_addFormatted(reply, "window %d (%dms every %dms) #%lld: samples %d, avg %.3f, min %.3f, max %.3f, dips %d\n",
+            id, stats.lengthMs, stats.hopMs, stats.windowNumber, stats.count, toUnits(table, avg),
+            toUnits(table, stats.min), toUnits(table, stats.max), stats.dips);
+    Calibration_releaseTable(table);
+    return true;
+}
+
+// Append a summary line and the non-empty buckets of a latency histogram
+static void addHistogram(Reply_t* reply, const char* title, Histogram_t* histogram)
+{
+    long long count = atomic_load(&histogram->count);
+    long long mean = count > 0 ? atomic_load(&histogram->sum) / count : 0;
+    Reply_addFormatted(reply, "# %s: n=%lld mean=%lld p50<=%lld p90<=%lld p99<=%lld max=%lld\n",
+            title, count, mean,
+            Histogram_percentile(histogram, 0.50),
+            Histogram_percentile(histogram, 0.90),
+            Histogram_percentile(histogram, 0.99),
+            atomic_load(&histogram->max));
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++){
+        long long bucketCount = atomic_load(&histogram->buckets[i]);
+        if (bucketCount > 0){
+            Reply_addFormatted(reply, "  <=%lld: %lld\n", Histogram_bucketUpperBound(i), bucketCount);
+        }
+    }
+}
+
+// Append one line per filter stage with its sample counts and cost per input sample
+static void addFilterChain(Reply_t* reply, FilterChain_t* chain)
+{
+    int numStages = FilterChain_getNumStages(chain);
+    if (numStages == 0){
+        addStaticLiteral(reply, "no filter (raw samples feed dip detection)\n");
+        return;
+    }
+    Reply_addFormatted(reply, "# filter: %d stages, decimation %d\n", numStages, FilterChain_getDecimation(chain));
+    for (int i = 0; i < numStages; i++){
+        FilterStage_t* stage = &chain->stages[i];
+        long long samplesIn = Metrics_counterGet(&stage->samplesIn);
+        long long costNs = Metrics_counterGet(&stage->costNs);
+        Reply_addFormatted(reply, "stage %d %s: in %lld, out %lld, %.1f ns/sample\n",
+                i, stage->description, samplesIn, Metrics_counterGet(&stage->samplesOut),
+                samplesIn > 0 ? (double)costNs / samplesIn : 0.0);
+    }
+}
+
+// Append the dominant frequency, band energy and peaks of the previous second's spectrum
+static void addSpectrum(Reply_t* reply)
+{
+    Spectrum_result_t result;
+    long long secondNumber;
+    if (!Sampler_getSpectrum(&result, &secondNumber)){
+        addStaticLiteral(reply, "no spectrum yet\n");
+        return;
+    }
+    Reply_addFormatted(reply, "# spectrum #%lld: %d samples at %.0fHz, %d-point FFT, %.2fHz bins\n",
+            secondNumber, result.numSamples, result.sampleRateHz, result.size, result.resolutionHz);
+    Reply_addFormatted(reply, "dominant %.2fHz at %.4fV\n", result.dominantHz, result.dominantMagnitude);
+    if (result.bandHighHz > 0){
+        double share = result.totalEnergy > 0 ? 100 * result.bandEnergy / result.totalEnergy : 0;
+        Reply_addFormatted(reply, "LED band %.0f-%.0fHz: energy %.3g (%.1f%% of total %.3g)\n",
+                result.bandLowHz, result.bandHighHz, result.bandEnergy, share, result.totalEnergy);
+    }
+    for (int i = 0; i < result.numPeaks; i++){
+        Reply_addFormatted(reply, "peak %d: %.2fHz %.4fV\n", i, result.peaks[i].frequencyHz, result.peaks[i].magnitude);
+    }
+}
+
+// Append one line per held dip capture, newest first
+static void addCaptureList(Reply_t* reply)
+{
+    int count = Sampler_listCaptures(captureInfos, DIP_CAPTURE_SLOTS);
+    if (count == 0){
+        addStaticLiteral(reply, "no dips captured yet\n");
+        return;
+    }
+    for (int i = 0; i < count; i++){
+        DipCapture_info_t* info = &captureInfos[i];
+        Reply_addFormatted(reply, "capture %lld: sample %lld, %.3fV below %.3fV, %d before + %d from trigger%s\n",
+                info->id, info->triggerSampleNumber, info->triggerVolts, info->thresholdVolts,
+                info->numPre, info->numPost, info->complete ? "" : " (capturing)");
+    }
+}
+
+static void addChangePoints(Reply_t* reply)
+{
+    int count = Sampler_listChangePoints(changeEvents, CHANGE_POINT_MAX_EVENTS);
+    if (count == 0){
+        addStaticLiteral(reply, "no level changes detected yet\n");
+        return;
+    }
+    const Calibration_table_t* table = Calibration_holdTable();
+    for (int i = 0; i < count; i++){
+        ChangePoint_event_t* event = &changeEvents[i];
+        Reply_addFormatted(reply, "change %lld: %s, %s %.3f%s -> %.3f%s, onset sample %lld, detected sample %lld (%lldms later)\n",
+                event->id, ChangePoint_methodName(event->method), event->direction > 0 ? "rise" : "fall",
+                toUnits(table, event->levelBefore), unitName(), toUnits(table, event->levelAfter), unitName(),
+                event->onsetSampleNumber, event->detectedSampleNumber,
+                event->detectedTimeMs - event->onsetTimeMs);
+    }
+    Calibration_releaseTable(table);
+}
+
+// Append a header and the samples of dip capture `id`, 10 per line like history.
+// Returns false if the capture is not held.
+static bool addCapture(Reply_t* reply, long long id)
+{
+    if (!Sampler_getCapture(id, &captureScratch)){
+        return false;
+    }
+    DipCapture_info_t* info = &captureScratch.info;
+    int numSamples = info->numPre + info->numPost;
+    const Calibration_table_t* table = Calibration_holdTable();
+    Reply_begin(reply, MAX_WRITABLE_HISTORY);
+    Reply_addFormatted(reply, "# capture %lld: trigger at sample %lld = index %d of %d, %.3f%s below %.3f%s%s\n",
+            info->id, info->triggerSampleNumber, info->numPre, numSamples, toUnits(table, info->triggerVolts), unitName(),
+            toUnits(table, info->thresholdVolts), unitName(), info->complete ? "" : " (capturing)");
+    for (int i = 0; i < numSamples; i++){
+        bool endOfLine = (i+1) % 10 == 0 || i == numSamples - 1;
+        Reply_addFixed3(reply, toUnits(table, captureScratch.samples[i]), endOfLine ? ",\n" : ", ");
+    }
+    Calibration_releaseTable(table);
+    return true;
+}
+
+// Append the curve in use and the table at a few counts
+static void addCalibration(Reply_t* reply)
+{
+    static const int counts[] = {0, 512, 1024, 2048, 3072, 3584, 4095};
+    const Calibration_table_t* table = Calibration_holdTable();
+    const Calibration_curve_t* curve = &table->curve;
+    Reply_addFormatted(reply, "# calibration #%lld from %s, built in %lldus\n",
+            table->generation, curve->source, table->buildNs / NS_PER_US);
+    if (curve->numPoints >= 2){
+        Reply_addFormatted(reply, "%d measured points, ref %.3fV\n", curve->numPoints, curve->refVolts);
+    } else {
+        Reply_addFormatted(reply, "divider: ref %.3fV, supply %.3fV, fixed %.0f ohms, photoresistor (%s) %.0f ohms at 10 lux, gamma %.2f\n",
+                curve->refVolts, curve->supplyVolts, curve->fixedOhms, curve->photoresistorOnTop ? "top" : "bottom",
+                curve->ohmsAt10Lux, curve->gamma);
+    }
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++){
+        Reply_addFormatted(reply, "count %d: %.3fV, %.3f lux\n", counts[i], table->volts[counts[i]], table->lux[counts[i]]);
+    }
+    Calibration_releaseTable(table);
+}
+
+// Load a curve and swap in its table: the board's own file if `name` is empty,
+// else the file `name` in the calibration directory. Anyone who can reach the
+// UDP port can send this, so a name may not leave that directory.
+static void calibrate(Reply_t* reply, const char* name)
+{
+    Calibration_curve_t curve;
+    char error[CALIBRATION_SOURCE_LEN + 64];
+    const char* path = getenv(CALIBRATION_FILE_ENV);
+    char namedPath[CALIBRATION_SOURCE_LEN];
+    if (name[0]){
+        const char* directory = getenv(CALIBRATION_DIR_ENV);
+        if (!directory || !directory[0]){
+            Reply_addFormatted(reply, "calibration unchanged: %s is not set\n", CALIBRATION_DIR_ENV);
+            return;
+        }
+        // A plain file name: no directories, no "..", no hidden files
+        if (strchr(name, '/') || name[0] == '.'){
+            Reply_addFormatted(reply, "calibration unchanged: give a file name in %s\n", CALIBRATION_DIR_ENV);
+            return;
+        }
+        if (snprintf(namedPath, sizeof(namedPath), "%s/%s", directory, name) >= (int)sizeof(namedPath)){
+            Reply_addFormatted(reply, "calibration unchanged: name too long\n");
+            return;
+        }
+        path = namedPath;
+    }
+    if (!path || !path[0]){
+        Calibration_defaultCurve(&curve);
+    } else if (!Calibration_loadCurve(path, &curve, error, sizeof(error))){
+        Reply_addFormatted(reply, "calibration unchanged: %s\n", error);
+        return;
+    }
+    Calibration_apply(&curve);
+    addCalibration(reply);
+}
+
+// `table` comes from Calibration_holdTable(), and each builder releases it
+// once its values are formatted: a `calibrate` may rebuild it after that
+static double toUnits(const Calibration_table_t* table, double volts)
+{
+    return luxUnits ? Calibration_voltsToLux(table, volts) : volts;
+}
+
+static const char* unitName(void)
+{
+    return luxUnits ? " lux" : "V";
+}
@@ -0,0 +1,249 @@
+// push.c
+// Streams sampler blocks to subscribers (see push.h)
+
+#include "push.h"
+#include "reply.h"
+#include "hal/blockQueue.h"
+#include "hal/sampler.h"
+#include "hal/metrics.h"
+#include "hal/timing.h"
+#include <assert.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#define MAX_LEN 1500
+#define POLL_TIMEOUT_MS 100
+#define NS_PER_MS 1000000LL
+
+typedef struct {
+    bool active;
+    struct sockaddr_in addr;
+    int blockSamples;
+    long long cursor;
+    long long lastSequence;
+    long long renewedNs;        // last `subscribe` from this client
+    // Base blocks gathered towards the next datagram
+    int pendingBlocks;
+    SampleBlock_t pending[PUSH_MAX_BLOCK_SAMPLES / SAMPLE_BLOCK_SAMPLES];
+} subscriber_t;
+
+static pthread_t thread;
+static pthread_mutex_t subscribersMutex = PTHREAD_MUTEX_INITIALIZER;
+static subscriber_t subscribers[PUSH_MAX_SUBSCRIBERS];
+static atomic_bool isRunning = true;
+static bool is_initialized = false;
+static int socketDescriptor;
+static BlockQueue_t* queue;
+static Reply_t pushReply;
+static Metrics_counter_t blocksSent;
+static Metrics_counter_t blocksDropped;
+static Metrics_counter_t leasesExpired;
+static Metrics_gauge_t subscribersGauge;
+
+static void* pushBlocks();
+static void deliverBlocks(subscriber_t* subscriber);
+static void sendPending(subscriber_t* subscriber);
+static void expireLeases(long long nowNs);
+static subscriber_t* findSubscriber(const struct sockaddr_in* addr);
+static void updateSubscribersGauge(void);
+
+void Push_init(int newSocketDescriptor)
+{
+    assert(!is_initialized);
+    is_initialized = true;
+    atomic_store(&isRunning, true);
+    socketDescriptor = newSocketDescriptor;
+    queue = Sampler_getBlockQueue();
+    memset(subscribers, 0, sizeof(subscribers));
+    Metrics_registerCounter(&blocksSent, "light_sampler_push_blocks_sent_total", "Sample blocks streamed to subscribers.");
+    Metrics_registerCounter(&blocksDropped, "light_sampler_push_blocks_dropped_total", "Sample blocks subscribers missed.");
+    Metrics_registerCounter(&leasesExpired, "light_sampler_push_leases_expired_total",
+            "Subscriptions dropped for not being renewed.");
+    Metrics_registerGauge(&subscribersGauge, "light_sampler_push_subscribers", "Active push subscribers.");
+    pthread_create(&thread, NULL, pushBlocks, NULL);
+}
+
+void Push_cleanup(void)
+{
+    assert(is_initialized);
+    is_initialized = false;
+    atomic_store(&isRunning, false);
+    pthread_join(thread, NULL);
+    Metrics_unregister(&blocksSent);
+    Metrics_unregister(&blocksDropped);
+    Metrics_unregister(&leasesExpired);
+    Metrics_unregister(&subscribersGauge);
+}
+
+int Push_subscribe(const struct sockaddr_in* addr, int blockSamples)
+{
+    assert(is_initialized);
+    if (blockSamples < SAMPLE_BLOCK_SAMPLES){
+        blockSamples = SAMPLE_BLOCK_SAMPLES;
+    }
+    if (blockSamples > PUSH_MAX_BLOCK_SAMPLES){
+        blockSamples = PUSH_MAX_BLOCK_SAMPLES;
+    }
+    blockSamples = (blockSamples + SAMPLE_BLOCK_SAMPLES - 1) / SAMPLE_BLOCK_SAMPLES * SAMPLE_BLOCK_SAMPLES;
+
+    pthread_mutex_lock(&subscribersMutex);
+    subscriber_t* subscriber = findSubscriber(addr);
+    if (subscriber){
+        // Renewal: keep the stream position, restarting the datagram only on a new size
+        if (subscriber->blockSamples != blockSamples){
+            subscriber->blockSamples = blockSamples;
+            subscriber->pendingBlocks = 0;
+        }
+    }
+    for (int i = 0; !subscriber && i < PUSH_MAX_SUBSCRIBERS; i++){
+        if (!subscribers[i].active){
+            subscriber = &subscribers[i];
+            subscriber->active = true;
+            subscriber->addr = *addr;
+            subscriber->blockSamples = blockSamples;
+            subscriber->cursor = BlockQueue_nextSequence(queue);
+            subscriber->lastSequence = subscriber->cursor - 1;
+            subscriber->pendingBlocks = 0;
+        }
+    }
+    if (subscriber){
+        subscriber->renewedNs = getTimeInNs();
+    }
+    updateSubscribersGauge();
+    pthread_mutex_unlock(&subscribersMutex);
+    return subscriber ? blockSamples : -1;
+}
+
+bool Push_unsubscribe(const struct sockaddr_in* addr)
+{
+    assert(is_initialized);
+    pthread_mutex_lock(&subscribersMutex);
+    subscriber_t* subscriber = findSubscriber(addr);
+    if (subscriber){
+        subscriber->active = false;
+    }
+    updateSubscribersGauge();
+    pthread_mutex_unlock(&subscribersMutex);
+    return subscriber != NULL;
+}
+
+long long Push_getBlocksSent(void)
+{
+    return Metrics_counterGet(&blocksSent);
+}
+
+long long Push_getBlocksDropped(void)
+{
+    return Metrics_counterGet(&blocksDropped);
+}
+
+// Push thread: sleep until the sampler publishes, then fan the new blocks out
+static void* pushBlocks()
+{
+    struct pollfd notify = {BlockQueue_notifyFd(queue), POLLIN, 0};
+    while (atomic_load(&isRunning)) {
+        poll(&notify, 1, POLL_TIMEOUT_MS);
+        BlockQueue_clearNotify(queue);
+        pthread_mutex_lock(&subscribersMutex);
+        expireLeases(getTimeInNs());
+        for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++){
+            if (subscribers[i].active){
+                deliverBlocks(&subscribers[i]);
+            }
+        }
+        pthread_mutex_unlock(&subscribersMutex);
+    }
+    pthread_exit(NULL);
+}
+
+// Gather the subscriber's new blocks and send every complete datagram
+static void deliverBlocks(subscriber_t* subscriber)
+{
+    int blocksPerDatagram = subscriber->blockSamples / SAMPLE_BLOCK_SAMPLES;
+    SampleBlock_t* next = &subscriber->pending[subscriber->pendingBlocks];
+    while (BlockQueue_read(queue, &subscriber->cursor, next) == BLOCK_QUEUE_OK){
+        long long missed = next->sequence - subscriber->lastSequence - 1;
+        if (missed > 0){
+            // Lost blocks: restart the datagram so it only holds consecutive samples
+            Metrics_counterAdd(&blocksDropped, missed + subscriber->pendingBlocks);
+            subscriber->pending[0] = *next;
+            subscriber->pendingBlocks = 0;
+        }
+        subscriber->lastSequence = next->sequence;
+        subscriber->pendingBlocks++;
+        if (subscriber->pendingBlocks == blocksPerDatagram){
+            sendPending(subscriber);
+            subscriber->pendingBlocks = 0;
+        }
+        next = &subscriber->pending[subscriber->pendingBlocks];
+    }
+}
+
+static void sendPending(subscriber_t* subscriber)
+{
+    SampleBlock_t* first = &subscriber->pending[0];
+    SampleBlock_t* last = &subscriber->pending[subscriber->pendingBlocks - 1];
+    int numDips = 0;
+    for (int i = 0; i < subscriber->pendingBlocks; i++){
+        numDips += subscriber->pending[i].numDips;
+    }
+    Reply_begin(&pushReply, MAX_LEN);
+    Reply_addFormatted(&pushReply, "#block seq=%lld first=%lld n=%d dips=%d acq_ns=%lld\n",
+            first->sequence, first->firstSampleNumber, subscriber->blockSamples, numDips, last->newestSampleNs);
+    for (int i = 0; i < subscriber->pendingBlocks; i++){
+        for (int s = 0; s < SAMPLE_BLOCK_SAMPLES; s++){
+            bool isLast = i == subscriber->pendingBlocks - 1 && s == SAMPLE_BLOCK_SAMPLES - 1;
+            Reply_addFixed3(&pushReply, subscriber->pending[i].samples[s], isLast ? "\n" : ", ");
+        }
+    }
+    // Never wait on a full socket buffer; a lost datagram shows up as a sequence gap
+    if (Reply_send(&pushReply, socketDescriptor, &subscriber->addr, sizeof(subscriber->addr), MSG_DONTWAIT) > 0){
+        Metrics_counterAdd(&blocksSent, subscriber->pendingBlocks);
+    } else {
+        Metrics_counterAdd(&blocksDropped, subscriber->pendingBlocks);
+    }
+}
+
+// Drop subscribers that have not renewed within the lease
+// subscribersMutex must be held
+static void expireLeases(long long nowNs)
+{
+    bool expired = false;
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++){
+        if (subscribers[i].active && nowNs - subscribers[i].renewedNs > PUSH_LEASE_MS * NS_PER_MS){
+            subscribers[i].active = false;
+            Metrics_counterAdd(&leasesExpired, 1);
+            expired = true;
+        }
+    }
+    if (expired){
+        updateSubscribersGauge();
+    }
+}
+
+static subscriber_t* findSubscriber(const struct sockaddr_in* addr)
+{
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++){
+        subscriber_t* subscriber = &subscribers[i];
+        if (subscriber->active && subscriber->addr.sin_addr.s_addr == addr->sin_addr.s_addr
+                && subscriber->addr.sin_port == addr->sin_port){
+            return subscriber;
+        }
+    }
+    return NULL;
+}
+
+// subscribersMutex must be held
+static void updateSubscribersGauge(void)
+{
+    int active = 0;
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++){
+        if (subscribers[i].active){
+            active++;
+        }
+    }
+    Metrics_gaugeSet(&subscribersGauge, active);
+}
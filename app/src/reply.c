@@ -0,0 +1,232 @@
+// reply.c
+// Implementation of preallocated, scatter-gather UDP replies (see reply.h)
+
+#include "reply.h"
+#include <assert.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+// Magnitudes are clamped here so value * 1000 always fits a long long
+#define FIXED3_MAX_MAGNITUDE 1e15
+
+static void addSegment(Reply_t* reply, const char* text, int length);
+static char* reserveStorage(Reply_t* reply, int length);
+static int appendSuffix(char* dest, const char* suffix);
+static bool sendSegments(int socketDescriptor, const struct sockaddr_in* dest, socklen_t destLen,
+        struct iovec* segments, int numSegments, int flags);
+
+void Reply_begin(Reply_t* reply, int datagramLimit)
+{
+    assert(datagramLimit > 0 && datagramLimit <= REPLY_MAX_DATAGRAM_LEN);
+    reply->storageUsed = 0;
+    reply->numDatagrams = 1;
+    reply->datagrams[0].numSegments = 0;
+    reply->datagrams[0].length = 0;
+    reply->datagramLimit = datagramLimit;
+    reply->overflowed = false;
+}
+
+void Reply_newDatagram(Reply_t* reply)
+{
+    if (reply->numDatagrams >= REPLY_MAX_DATAGRAMS){
+        reply->overflowed = true;
+        return;
+    }
+    Reply_datagram_t* datagram = &reply->datagrams[reply->numDatagrams++];
+    datagram->numSegments = 0;
+    datagram->length = 0;
+}
+
+void Reply_addStatic(Reply_t* reply, const char* text, int length)
+{
+    addSegment(reply, text, length);
+}
+
+void Reply_addInt(Reply_t* reply, long long value, const char* suffix)
+{
+    char* dest = reserveStorage(reply, REPLY_MAX_NUMBER_LEN + REPLY_MAX_SUFFIX_LEN);
+    if (dest){
+        int length = Reply_formatInt(dest, value);
+        length += appendSuffix(dest + length, suffix);
+        reply->storageUsed += length;
+        addSegment(reply, dest, length);
+    }
+}
+
+void Reply_addFixed3(Reply_t* reply, double value, const char* suffix)
+{
+    char* dest = reserveStorage(reply, REPLY_MAX_NUMBER_LEN + REPLY_MAX_SUFFIX_LEN);
+    if (dest){
+        int length = Reply_formatFixed3(dest, value);
+        length += appendSuffix(dest + length, suffix);
+        reply->storageUsed += length;
+        addSegment(reply, dest, length);
+    }
+}
+
+void Reply_addFormatted(Reply_t* reply, const char* format, ...)
+{
+    char* dest = reserveStorage(reply, 1);
+    if (!dest){
+        return;
+    }
+    int available = REPLY_STORAGE_LEN - reply->storageUsed;
+    if (available > reply->datagramLimit + 1){
+        available = reply->datagramLimit + 1;
+    }
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(dest, available, format, args);
+    va_end(args);
+    if (length < 0){
+        return;
+    }
+    if (length >= available){
+        // A cut line would read as a whole one; drop it and let the marker say so
+        reply->overflowed = true;
+        return;
+    }
+    reply->storageUsed += length;
+    addSegment(reply, dest, length);
+}
+
+int Reply_currentDatagramLength(const Reply_t* reply)
+{
+    return reply->datagrams[reply->numDatagrams - 1].length;
+}
+
+int Reply_send(Reply_t* reply, int socketDescriptor, const struct sockaddr_in* dest, socklen_t destLen, int flags)
+{
+    int sent = 0;
+    for (int i = 0; i < reply->numDatagrams; i++){
+        Reply_datagram_t* datagram = &reply->datagrams[i];
+        // Only the first datagram may be empty (an empty reply is still answered)
+        if (datagram->length == 0 && i > 0){
+            continue;
+        }
+        if (sendSegments(socketDescriptor, dest, destLen, datagram->segments, datagram->numSegments, flags)){
+            sent++;
+        }
+    }
+    if (reply->overflowed){
+        struct iovec marker = {(void*)REPLY_TRUNCATED_MARKER, strlen(REPLY_TRUNCATED_MARKER)};
+        if (sendSegments(socketDescriptor, dest, destLen, &marker, 1, flags)){
+            sent++;
+        }
+    }
+    return sent;
+}
+
+int Reply_formatInt(char* dest, long long value)
+{
+    char digits[REPLY_MAX_NUMBER_LEN];
+    int numDigits = 0;
+    int length = 0;
+    unsigned long long magnitude = (unsigned long long)value;
+    if (value < 0){
+        dest[length++] = '-';
+        magnitude = 0 - magnitude;
+    }
+    do {
+        digits[numDigits++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    while (numDigits > 0){
+        dest[length++] = digits[--numDigits];
+    }
+    return length;
+}
+
+int Reply_formatFixed3(char* dest, double value)
+{
+    int length = 0;
+    if (isnan(value)){
+        memcpy(dest, "nan", 3);
+        return 3;
+    }
+    if (value < 0){
+        dest[length++] = '-';
+        value = -value;
+    }
+    if (isinf(value)){
+        memcpy(dest + length, "inf", 3);
+        return length + 3;
+    }
+    if (value > FIXED3_MAX_MAGNITUDE){
+        value = FIXED3_MAX_MAGNITUDE;
+    }
+    long long scaled = (long long)(value * 1000.0 + 0.5);
+    length += Reply_formatInt(dest + length, scaled / 1000);
+    int fraction = (int)(scaled % 1000);
+    dest[length++] = '.';
+    dest[length++] = (char)('0' + fraction / 100);
+    dest[length++] = (char)('0' + (fraction / 10) % 10);
+    dest[length++] = (char)('0' + fraction % 10);
+    return length;
+}
+
+// Attach text to the current datagram, starting a new datagram if it would not fit.
+// Text that directly follows the previous segment in memory extends that segment.
+static void addSegment(Reply_t* reply, const char* text, int length)
+{
+    if (reply->overflowed){
+        return;
+    }
+    Reply_datagram_t* datagram = &reply->datagrams[reply->numDatagrams - 1];
+    if (datagram->length > 0 && (datagram->length + length > reply->datagramLimit || datagram->numSegments == REPLY_MAX_SEGMENTS)){
+        Reply_newDatagram(reply);
+        if (reply->overflowed){
+            return;
+        }
+        datagram = &reply->datagrams[reply->numDatagrams - 1];
+    }
+    if (datagram->numSegments > 0){
+        struct iovec* last = &datagram->segments[datagram->numSegments - 1];
+        if ((const char*)last->iov_base + last->iov_len == text){
+            last->iov_len += length;
+            datagram->length += length;
+            return;
+        }
+    }
+    datagram->segments[datagram->numSegments].iov_base = (void*)text;
+    datagram->segments[datagram->numSegments].iov_len = length;
+    datagram->numSegments++;
+    datagram->length += length;
+}
+
+// Returns space for `length` bytes in the pool storage, or NULL if the pool is exhausted
+static char* reserveStorage(Reply_t* reply, int length)
+{
+    if (reply->overflowed || reply->storageUsed + length > REPLY_STORAGE_LEN){
+        reply->overflowed = true;
+        return NULL;
+    }
+    return reply->storage + reply->storageUsed;
+}
+
+// Copies at most REPLY_MAX_SUFFIX_LEN characters of `suffix`; returns the count copied
+static int appendSuffix(char* dest, const char* suffix)
+{
+    int length = 0;
+    while (suffix[length] && length < REPLY_MAX_SUFFIX_LEN){
+        dest[length] = suffix[length];
+        length++;
+    }
+    return length;
+}
+
+// One sendmsg() of the segments to `dest`; returns true if it was accepted
+static bool sendSegments(int socketDescriptor, const struct sockaddr_in* dest, socklen_t destLen,
+        struct iovec* segments, int numSegments, int flags)
+{
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void*)dest;
+    msg.msg_namelen = destLen;
+    msg.msg_iov = segments;
+    msg.msg_iovlen = numSegments;
+    return sendmsg(socketDescriptor, &msg, flags) >= 0;
+}
@@ -0,0 +1,37 @@
+// bench.h
+// Minimal benchmark harness shared by the benchmark groups
+//
+// Each group checks Bench_enabled() for a case, times a fixed number of
+// iterations with Bench_nowNs(), and hands the result to Bench_report().
+// Results are printed as they complete and written as JSON at exit.
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdbool.h>
+
+// True if the case was selected on the command line (--filter)
+bool Bench_enabled(const char* name);
+
+// Scale a default iteration count (reduced under --quick)
+long long Bench_iterations(long long defaultIterations);
+
+// Monotonic time in ns, for timing loops
+long long Bench_nowNs(void);
+
+// Deterministic pseudo-random numbers so every run sees identical inputs
+void Bench_seedRandom(unsigned int seed);
+unsigned int Bench_random(void);
+
+// Record a finished case. `bytes` is the payload handled in total (0 if not applicable).
+void Bench_report(const char* name, long long iterations, long long elapsedNs, long long bytes);
+
+// Directory holding the simulated device tree
+const char* Bench_simRoot(void);
+
+// Benchmark groups
+void BenchHal_run(void);
+void BenchNetwork_run(void);
+void BenchDsp_run(void);
+
+#endif
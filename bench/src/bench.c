@@ -0,0 +1,158 @@
+// bench.c
+// Benchmark driver: parses options, sets up the simulated device, runs every
+// group, and writes machine-readable results.
+//
+// Usage: light_sampler_bench [--output results.json] [--filter substring] [--quick]
+
+#define _DEFAULT_SOURCE
+#include "bench.h"
+#include "hal/sysfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_RESULTS 128
+#define QUICK_DIVISOR 20
+
+typedef struct {
+    const char* name;
+    long long iterations;
+    long long elapsedNs;
+    long long bytes;
+} result_t;
+
+static result_t results[MAX_RESULTS];
+static int numResults = 0;
+static const char* filter = NULL;
+static bool quick = false;
+static unsigned int randomState = 1;
+static char simRoot[] = "/tmp/light_sampler_bench_XXXXXX";
+
+static void writeJson(FILE* out);
+static void removeSimRoot(void);
+
+int main(int argc, char* argv[])
+{
+    const char* outputPath = NULL;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc){
+            outputPath = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc){
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--quick") == 0){
+            quick = true;
+        } else {
+            fprintf(stderr, "usage: %s [--output results.json] [--filter substring] [--quick]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (!mkdtemp(simRoot)){
+        perror("Unable to create simulated device directory");
+        return 1;
+    }
+    Sysfs_setRoot(simRoot);
+
+    fprintf(stderr, "%-36s %12s %14s %14s %12s\n", "benchmark", "iterations", "ns/op", "ops/s", "MB/s");
+    BenchHal_run();
+    BenchNetwork_run();
+    BenchDsp_run();
+
+    if (outputPath){
+        FILE* out = fopen(outputPath, "w");
+        if (!out){
+            perror("Unable to open output file");
+            return 1;
+        }
+        writeJson(out);
+        fclose(out);
+    } else {
+        writeJson(stdout);
+    }
+    removeSimRoot();
+    return 0;
+}
+
+bool Bench_enabled(const char* name)
+{
+    return !filter || strstr(name, filter) != NULL;
+}
+
+long long Bench_iterations(long long defaultIterations)
+{
+    if (!quick){
+        return defaultIterations;
+    }
+    long long reduced = defaultIterations / QUICK_DIVISOR;
+    return reduced > 0 ? reduced : 1;
+}
+
+long long Bench_nowNs(void)
+{
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec * 1000000000LL + spec.tv_nsec;
+}
+
+void Bench_seedRandom(unsigned int seed)
+{
+    randomState = seed;
+}
+
+// Numerical Recipes LCG; quality is irrelevant, repeatability is not
+unsigned int Bench_random(void)
+{
+    randomState = randomState * 1664525u + 1013904223u;
+    return randomState >> 8;
+}
+
+void Bench_report(const char* name, long long iterations, long long elapsedNs, long long bytes)
+{
+    if (numResults < MAX_RESULTS){
+        results[numResults++] = (result_t){name, iterations, elapsedNs, bytes};
+    }
+    double seconds = elapsedNs / 1e9;
+    double nsPerOp = iterations > 0 ? (double)elapsedNs / iterations : 0;
+    double opsPerSec = seconds > 0 ? iterations / seconds : 0;
+    if (bytes > 0 && seconds > 0){
+        fprintf(stderr, "%-36s %12lld %14.1f %14.0f %12.2f\n", name, iterations, nsPerOp, opsPerSec, bytes / seconds / 1e6);
+    } else {
+        fprintf(stderr, "%-36s %12lld %14.1f %14.0f %12s\n", name, iterations, nsPerOp, opsPerSec, "-");
+    }
+}
+
+const char* Bench_simRoot(void)
+{
+    return simRoot;
+}
+
+static void writeJson(FILE* out)
+{
+    fprintf(out, "{\n  \"schema\": 1,\n  \"build_type\": \"%s\",\n  \"sanitizer\": \"%s\",\n  \"quick\": %s,\n  \"results\": [\n",
+            BENCH_BUILD_TYPE, BENCH_SANITIZER, quick ? "true" : "false");
+    for (int i = 0; i < numResults; i++){
+        result_t* r = &results[i];
+        double seconds = r->elapsedNs / 1e9;
+        fprintf(out, "    {\"name\": \"%s\", \"iterations\": %lld, \"elapsed_ns\": %lld, \"ns_per_op\": %.3f, \"ops_per_sec\": %.1f",
+                r->name, r->iterations, r->elapsedNs,
+                r->iterations > 0 ? (double)r->elapsedNs / r->iterations : 0.0,
+                seconds > 0 ? r->iterations / seconds : 0.0);
+        if (r->bytes > 0){
+            fprintf(out, ", \"bytes\": %lld, \"bytes_per_sec\": %.1f", r->bytes, seconds > 0 ? r->bytes / seconds : 0.0);
+        }
+        fprintf(out, "}%s\n", i + 1 < numResults ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// The simulated tree is shallow and only holds files the HAL created
+static void removeSimRoot(void)
+{
+    char command[sizeof(simRoot) + 16];
+    snprintf(command, sizeof(command), "rm -rf '%s'", simRoot);
+    if (system(command) != 0){
+        fprintf(stderr, "WARNING: unable to remove %s\n", simRoot);
+    }
+}
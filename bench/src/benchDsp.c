@@ -0,0 +1,181 @@
+// benchDsp.c
+// Benchmarks for the signal-processing stages run on the sample stream.
+//
+// The filter case runs the chain in sampler-sized blocks over 10 kHz input
+// decimated to 1 kHz, and reports the whole chain plus each stage's share
+// (from the stage's own counters) per input sample. The FFT cases time one
+// full window analysis (window, transform, peaks) per FFT size. The
+// change-point case feeds both detectors a noisy level that steps by 0.1V
+// every few seconds and reports the cost per sample and the mean delay.
+
+#include "bench.h"
+#include "hal/filterChain.h"
+#include "hal/spectrum.h"
+#include "hal/changePoint.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INPUT_RATE_HZ 10000
+#define OUTPUT_RATE_HZ 1000
+#define FILTER_SPEC "median:5,fir:32:10,lowpass:50"
+#define OUTPUT_BLOCK 10
+#define FILTER_LEVEL_VOLTS 0.9
+#define FLICKER_VOLTS 0.02
+// Outputs before this block are the filters settling and are not checked
+#define SETTLE_BLOCKS 10
+// The filtered level must be within this of the true level...
+#define FILTER_MEAN_TOLERANCE 0.002
+// ...and its peak-to-peak ripple under this (the input's is 0.06V: 0.04V flicker plus noise)
+#define FILTER_MAX_RIPPLE 0.012
+
+#define FFT_SAMPLE_RATE_HZ 1000
+#define FFT_FLICKER_HZ 51
+
+#define CHANGE_STEP_SAMPLES 5000
+#define CHANGE_STEP_VOLTS 0.1
+
+static void benchFilterChain(void);
+static void benchSpectrum(void);
+static void benchChangePoint(void);
+
+void BenchDsp_run(void)
+{
+    benchFilterChain();
+    benchSpectrum();
+    benchChangePoint();
+}
+
+// 0.9V light level with 250 Hz square PWM flicker and zero-mean ADC noise, sampled at 10 kHz
+static double flickeringVoltage(long long sampleIndex)
+{
+    double flicker = (sampleIndex / 20) % 2 == 0 ? FLICKER_VOLTS : -FLICKER_VOLTS;
+    double noise = ((int)(Bench_random() % 1001) - 500) / 50000.0;
+    return FILTER_LEVEL_VOLTS + flicker + noise;
+}
+
+static void benchFilterChain(void)
+{
+    static const char* stageNames[FILTER_MAX_STAGES] = {
+        "filter_stage0", "filter_stage1", "filter_stage2", "filter_stage3",
+    };
+    static FilterChain_t chain;
+    static double block[FILTER_MAX_BLOCK];
+    if (!Bench_enabled("filter_chain_10k_to_1k") && !Bench_enabled("filter_stage")){
+        return;
+    }
+    if (!FilterChain_parse(&chain, FILTER_SPEC, OUTPUT_RATE_HZ)){
+        abort();
+    }
+    int blockInputs = OUTPUT_BLOCK * FilterChain_getDecimation(&chain);
+    long long numBlocks = Bench_iterations(100000);
+    long long outputs = 0;
+    double checksum = 0;
+    double minOutput = INFINITY;
+    double maxOutput = -INFINITY;
+    Bench_seedRandom(6);
+    long long start = Bench_nowNs();
+    for (long long b = 0; b < numBlocks; b++){
+        for (int i = 0; i < blockInputs; i++){
+            block[i] = flickeringVoltage(b * blockInputs + i);
+        }
+        int count = FilterChain_process(&chain, block, blockInputs, block);
+        outputs += count;
+        checksum += block[count - 1];
+        for (int i = 0; b >= SETTLE_BLOCKS && i < count; i++){
+            minOutput = fmin(minOutput, block[i]);
+            maxOutput = fmax(maxOutput, block[i]);
+        }
+    }
+    long long elapsed = Bench_nowNs() - start;
+    // The flicker and noise must be gone: the output sits at the true level with little ripple
+    double mean = checksum / numBlocks;
+    double ripple = maxOutput - minOutput;
+    if (outputs != numBlocks * OUTPUT_BLOCK || fabs(mean - FILTER_LEVEL_VOLTS) > FILTER_MEAN_TOLERANCE
+            || ripple > FILTER_MAX_RIPPLE){
+        fprintf(stderr, "filter output check failed: %lld outputs, mean %f, ripple %f\n", outputs, mean, ripple);
+        abort();
+    }
+    // Includes generating the input; the stage lines below are the filters alone
+    Bench_report("filter_chain_10k_to_1k", numBlocks * blockInputs, elapsed, 0);
+    for (int i = 0; i < FilterChain_getNumStages(&chain); i++){
+        FilterStage_t* stage = &chain.stages[i];
+        fprintf(stderr, "  %s = %s\n", stageNames[i], stage->description);
+        Bench_report(stageNames[i], numBlocks * blockInputs, Metrics_counterGet(&stage->costNs), 0);
+    }
+}
+
+static void benchSpectrum(void)
+{
+    static const char* names[] = {"fft_256", "fft_512", "fft_1024", "fft_2048", "fft_4096"};
+    static const int sizes[] = {256, 512, 1024, 2048, 4096};
+    static Spectrum_t spectrum;
+    static double samples[SPECTRUM_MAX_SIZE];
+    Bench_seedRandom(7);
+    for (int i = 0; i < SPECTRUM_MAX_SIZE; i++){
+        samples[i] = 0.9 + 0.03 * sin(2 * M_PI * FFT_FLICKER_HZ * i / FFT_SAMPLE_RATE_HZ) + (Bench_random() % 1000) / 100000.0;
+    }
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+        if (!Bench_enabled(names[s])){
+            continue;
+        }
+        Spectrum_init(&spectrum, sizes[s]);
+        Spectrum_result_t result;
+        long long iterations = Bench_iterations(2000000 / sizes[s]);
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            Spectrum_analyze(&spectrum, samples, sizes[s], FFT_SAMPLE_RATE_HZ, FFT_FLICKER_HZ - 2, FFT_FLICKER_HZ + 2, &result);
+        }
+        long long elapsed = Bench_nowNs() - start;
+        if (fabs(result.dominantHz - FFT_FLICKER_HZ) > 1){
+            fprintf(stderr, "%s: dominant %.2fHz, expected %dHz\n", names[s], result.dominantHz, FFT_FLICKER_HZ);
+            abort();
+        }
+        Bench_report(names[s], iterations, elapsed, (long long)sizes[s] * iterations * (long long)sizeof(double));
+    }
+}
+
+// The level alternates between two values every CHANGE_STEP_SAMPLES (1kHz)
+static void benchChangePoint(void)
+{
+    static ChangePoint_t changePoint;
+    static double samples[2 * CHANGE_STEP_SAMPLES];
+    if (!Bench_enabled("change_point_sample")){
+        return;
+    }
+    Bench_seedRandom(8);
+    for (int i = 0; i < 2 * CHANGE_STEP_SAMPLES; i++){
+        samples[i] = 0.9 + (i >= CHANGE_STEP_SAMPLES ? CHANGE_STEP_VOLTS : 0) + (Bench_random() % 1000) / 50000.0;
+    }
+    ChangePoint_config_t config = ChangePoint_defaultConfig();
+    ChangePoint_init(&changePoint, &config);
+    long long iterations = Bench_iterations(4000000) / (2 * CHANGE_STEP_SAMPLES) * (2 * CHANGE_STEP_SAMPLES);
+    long long numEvents = 0;
+    long long cusumEvents = 0;
+    long long cusumDelayMs = 0;
+    long long start = Bench_nowNs();
+    for (long long i = 0; i < iterations; i++){
+        int raised = ChangePoint_addSample(&changePoint, samples[i % (2 * CHANGE_STEP_SAMPLES)], i, i, 0);
+        if (raised > 0){
+            ChangePoint_event_t events[CHANGE_POINT_NUM_METHODS];
+            raised = ChangePoint_list(&changePoint, events, raised);
+            for (int e = 0; e < raised; e++){
+                if (events[e].method == CHANGE_POINT_CUSUM){
+                    cusumEvents++;
+                    cusumDelayMs += events[e].detectedTimeMs - events[e].onsetTimeMs;
+                }
+            }
+            numEvents += raised;
+        }
+    }
+    long long elapsed = Bench_nowNs() - start;
+    // CUSUM must find every step after the first level (and nothing else)
+    long long numSteps = iterations / CHANGE_STEP_SAMPLES - 1;
+    if (cusumEvents != numSteps){
+        fprintf(stderr, "change point check failed: %lld cusum events for %lld steps\n", cusumEvents, numSteps);
+        abort();
+    }
+    fprintf(stderr, "  %lld events, cusum mean delay %.1fms\n", numEvents,
+            cusumEvents > 0 ? (double)cusumDelayMs / cusumEvents : 0.0);
+    Bench_report("change_point_sample", iterations, elapsed, 0);
+}
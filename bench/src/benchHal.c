@@ -0,0 +1,385 @@
+// benchHal.c
+// Benchmarks for the HAL hot paths: A2D read/parse, the per-sample update,
+// history swap/copy, Period_markEvent, the 14-seg display refresh,
+// metrics updates and scrape formatting, trace record/replay, count to lux
+// conversion (table lookup against computing the divider curve with pow()),
+// and the cost of reading each clock the timing module can use.
+
+#include "bench.h"
+#include "hal/calibration.h"
+#include "hal/metrics.h"
+#include "hal/periodTimer.h"
+#include "hal/sampleTrace.h"
+#include "hal/sampler.h"
+#include "hal/sigDisplay.h"
+#include "hal/pinConfig.h"
+#include "hal/sysfs.h"
+#include "hal/timing.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define A2D_FILE_VOLTAGE1 "/sys/bus/iio/devices/iio:device0/in_voltage1_raw"
+#define BASE_VOLTAGE 0.9
+#define DIP_EVERY_SAMPLES 250
+
+static void benchA2dRead(void);
+static void benchSampleUpdate(void);
+static void benchHistorySwap(void);
+static void benchHistoryCopy(void);
+static void benchPeriodMarkEvent(void);
+static void benchDisplayRefresh(void);
+static void benchMetrics(void);
+static void benchTrace(void);
+static void benchCalibration(void);
+static void benchClocks(void);
+static double syntheticVoltage(long long sampleIndex);
+static void fillHistory(void);
+
+void BenchHal_run(void)
+{
+    Period_init();
+    Calibration_init();
+    Sampler_initManual(BASE_VOLTAGE);
+
+    benchA2dRead();
+    benchSampleUpdate();
+    benchHistorySwap();
+    benchHistoryCopy();
+    benchPeriodMarkEvent();
+    benchDisplayRefresh();
+    benchMetrics();
+    benchTrace();
+    benchCalibration();
+    benchClocks();
+
+    Sampler_cleanup();
+    Calibration_cleanup();
+    Period_cleanup();
+}
+
+// Record a full second of samples and move it into the history
+static void fillHistory(void)
+{
+    long long timeMs = getTimeInMs();
+    for (int s = 0; s < SAMPLER_HISTORY_CAPACITY; s++){
+        Sampler_recordSample(syntheticVoltage(s), timeMs);
+    }
+    Sampler_moveCurrentDataToHistory();
+}
+
+// Light-level signal around BASE_VOLTAGE with a little noise and a regular dip
+static double syntheticVoltage(long long sampleIndex)
+{
+    double noise = (Bench_random() % 1000) / 100000.0;
+    if (sampleIndex % DIP_EVERY_SAMPLES < 20){
+        return BASE_VOLTAGE - 0.3 + noise;
+    }
+    return BASE_VOLTAGE + noise;
+}
+
+static void benchA2dRead(void)
+{
+    if (!Bench_enabled("a2d_read_parse")){
+        return;
+    }
+    Sysfs_writeInt(A2D_FILE_VOLTAGE1, 2047);
+    long long iterations = Bench_iterations(20000);
+    long long sum = 0;
+    long long start = Bench_nowNs();
+    for (long long i = 0; i < iterations; i++){
+        sum += Sysfs_readInt(A2D_FILE_VOLTAGE1);
+    }
+    long long elapsed = Bench_nowNs() - start;
+    if (sum != 2047 * iterations){
+        abort();
+    }
+    Bench_report("a2d_read_parse", iterations, elapsed, 0);
+}
+
+static void benchSampleUpdate(void)
+{
+    if (!Bench_enabled("sample_update")){
+        return;
+    }
+    Bench_seedRandom(1);
+    long long iterations = Bench_iterations(1000000);
+    long long timeMs = getTimeInMs();
+    long long start = Bench_nowNs();
+    for (long long i = 0; i < iterations; i++){
+        Sampler_recordSample(syntheticVoltage(i), timeMs + i);
+    }
+    Bench_report("sample_update", iterations, Bench_nowNs() - start, 0);
+}
+
+// Times only the swap; each swap moves a full second of samples
+static void benchHistorySwap(void)
+{
+    if (!Bench_enabled("history_swap")){
+        return;
+    }
+    Bench_seedRandom(2);
+    long long iterations = Bench_iterations(2000);
+    long long elapsed = 0;
+    for (long long i = 0; i < iterations; i++){
+        long long timeMs = getTimeInMs();
+        for (int s = 0; s < SAMPLER_HISTORY_CAPACITY; s++){
+            Sampler_recordSample(syntheticVoltage(s), timeMs);
+        }
+        long long start = Bench_nowNs();
+        Sampler_moveCurrentDataToHistory();
+        elapsed += Bench_nowNs() - start;
+    }
+    Bench_report("history_swap", iterations, elapsed, iterations * SAMPLER_HISTORY_CAPACITY * (long long)sizeof(double));
+}
+
+static void benchHistoryCopy(void)
+{
+    static double copy[SAMPLER_HISTORY_CAPACITY];
+    Bench_seedRandom(3);
+    fillHistory();
+    long long iterations = Bench_iterations(100000);
+    int size = Sampler_getHistorySize();
+    long long bytes = iterations * size * (long long)sizeof(double);
+
+    if (Bench_enabled("history_copy")){
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            Sampler_copyHistory(copy, SAMPLER_HISTORY_CAPACITY);
+        }
+        Bench_report("history_copy", iterations, Bench_nowNs() - start, bytes);
+    }
+    if (Bench_enabled("history_copy_malloc")){
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            int historySize = size;
+            free(Sampler_getHistory(&historySize));
+        }
+        Bench_report("history_copy_malloc", iterations, Bench_nowNs() - start, bytes);
+    }
+}
+
+// Clears the statistics as often as the history thread would, so the
+// timestamp buffer never fills
+static void benchPeriodMarkEvent(void)
+{
+    if (!Bench_enabled("period_mark_event")){
+        return;
+    }
+    Period_statistics_t stats;
+    long long iterations = Bench_iterations(1000000);
+    long long start = Bench_nowNs();
+    for (long long i = 0; i < iterations; i++){
+        Period_markEvent(PERIOD_EVENT_SAMPLE_LIGHT);
+        if (i % SAMPLER_HISTORY_CAPACITY == 0){
+            Period_getStatisticsAndClear(PERIOD_EVENT_SAMPLE_LIGHT, &stats);
+        }
+    }
+    Bench_report("period_mark_event", iterations, Bench_nowNs() - start, 0);
+}
+
+// The display thread keeps running in the background but sleeps 10ms per
+// frame, so it adds little noise to this measurement
+static void benchDisplayRefresh(void)
+{
+    if (!Bench_enabled("display_refresh")){
+        return;
+    }
+    PinConfig_init();
+    SigDisplay_init();
+    SigDisplay_setNumber(42);
+    long long iterations = Bench_iterations(5000);
+    long long start = Bench_nowNs();
+    for (long long i = 0; i < iterations; i++){
+        SigDisplay_refresh();
+    }
+    Bench_report("display_refresh", iterations, Bench_nowNs() - start, 0);
+    SigDisplay_cleanup();
+    PinConfig_cleanup();
+}
+
+// A counter update from a hot path, and one full scrape of the sampler's metrics
+static void benchMetrics(void)
+{
+    static Metrics_counter_t counter;
+    static char exposition[65536];
+    Metrics_registerCounter(&counter, "bench_counter_total", "Benchmark counter.");
+    if (Bench_enabled("metrics_counter_add")){
+        long long iterations = Bench_iterations(10000000);
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            Metrics_counterAdd(&counter, 1);
+        }
+        long long elapsed = Bench_nowNs() - start;
+        if (Metrics_counterGet(&counter) != iterations){
+            abort();
+        }
+        Bench_report("metrics_counter_add", iterations, elapsed, 0);
+    }
+    if (Bench_enabled("metrics_format")){
+        long long iterations = Bench_iterations(100000);
+        long long bytes = 0;
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            bytes += Metrics_format(exposition, sizeof(exposition));
+        }
+        Bench_report("metrics_format", iterations, Bench_nowNs() - start, bytes);
+    }
+    Metrics_unregister(&counter);
+}
+
+// Recording cost per sample, then a recorded trace fed through the per-sample update
+static void benchTrace(void)
+{
+    static SampleTrace_writer_t writer;
+    static SampleTrace_reader_t reader;
+    char path[SYSFS_MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/bench.trace", Bench_simRoot());
+    long long iterations = Bench_iterations(1000000);
+    const long long periodNs = 1060000;
+
+    Bench_seedRandom(5);
+    SampleTrace_openWriter(&writer, path, 0);
+    long long start = Bench_nowNs();
+    for (long long i = 0; i < iterations; i++){
+        SampleTrace_write(&writer, i * periodNs, (int)(syntheticVoltage(i) / 1.8 * 4095));
+    }
+    SampleTrace_closeWriter(&writer);
+    if (Bench_enabled("trace_write")){
+        Bench_report("trace_write", iterations, Bench_nowNs() - start, 0);
+    }
+
+    if (Bench_enabled("trace_replay_pipeline")){
+        long long timeUs;
+        int a2dReading;
+        long long count = 0;
+        long long timeMs = getTimeInMs();
+        SampleTrace_openReader(&reader, path);
+        start = Bench_nowNs();
+        while (SampleTrace_read(&reader, &timeUs, &a2dReading)){
+            Sampler_recordSample(((double)a2dReading / 4095.0) * 1.8, timeMs + timeUs / 1000);
+            count++;
+        }
+        long long elapsed = Bench_nowNs() - start;
+        SampleTrace_closeReader(&reader);
+        if (count != iterations){
+            abort();
+        }
+        Bench_report("trace_replay_pipeline", count, elapsed, 0);
+    }
+}
+
+// The divider curve as computed offline before the table: pow() per sample
+static double luxFromCount(const Calibration_curve_t* curve, int count)
+{
+    double volts = count * curve->refVolts / 4095.0;
+    double ohms = curve->fixedOhms * (curve->supplyVolts - volts) / volts;
+    return 10 * pow(ohms / curve->ohmsAt10Lux, -1 / curve->gamma);
+}
+
+static void benchCalibration(void)
+{
+    static int counts[4096];
+    Bench_seedRandom(9);
+    for (int i = 0; i < 4096; i++){
+        counts[i] = 1 + Bench_random() % 4000;
+    }
+    Calibration_curve_t curve;
+    Calibration_defaultCurve(&curve);
+    long long iterations = Bench_iterations(4000000);
+    double lookupSum = 0;
+    double powSum = 0;
+    if (Bench_enabled("lux_table_lookup")){
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            lookupSum += Calibration_countToLux(counts[i & 4095]);
+        }
+        Bench_report("lux_table_lookup", iterations, Bench_nowNs() - start, 0);
+    }
+    if (Bench_enabled("lux_pow_curve")){
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            powSum += luxFromCount(&curve, counts[i & 4095]);
+        }
+        Bench_report("lux_pow_curve", iterations, Bench_nowNs() - start, 0);
+    }
+    // The table holds floats, so the sums agree to float precision
+    if (lookupSum > 0 && powSum > 0 && fabs(lookupSum - powSum) > 1e-5 * powSum){
+        fprintf(stderr, "lux table disagrees with the curve: %f vs %f\n", lookupSum, powSum);
+        abort();
+    }
+    if (Bench_enabled("lux_table_rebuild")){
+        // Each rebuild first waits out the grace period, so only the build itself is timed
+        long long rebuilds = Bench_iterations(10);
+        long long buildNs = 0;
+        for (long long i = 0; i < rebuilds; i++){
+            Calibration_apply(&curve);
+            buildNs += Calibration_getTable()->buildNs;
+        }
+        Bench_report("lux_table_rebuild", rebuilds, buildNs, 0);
+    }
+}
+
+static long long readClockNs(clockid_t clock)
+{
+    struct timespec spec;
+    clock_gettime(clock, &spec);
+    return spec.tv_sec * 1000000000LL + spec.tv_nsec;
+}
+
+// Cost of one read of each time source. Every read feeds a running sum, so
+// the compiler cannot drop or hoist it; the sum's sign is checked at the end.
+static void benchClocks(void)
+{
+    static const struct {
+        const char* name;
+        clockid_t clock;
+    } clocks[] = {
+        {"clock_read_monotonic", CLOCK_MONOTONIC},
+        {"clock_read_monotonic_coarse", CLOCK_MONOTONIC_COARSE},
+        {"clock_read_realtime", CLOCK_REALTIME},
+        {"clock_read_boottime", CLOCK_BOOTTIME},
+    };
+    long long iterations = Bench_iterations(2000000);
+    long long sum = 0;
+    for (size_t c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++){
+        if (!Bench_enabled(clocks[c].name)){
+            continue;
+        }
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            sum += readClockNs(clocks[c].clock) & 1;
+        }
+        Bench_report(clocks[c].name, iterations, Bench_nowNs() - start, 0);
+    }
+    if (Bench_enabled("clock_read_ticks")){
+        fprintf(stderr, "  tick source %s, %.1f ticks/us\n", getTickSourceName(), getTicksPerUs());
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            sum += readTicks() & 1;
+        }
+        Bench_report("clock_read_ticks", iterations, Bench_nowNs() - start, 0);
+    }
+    if (Bench_enabled("clock_interval_ticks")){
+        // What a hot path pays per measured interval: two reads and a conversion
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            long long startTicks = readTicks();
+            sum += ticksToNs(readTicks() - startTicks) & 1;
+        }
+        Bench_report("clock_interval_ticks", iterations, Bench_nowNs() - start, 0);
+    }
+    if (Bench_enabled("clock_wall_offset")){
+        long long offsets = Bench_iterations(200000);
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < offsets; i++){
+            sum += getWallClockOffsetNs() & 1;
+        }
+        Bench_report("clock_wall_offset", offsets, Bench_nowNs() - start, 0);
+    }
+    if (sum < 0){
+        fprintf(stderr, "clock sum check failed\n");
+        abort();
+    }
+}
@@ -0,0 +1,390 @@
+// benchNetwork.c
+// Benchmarks for building and sending the `history` reply.
+//
+// Compares the original processRx() path (malloc'd copy, snprintf per value,
+// strlen + sendto + memset per datagram) with the pooled reply path
+// (Sampler_copyHistory, fixed-point formatter, sendmsg from the pool).
+// Replies go to a UDP socket on loopback that is drained as the run goes.
+//
+// The export cases compare bulk transfer of samples on loopback, counting
+// samples delivered to the receiver: the UDP text path (one `history` reply
+// received in full per request) against the binary export server
+// (exportServer.h) over TCP and a Unix socket, each request fetching the
+// whole sample archive.
+//
+// history_reply_lux_widest times the widest `history` reply (every value in
+// lux at CALIBRATION_MAX_LUX) and checks it fits the reply pool, and that a
+// reply too large for the pool arrives ending in the truncation marker.
+
+#include "bench.h"
+#include "reply.h"
+#include "exportServer.h"
+#include "hal/calibration.h"
+#include "hal/sampler.h"
+#include "hal/timing.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_LEN 1500
+#define MAX_WRITABLE_HISTORY 1470
+#define DRAIN_EVERY_REQUESTS 16
+#define EXPORT_BENCH_PORT "12397"
+#define EXPORT_RECEIVE_LEN (256 * 1024)
+
+static int senderSocket;
+static int receiverSocket;
+static struct sockaddr_in receiverAddr;
+
+static void openLoopback(void);
+static void closeLoopback(void);
+static void drainReceiver(void);
+static void fillHistory(void);
+static long long legacyHistoryReply(bool send);
+static long long pooledHistoryReply(bool send);
+static void benchExport(void);
+static long long receiveHistoryReply(void);
+static void benchWidestHistory(void);
+static int addWidestValues(Reply_t* reply, int count);
+static int receiveReply(int numDatagrams, char* lastDatagram);
+static long long fetchExport(int domain, const struct sockaddr* addr, socklen_t addrLen);
+
+void BenchNetwork_run(void)
+{
+    Sampler_initManual(0.9);
+    fillHistory();
+    openLoopback();
+
+    long long iterations = Bench_iterations(20000);
+    if (Bench_enabled("history_format_snprintf")){
+        long long bytes = 0;
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            bytes += legacyHistoryReply(false);
+        }
+        Bench_report("history_format_snprintf", iterations, Bench_nowNs() - start, bytes);
+    }
+    if (Bench_enabled("history_format_pooled")){
+        long long bytes = 0;
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            bytes += pooledHistoryReply(false);
+        }
+        Bench_report("history_format_pooled", iterations, Bench_nowNs() - start, bytes);
+    }
+    if (Bench_enabled("history_request_sendto")){
+        long long bytes = 0;
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            bytes += legacyHistoryReply(true);
+            if (i % DRAIN_EVERY_REQUESTS == 0){
+                drainReceiver();
+            }
+        }
+        Bench_report("history_request_sendto", iterations, Bench_nowNs() - start, bytes);
+    }
+    if (Bench_enabled("history_request_sendmsg")){
+        long long bytes = 0;
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            bytes += pooledHistoryReply(true);
+            if (i % DRAIN_EVERY_REQUESTS == 0){
+                drainReceiver();
+            }
+        }
+        Bench_report("history_request_sendmsg", iterations, Bench_nowNs() - start, bytes);
+    }
+
+    benchWidestHistory();
+    benchExport();
+    closeLoopback();
+    Sampler_cleanup();
+}
+
+// Realistic 1s of voltages: every value is an exact A2D step
+static void fillHistory(void)
+{
+    Bench_seedRandom(4);
+    long long timeMs = getTimeInMs();
+    for (int i = 0; i < SAMPLER_HISTORY_CAPACITY; i++){
+        int a2dReading = 1800 + Bench_random() % 400;
+        Sampler_recordSample(((double)a2dReading / 4095.0) * 1.8, timeMs);
+    }
+    Sampler_moveCurrentDataToHistory();
+}
+
+// The `history` branch of processRx() as originally written; returns bytes formatted
+static long long legacyHistoryReply(bool send)
+{
+    char messageTx[MAX_LEN];
+    long long total = 0;
+    int historySize = Sampler_getHistorySize();
+    double* history = Sampler_getHistory(&historySize);
+    int offset = 0;
+    int bytesWritten = 0;
+    for (int i = 0; i < historySize; i++){
+        if ((i+1) % 10 == 0 || i == historySize - 1){
+            bytesWritten = snprintf(messageTx + offset, MAX_LEN - offset, "%.3f,\n", history[i]);
+        } else {
+            bytesWritten = snprintf(messageTx + offset, MAX_LEN - offset, "%.3f, ", history[i]);
+        }
+        offset += bytesWritten;
+        if (offset == MAX_WRITABLE_HISTORY){
+            total += strlen(messageTx);
+            if (send){
+                sendto(senderSocket, messageTx, strlen(messageTx), 0, (struct sockaddr*) &receiverAddr, sizeof(receiverAddr));
+            }
+            memset(messageTx, 0, sizeof(messageTx));
+            offset = 0;
+            bytesWritten = 0;
+        }
+    }
+    free(history);
+    total += strlen(messageTx);
+    if (send){
+        sendto(senderSocket, messageTx, strlen(messageTx), 0, (struct sockaddr*) &receiverAddr, sizeof(receiverAddr));
+    }
+    return total;
+}
+
+// The pooled path used by processRx(); returns bytes formatted
+static long long pooledHistoryReply(bool send)
+{
+    static Reply_t reply;
+    static double history[SAMPLER_HISTORY_CAPACITY];
+    int historySize = Sampler_copyHistory(history, SAMPLER_HISTORY_CAPACITY);
+    Reply_begin(&reply, MAX_WRITABLE_HISTORY);
+    for (int i = 0; i < historySize; i++){
+        bool endOfLine = (i+1) % 10 == 0 || i == historySize - 1;
+        Reply_addFixed3(&reply, history[i], endOfLine ? ",\n" : ", ");
+    }
+    if (send){
+        Reply_send(&reply, senderSocket, &receiverAddr, sizeof(receiverAddr), 0);
+    }
+    long long total = 0;
+    for (int i = 0; i < reply.numDatagrams; i++){
+        total += reply.datagrams[i].length;
+    }
+    return total;
+}
+
+static void openLoopback(void)
+{
+    receiverSocket = socket(PF_INET, SOCK_DGRAM, 0);
+    senderSocket = socket(PF_INET, SOCK_DGRAM, 0);
+    memset(&receiverAddr, 0, sizeof(receiverAddr));
+    receiverAddr.sin_family = AF_INET;
+    receiverAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    receiverAddr.sin_port = 0;
+    socklen_t addrLen = sizeof(receiverAddr);
+    if (bind(receiverSocket, (struct sockaddr*) &receiverAddr, sizeof(receiverAddr)) != 0
+            || getsockname(receiverSocket, (struct sockaddr*) &receiverAddr, &addrLen) != 0){
+        perror("Unable to bind loopback receiver");
+        exit(1);
+    }
+}
+
+static void closeLoopback(void)
+{
+    close(senderSocket);
+    close(receiverSocket);
+}
+
+static void drainReceiver(void)
+{
+    char buffer[MAX_LEN];
+    while (recv(receiverSocket, buffer, sizeof(buffer), MSG_DONTWAIT) > 0){
+        // discard
+    }
+}
+
+static void benchWidestHistory(void)
+{
+    static Reply_t reply;
+    char lastDatagram[MAX_LEN];
+    if (!Bench_enabled("history_reply_lux_widest")){
+        return;
+    }
+    drainReceiver();
+    long long iterations = Bench_iterations(20000);
+    long long bytes = 0;
+    long long start = Bench_nowNs();
+    for (long long i = 0; i < iterations; i++){
+        Reply_begin(&reply, MAX_WRITABLE_HISTORY);
+        bytes += addWidestValues(&reply, SAMPLER_HISTORY_CAPACITY);
+        if (reply.overflowed){
+            fprintf(stderr, "widest history check failed: %d values overflow the reply pool\n", SAMPLER_HISTORY_CAPACITY);
+            abort();
+        }
+        if (i == 0){
+            int numSent = Reply_send(&reply, senderSocket, &receiverAddr, sizeof(receiverAddr), 0);
+            int received = receiveReply(numSent, lastDatagram);
+            if (numSent != reply.numDatagrams || received != bytes){
+                fprintf(stderr, "widest history check failed: %d of %lld bytes received\n", received, bytes);
+                abort();
+            }
+        }
+    }
+    Bench_report("history_reply_lux_widest", iterations, Bench_nowNs() - start, bytes);
+
+    // Twice the history cannot fit; it must say so rather than stop short silently
+    Reply_begin(&reply, MAX_WRITABLE_HISTORY);
+    addWidestValues(&reply, 2 * SAMPLER_HISTORY_CAPACITY);
+    int numSent = Reply_send(&reply, senderSocket, &receiverAddr, sizeof(receiverAddr), 0);
+    receiveReply(numSent, lastDatagram);
+    if (!reply.overflowed || strcmp(lastDatagram, REPLY_TRUNCATED_MARKER) != 0){
+        fprintf(stderr, "truncated reply check failed: last datagram \"%.32s\"\n", lastDatagram);
+        abort();
+    }
+}
+
+// Append `count` values formatted as buildHistory() does; returns bytes added
+static int addWidestValues(Reply_t* reply, int count)
+{
+    int before = reply->storageUsed;
+    for (int i = 0; i < count; i++){
+        bool endOfLine = (i+1) % 10 == 0 || i == count - 1;
+        Reply_addFixed3(reply, CALIBRATION_MAX_LUX, endOfLine ? ",\n" : ", ");
+    }
+    return reply->storageUsed - before;
+}
+
+// Receive `numDatagrams` datagrams, keeping the last as a string; returns bytes received
+static int receiveReply(int numDatagrams, char* lastDatagram)
+{
+    int bytes = 0;
+    lastDatagram[0] = '\0';
+    for (int i = 0; i < numDatagrams; i++){
+        int received = recv(receiverSocket, lastDatagram, MAX_LEN - 1, 0);
+        if (received <= 0){
+            perror("Lost a history datagram on loopback");
+            abort();
+        }
+        lastDatagram[received] = '\0';
+        bytes += received;
+    }
+    return bytes;
+}
+
+static void benchExport(void)
+{
+    if (!Bench_enabled("export_udp_history_text") && !Bench_enabled("export_tcp_samples")
+            && !Bench_enabled("export_unix_samples")){
+        return;
+    }
+    if (Bench_enabled("export_udp_history_text")){
+        drainReceiver();
+        long long iterations = Bench_iterations(5000);
+        long long samples = 0;
+        long long bytes = 0;
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            bytes += receiveHistoryReply();
+            samples += Sampler_getHistorySize();
+        }
+        Bench_report("export_udp_history_text", samples, Bench_nowNs() - start, bytes);
+    }
+
+    // Fill the archive so each export request moves all of it
+    long long timeMs = getTimeInMs();
+    for (int i = 0; i < SAMPLE_ARCHIVE_CAPACITY; i++){
+        Sampler_recordSample(0.9 + (Bench_random() % 400) / 4095.0, timeMs);
+    }
+    char socketPath[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    snprintf(socketPath, sizeof(socketPath), "%s/export.sock", Bench_simRoot());
+    setenv(EXPORT_SERVER_PORT_ENV, EXPORT_BENCH_PORT, 1);
+    setenv(EXPORT_SERVER_SOCKET_ENV, socketPath, 1);
+    ExportServer_init();
+
+    struct sockaddr_in tcpAddr;
+    memset(&tcpAddr, 0, sizeof(tcpAddr));
+    tcpAddr.sin_family = AF_INET;
+    tcpAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    tcpAddr.sin_port = htons(atoi(EXPORT_BENCH_PORT));
+    struct sockaddr_un unixAddr;
+    memset(&unixAddr, 0, sizeof(unixAddr));
+    unixAddr.sun_family = AF_UNIX;
+    snprintf(unixAddr.sun_path, sizeof(unixAddr.sun_path), "%s", socketPath);
+
+    const char* names[] = {"export_tcp_samples", "export_unix_samples"};
+    const int domains[] = {AF_INET, AF_UNIX};
+    const struct sockaddr* addrs[] = {(struct sockaddr*)&tcpAddr, (struct sockaddr*)&unixAddr};
+    const socklen_t addrLens[] = {sizeof(tcpAddr), sizeof(unixAddr)};
+    for (int c = 0; c < 2; c++){
+        if (!Bench_enabled(names[c])){
+            continue;
+        }
+        long long iterations = Bench_iterations(50);
+        long long samples = 0;
+        long long start = Bench_nowNs();
+        for (long long i = 0; i < iterations; i++){
+            samples += fetchExport(domains[c], addrs[c], addrLens[c]);
+        }
+        Bench_report(names[c], samples, Bench_nowNs() - start, samples * (long long)sizeof(float));
+    }
+    ExportServer_cleanup();
+    unsetenv(EXPORT_SERVER_PORT_ENV);
+    unsetenv(EXPORT_SERVER_SOCKET_ENV);
+}
+
+// Send one pooled `history` reply and receive every datagram of it; returns bytes received
+static long long receiveHistoryReply(void)
+{
+    static Reply_t reply;
+    static double history[SAMPLER_HISTORY_CAPACITY];
+    char buffer[MAX_LEN];
+    int historySize = Sampler_copyHistory(history, SAMPLER_HISTORY_CAPACITY);
+    Reply_begin(&reply, MAX_WRITABLE_HISTORY);
+    for (int i = 0; i < historySize; i++){
+        bool endOfLine = (i+1) % 10 == 0 || i == historySize - 1;
+        Reply_addFixed3(&reply, history[i], endOfLine ? ",\n" : ", ");
+    }
+    Reply_send(&reply, senderSocket, &receiverAddr, sizeof(receiverAddr), 0);
+    long long bytes = 0;
+    for (int i = 0; i < reply.numDatagrams; i++){
+        int received = recv(receiverSocket, buffer, sizeof(buffer), 0);
+        if (received <= 0){
+            perror("Lost a history datagram on loopback");
+            abort();
+        }
+        bytes += received;
+    }
+    return bytes;
+}
+
+// Request every archived sample and read the reply to the end; returns samples received
+static long long fetchExport(int domain, const struct sockaddr* addr, socklen_t addrLen)
+{
+    static char buffer[EXPORT_RECEIVE_LEN];
+    int connection = socket(domain, SOCK_STREAM, 0);
+    if (connection < 0 || connect(connection, addr, addrLen) != 0){
+        perror("Unable to connect to the export server");
+        abort();
+    }
+    send(connection, "samples", strlen("samples"), 0);
+    // The header line arrives with the first read
+    char header[64] = {0};
+    long long received = 0;
+    int bytes;
+    while ((bytes = recv(connection, buffer, sizeof(buffer), 0)) > 0){
+        if (received == 0){
+            memcpy(header, buffer, bytes < (int)sizeof(header) - 1 ? bytes : (int)sizeof(header) - 1);
+        }
+        received += bytes;
+    }
+    close(connection);
+
+    long long first = 0;
+    long long count = 0;
+    char* newline = strchr(header, '\n');
+    if (sscanf(header, "samples %lld %lld", &first, &count) != 2 || !newline
+            || received != (newline - header) + 1 + count * (long long)sizeof(float)){
+        fprintf(stderr, "export reply check failed: %lld bytes for %lld samples\n", received, count);
+        abort();
+    }
+    return count;
+}
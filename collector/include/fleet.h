@@ -0,0 +1,88 @@
+// fleet.h
+// Module holding the collector's per-board series, built from the block
+// datagrams that each light sampler pushes to its subscribers (see app/push.h).
+//
+// Each board gets a ring of FLEET_HISTORY_SECONDS one-second bins. Bins are
+// keyed by the collector's clock, so all boards share the same seconds.
+// A board's sample times are on its own monotonic clock. They are mapped
+// onto the collector's clock by the smallest (receive - acquisition) offset
+// seen from that board, which is the offset of its fastest datagram. A late
+// datagram therefore still lands in the second its samples were taken.
+// Memory is fixed: FLEET_MAX_BOARDS boards × FLEET_HISTORY_SECONDS bins.
+// Not thread-safe; the collector uses it from a single thread.
+
+#ifndef _FLEET_H_
+#define _FLEET_H_
+
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#define FLEET_MAX_BOARDS 256
+#define FLEET_HISTORY_SECONDS 60
+// A board with no datagram for this long is stale (and is resubscribed)
+#define FLEET_STALE_NS 2000000000LL
+// Samples are taken every ms; used to place each sample of a datagram in time
+#define FLEET_SAMPLE_PERIOD_NS 1000000LL
+// How long after a second ends it is considered complete (datagram batching + latency)
+#define FLEET_SETTLE_NS 300000000LL
+
+typedef struct {
+    long long second;   // collector second this bin holds (-1 if never used)
+    int samples;
+    int dips;
+    double sum;
+    double min;
+    double max;
+} Fleet_bin_t;
+
+typedef struct {
+    struct sockaddr_in addr;
+    char name[32];                  // "host:port"
+    bool haveOffset;
+    long long offsetNs;             // collector time - board acquisition time
+    long long lastSequence;         // -1 before the first datagram
+    long long lastRxNs;             // 0 before the first datagram
+    long long lastSubscribeNs;
+    long long datagrams;
+    long long samples;
+    long long dips;
+    long long lostBlocks;           // gaps in the block sequence
+    long long restarts;             // sequence went backwards (board restarted)
+    Fleet_bin_t bins[FLEET_HISTORY_SECONDS];
+} Fleet_board_t;
+
+typedef struct {
+    long long startNs;
+    int numBoards;
+    Fleet_board_t boards[FLEET_MAX_BOARDS];
+    // Open-addressed index from address to board, twice the board capacity
+    short index[2 * FLEET_MAX_BOARDS];
+    long long datagrams;
+    long long parseErrors;
+    long long unknownSenders;
+} Fleet_t;
+
+// Start an empty fleet whose second 0 begins at `startNs` (getTimeInNs clock).
+void Fleet_init(Fleet_t* fleet, long long startNs);
+
+// Add a board; returns it, or NULL if the fleet is full or it is already present.
+Fleet_board_t* Fleet_addBoard(Fleet_t* fleet, const struct sockaddr_in* addr);
+
+// Board sending from `addr`, or NULL.
+Fleet_board_t* Fleet_findBoard(Fleet_t* fleet, const struct sockaddr_in* addr);
+
+// Fold one "#block ..." datagram from `board`, received at `rxNs`, into its
+// series. Returns false (and counts a parse error) if it is not a block.
+bool Fleet_ingest(Fleet_t* fleet, Fleet_board_t* board, const char* datagram, int length, long long rxNs);
+
+// Newest second that every live board has had time to fill at `nowNs` (-1 if none yet).
+long long Fleet_completeSecond(const Fleet_t* fleet, long long nowNs);
+
+// Copy `board`'s bin for `second`; an unfilled second reads as empty. Returns
+// false if the second is outside the history.
+bool Fleet_getBin(const Fleet_board_t* board, long long second, long long newestSecond, Fleet_bin_t* bin);
+
+// True if `board` has sent nothing for FLEET_STALE_NS (or ever).
+bool Fleet_isStale(const Fleet_board_t* board, long long nowNs);
+
+#endif
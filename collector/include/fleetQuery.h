@@ -0,0 +1,26 @@
+// fleetQuery.h
+// Module to answer the collector's text queries about the fleet (see fleet.h)
+//
+// Queries look at whole seconds that every board has had time to report
+// (Fleet_completeSecond), so all boards are compared over the same second:
+//   fleet          -- fleet-wide totals for the last complete second and the last minute
+//   boards         -- one line per board: rates, last-second level, losses, data age
+//   stragglers     -- boards that are stale or sampling well below the fleet median
+//   series [N]     -- dips per second for every board over the last N seconds, aligned
+
+#ifndef _FLEET_QUERY_H_
+#define _FLEET_QUERY_H_
+
+#include <stdbool.h>
+#include "fleet.h"
+
+// A board is a straggler when its last complete second has fewer samples than
+// this fraction of the fleet median
+#define FLEET_QUERY_STRAGGLER_FRACTION 0.9
+#define FLEET_QUERY_DEFAULT_SERIES 10
+
+// Write the answer to `command` into `out` (null-terminated, truncated to
+// `outLen`). Returns the length, or -1 if the command is not a fleet query.
+int FleetQuery_answer(const Fleet_t* fleet, const char* command, long long nowNs, char* out, int outLen);
+
+#endif
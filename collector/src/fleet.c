@@ -0,0 +1,210 @@
+// fleet.c
+// Per-board one-second series built from pushed sample blocks (see fleet.h)
+
+#include "fleet.h"
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NS_PER_SECOND 1000000000LL
+#define INDEX_SIZE (2 * FLEET_MAX_BOARDS)
+#define BLOCK_HEADER "#block seq=%lld first=%lld n=%d dips=%d acq_ns=%lld"
+// Samples per sequence number (SAMPLE_BLOCK_SAMPLES on the board)
+#define SAMPLES_PER_SEQUENCE 10
+
+static int slotFor(const struct sockaddr_in* addr);
+static bool sameAddress(const struct sockaddr_in* a, const struct sockaddr_in* b);
+static bool parseFixed(const char** text, const char* end, double* value);
+static void addToBin(Fleet_t* fleet, Fleet_board_t* board, long long timeNs, double volts, int dips);
+
+void Fleet_init(Fleet_t* fleet, long long startNs)
+{
+    memset(fleet, 0, sizeof(*fleet));
+    fleet->startNs = startNs;
+}
+
+Fleet_board_t* Fleet_addBoard(Fleet_t* fleet, const struct sockaddr_in* addr)
+{
+    if (fleet->numBoards >= FLEET_MAX_BOARDS || Fleet_findBoard(fleet, addr)){
+        return NULL;
+    }
+    Fleet_board_t* board = &fleet->boards[fleet->numBoards];
+    memset(board, 0, sizeof(*board));
+    board->addr = *addr;
+    board->lastSequence = -1;
+    for (int i = 0; i < FLEET_HISTORY_SECONDS; i++){
+        board->bins[i].second = -1;
+    }
+    char host[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr->sin_addr, host, sizeof(host));
+    snprintf(board->name, sizeof(board->name), "%s:%d", host, ntohs(addr->sin_port));
+
+    int slot = slotFor(addr);
+    while (fleet->index[slot] != 0){
+        slot = (slot + 1) % INDEX_SIZE;
+    }
+    fleet->index[slot] = fleet->numBoards + 1;
+    fleet->numBoards++;
+    return board;
+}
+
+Fleet_board_t* Fleet_findBoard(Fleet_t* fleet, const struct sockaddr_in* addr)
+{
+    for (int slot = slotFor(addr); fleet->index[slot] != 0; slot = (slot + 1) % INDEX_SIZE){
+        Fleet_board_t* board = &fleet->boards[fleet->index[slot] - 1];
+        if (sameAddress(&board->addr, addr)){
+            return board;
+        }
+    }
+    return NULL;
+}
+
+bool Fleet_ingest(Fleet_t* fleet, Fleet_board_t* board, const char* datagram, int length, long long rxNs)
+{
+    long long sequence, firstSample, acquiredNs;
+    int numSamples, numDips;
+    const char* end = datagram + length;
+    const char* body = memchr(datagram, '\n', length);
+    if (!body || sscanf(datagram, BLOCK_HEADER, &sequence, &firstSample, &numSamples, &numDips, &acquiredNs) != 5
+            || numSamples <= 0){
+        fleet->parseErrors++;
+        return false;
+    }
+    body++;
+    fleet->datagrams++;
+
+    // Sequence numbers count 10-sample blocks; lastSequence is the next one expected
+    if (board->lastSequence >= 0 && sequence < board->lastSequence){
+        // The board restarted: its clock offset may have changed too
+        board->restarts++;
+        board->haveOffset = false;
+    } else if (board->lastSequence >= 0 && sequence > board->lastSequence){
+        board->lostBlocks += sequence - board->lastSequence;
+    }
+    board->lastSequence = sequence + numSamples / SAMPLES_PER_SEQUENCE;
+    board->lastRxNs = rxNs;
+    board->datagrams++;
+    board->dips += numDips;
+
+    long long offsetNs = rxNs - acquiredNs;
+    if (!board->haveOffset || offsetNs < board->offsetNs){
+        board->offsetNs = offsetNs;
+        board->haveOffset = true;
+    }
+    long long newestNs = acquiredNs + board->offsetNs;
+    const char* cursor = body;
+    for (int i = 0; i < numSamples; i++){
+        double volts;
+        if (!parseFixed(&cursor, end, &volts)){
+            fleet->parseErrors++;
+            break;
+        }
+        // Dips are only known per datagram; count them with its newest sample
+        bool isNewest = i == numSamples - 1;
+        addToBin(fleet, board, newestNs - (numSamples - 1 - i) * FLEET_SAMPLE_PERIOD_NS, volts, isNewest ? numDips : 0);
+        board->samples++;
+    }
+    return true;
+}
+
+long long Fleet_completeSecond(const Fleet_t* fleet, long long nowNs)
+{
+    long long settled = nowNs - fleet->startNs - FLEET_SETTLE_NS;
+    return settled < NS_PER_SECOND ? -1 : settled / NS_PER_SECOND - 1;
+}
+
+bool Fleet_getBin(const Fleet_board_t* board, long long second, long long newestSecond, Fleet_bin_t* bin)
+{
+    if (second < 0 || second > newestSecond || second <= newestSecond - FLEET_HISTORY_SECONDS){
+        return false;
+    }
+    const Fleet_bin_t* stored = &board->bins[second % FLEET_HISTORY_SECONDS];
+    if (stored->second == second){
+        *bin = *stored;
+    } else {
+        memset(bin, 0, sizeof(*bin));
+        bin->second = second;
+    }
+    return true;
+}
+
+bool Fleet_isStale(const Fleet_board_t* board, long long nowNs)
+{
+    return board->lastRxNs == 0 || nowNs - board->lastRxNs > FLEET_STALE_NS;
+}
+
+static void addToBin(Fleet_t* fleet, Fleet_board_t* board, long long timeNs, double volts, int dips)
+{
+    if (timeNs < fleet->startNs){
+        return;
+    }
+    long long second = (timeNs - fleet->startNs) / NS_PER_SECOND;
+    Fleet_bin_t* bin = &board->bins[second % FLEET_HISTORY_SECONDS];
+    if (bin->second != second){
+        if (bin->second > second){
+            // Older than the history kept
+            return;
+        }
+        bin->second = second;
+        bin->samples = 0;
+        bin->dips = 0;
+        bin->sum = 0;
+        bin->min = volts;
+        bin->max = volts;
+    }
+    bin->samples++;
+    bin->dips += dips;
+    bin->sum += volts;
+    if (volts < bin->min){
+        bin->min = volts;
+    }
+    if (volts > bin->max){
+        bin->max = volts;
+    }
+}
+
+// Parse the next "d.ddd" value (optionally negative) of a ", "-separated
+// list, skipping separators; much cheaper than strtod for the push format
+static bool parseFixed(const char** text, const char* end, double* value)
+{
+    const char* p = *text;
+    while (p < end && (*p == ',' || *p == ' ' || *p == '\n')){
+        p++;
+    }
+    bool negative = p < end && *p == '-';
+    if (negative){
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9'){
+        return false;
+    }
+    long long whole = 0;
+    while (p < end && *p >= '0' && *p <= '9'){
+        whole = whole * 10 + (*p++ - '0');
+    }
+    long long fraction = 0;
+    long long scale = 1;
+    if (p < end && *p == '.'){
+        p++;
+        while (p < end && *p >= '0' && *p <= '9'){
+            fraction = fraction * 10 + (*p++ - '0');
+            scale *= 10;
+        }
+    }
+    double parsed = whole + (double)fraction / scale;
+    *value = negative ? -parsed : parsed;
+    *text = p;
+    return true;
+}
+
+static int slotFor(const struct sockaddr_in* addr)
+{
+    uint32_t key = ntohl(addr->sin_addr.s_addr) * 2654435761u ^ ntohs(addr->sin_port) * 40503u;
+    return key % INDEX_SIZE;
+}
+
+static bool sameAddress(const struct sockaddr_in* a, const struct sockaddr_in* b)
+{
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
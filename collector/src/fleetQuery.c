@@ -0,0 +1,210 @@
+// fleetQuery.c
+// Fleet-wide aggregate queries over the per-board series (see fleetQuery.h)
+
+#include "fleetQuery.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NS_PER_MS 1000000
+
+typedef struct {
+    char* text;
+    int length;
+    int capacity;
+} output_t;
+
+static void append(output_t* out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+static void answerFleet(const Fleet_t* fleet, long long second, long long nowNs, output_t* out);
+static void answerBoards(const Fleet_t* fleet, long long second, long long nowNs, output_t* out);
+static void answerStragglers(const Fleet_t* fleet, long long second, long long nowNs, output_t* out);
+static void answerSeries(const Fleet_t* fleet, long long second, int numSeconds, output_t* out);
+static int medianSamples(const Fleet_t* fleet, long long second);
+static bool isStraggler(const Fleet_board_t* board, long long second, long long nowNs, int median);
+static int compareInts(const void* a, const void* b);
+
+int FleetQuery_answer(const Fleet_t* fleet, const char* command, long long nowNs, char* text, int textLen)
+{
+    output_t out = {text, 0, textLen};
+    text[0] = 0;
+    long long second = Fleet_completeSecond(fleet, nowNs);
+    bool isQuery = true;
+    if (strncmp(command, "fleet", strlen("fleet")) == 0){
+        answerFleet(fleet, second, nowNs, &out);
+    } else if (strncmp(command, "boards", strlen("boards")) == 0){
+        answerBoards(fleet, second, nowNs, &out);
+    } else if (strncmp(command, "stragglers", strlen("stragglers")) == 0){
+        answerStragglers(fleet, second, nowNs, &out);
+    } else if (strncmp(command, "series", strlen("series")) == 0){
+        int numSeconds = FLEET_QUERY_DEFAULT_SERIES;
+        sscanf(command + strlen("series"), "%d", &numSeconds);
+        answerSeries(fleet, second, numSeconds, &out);
+    } else {
+        isQuery = false;
+    }
+    return isQuery ? out.length : -1;
+}
+
+// Totals for the last complete second and the last minute
+static void answerFleet(const Fleet_t* fleet, long long second, long long nowNs, output_t* out)
+{
+    int live = 0;
+    int stragglers = 0;
+    long long samples = 0;
+    long long dips = 0;
+    long long minuteDips = 0;
+    long long lost = 0;
+    long long restarts = 0;
+    double sum = 0;
+    int median = medianSamples(fleet, second);
+    for (int b = 0; b < fleet->numBoards; b++){
+        const Fleet_board_t* board = &fleet->boards[b];
+        live += Fleet_isStale(board, nowNs) ? 0 : 1;
+        stragglers += isStraggler(board, second, nowNs, median) ? 1 : 0;
+        lost += board->lostBlocks;
+        restarts += board->restarts;
+        Fleet_bin_t bin;
+        for (long long s = second; Fleet_getBin(board, s, second, &bin); s--){
+            if (s == second){
+                samples += bin.samples;
+                dips += bin.dips;
+                sum += bin.sum;
+            }
+            minuteDips += bin.dips;
+        }
+    }
+    append(out, "# fleet second %lld: %d boards (%d live, %d stale, %d stragglers)\n",
+            second, fleet->numBoards, live, fleet->numBoards - live, stragglers);
+    append(out, "samples %lld (median %d per board), dips %lld, avg %.3fV\n",
+            samples, median, dips, samples > 0 ? sum / samples : 0.0);
+    append(out, "last %ds: dips %lld (%.2f per board per second)\n", FLEET_HISTORY_SECONDS, minuteDips,
+            fleet->numBoards > 0 ? (double)minuteDips / fleet->numBoards / FLEET_HISTORY_SECONDS : 0.0);
+    append(out, "lost blocks %lld, board restarts %lld\n", lost, restarts);
+}
+
+// One line per board for the last complete second
+static void answerBoards(const Fleet_t* fleet, long long second, long long nowNs, output_t* out)
+{
+    append(out, "# second %lld: board, samples/s, dips/s, dips/min, avg, min, max, lost, age\n", second);
+    for (int b = 0; b < fleet->numBoards; b++){
+        const Fleet_board_t* board = &fleet->boards[b];
+        Fleet_bin_t bin;
+        long long minuteDips = 0;
+        memset(&bin, 0, sizeof(bin));
+        for (long long s = second; s > second - FLEET_HISTORY_SECONDS && s >= 0; s--){
+            Fleet_bin_t older;
+            if (Fleet_getBin(board, s, second, &older)){
+                minuteDips += older.dips;
+                if (s == second){
+                    bin = older;
+                }
+            }
+        }
+        long long ageMs = board->lastRxNs > 0 ? (nowNs - board->lastRxNs) / NS_PER_MS : -1;
+        append(out, "%s: %d, %d, %lld, %.3f, %.3f, %.3f, %lld, %lldms%s\n",
+                board->name, bin.samples, bin.dips, minuteDips, bin.samples > 0 ? bin.sum / bin.samples : 0.0,
+                bin.min, bin.max, board->lostBlocks, ageMs, Fleet_isStale(board, nowNs) ? " STALE" : "");
+    }
+}
+
+static void answerStragglers(const Fleet_t* fleet, long long second, long long nowNs, output_t* out)
+{
+    int median = medianSamples(fleet, second);
+    int count = 0;
+    for (int b = 0; b < fleet->numBoards; b++){
+        const Fleet_board_t* board = &fleet->boards[b];
+        if (!isStraggler(board, second, nowNs, median)){
+            continue;
+        }
+        Fleet_bin_t bin;
+        Fleet_getBin(board, second, second, &bin);
+        if (Fleet_isStale(board, nowNs)){
+            append(out, "%s: stale, last datagram %s\n", board->name,
+                    board->lastRxNs > 0 ? "over 2s ago" : "never");
+        } else {
+            append(out, "%s: %d samples in second %lld (fleet median %d)\n", board->name, bin.samples, second, median);
+        }
+        count++;
+    }
+    if (count == 0){
+        append(out, "no stragglers (median %d samples/s)\n", median);
+    }
+}
+
+// Dips per second of every board over the same seconds, oldest first
+static void answerSeries(const Fleet_t* fleet, long long second, int numSeconds, output_t* out)
+{
+    if (numSeconds < 1 || numSeconds > FLEET_HISTORY_SECONDS){
+        numSeconds = FLEET_QUERY_DEFAULT_SERIES;
+    }
+    long long first = second - numSeconds + 1 < 0 ? 0 : second - numSeconds + 1;
+    append(out, "# dips per second, seconds %lld-%lld\n", first, second);
+    long long totals[FLEET_HISTORY_SECONDS] = {0};
+    for (int b = 0; b < fleet->numBoards; b++){
+        const Fleet_board_t* board = &fleet->boards[b];
+        append(out, "%s:", board->name);
+        for (long long s = first; s <= second; s++){
+            Fleet_bin_t bin;
+            Fleet_getBin(board, s, second, &bin);
+            totals[s - first] += bin.dips;
+            append(out, " %d", bin.dips);
+        }
+        append(out, "\n");
+    }
+    append(out, "total:");
+    for (long long s = first; s <= second; s++){
+        append(out, " %lld", totals[s - first]);
+    }
+    append(out, "\n");
+}
+
+// Median samples in `second` over the boards that reported in it
+static int medianSamples(const Fleet_t* fleet, long long second)
+{
+    static int counts[FLEET_MAX_BOARDS];
+    int numCounts = 0;
+    for (int b = 0; b < fleet->numBoards; b++){
+        Fleet_bin_t bin;
+        if (Fleet_getBin(&fleet->boards[b], second, second, &bin) && bin.samples > 0){
+            counts[numCounts++] = bin.samples;
+        }
+    }
+    if (numCounts == 0){
+        return 0;
+    }
+    qsort(counts, numCounts, sizeof(int), compareInts);
+    return counts[numCounts / 2];
+}
+
+static bool isStraggler(const Fleet_board_t* board, long long second, long long nowNs, int median)
+{
+    if (Fleet_isStale(board, nowNs)){
+        return true;
+    }
+    Fleet_bin_t bin;
+    return Fleet_getBin(board, second, second, &bin) && bin.samples < FLEET_QUERY_STRAGGLER_FRACTION * median;
+}
+
+static int compareInts(const void* a, const void* b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+// printf into the output, stopping (null-terminated) at its capacity
+static void append(output_t* out, const char* format, ...)
+{
+    if (out->length >= out->capacity - 1){
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(out->text + out->length, out->capacity - out->length, format, args);
+    va_end(args);
+    if (written > 0){
+        out->length += written;
+        if (out->length > out->capacity - 1){
+            out->length = out->capacity - 1;
+        }
+    }
+}
@@ -0,0 +1,272 @@
+// Main program for the fleet collector
+// Subscribes to the block stream of every light sampler named on the command
+// line, folds the blocks into per-board series (fleet.h), and answers fleet
+// queries over UDP (fleetQuery.h). Everything runs on one thread around poll().
+//
+//   light_sampler_collector [--port P] host:port [host:port ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "hal/timing.h"
+#include "fleet.h"
+#include "fleetQuery.h"
+
+#define QUERY_PORT 12400
+// Samples per pushed datagram requested from each board
+#define SUBSCRIBE_BLOCK_SAMPLES 100
+// Stale boards are resubscribed at most this often
+#define RESUBSCRIBE_NS 1000000000LL
+// Live boards are resubscribed this often to renew the lease (PUSH_LEASE_MS, 30s)
+#define RENEW_NS 10000000000LL
+#define POLL_TIMEOUT_MS 100
+#define MAX_DATAGRAM 2048
+#define MAX_REPLY_DATAGRAM 1400
+#define REPLY_BUFFER_SIZE (FLEET_MAX_BOARDS * 512)
+#define SOCKET_BUFFER_BYTES (4 * 1024 * 1024)
+#define NS_PER_MS 1000000
+
+#define HELP_MSG "\nAccepted command examples:\nfleet      -- get fleet-wide totals for the last complete second and minute.\nboards     -- get each board's rates, level, losses and data age.\nstragglers -- get the boards that are stale or sampling below the fleet median.\nseries N   -- get every board's dips per second over the last N seconds.\nstats      -- get the collector's own ingest counters and cost.\nstop       -- cause the collector to end.\n"
+
+static Fleet_t fleet;
+static long long ingestNs = 0;
+static long long numIngested = 0;
+
+static void parseArguments(int argc, char* argv[], int* queryPort);
+static bool resolveBoard(const char* spec, struct sockaddr_in* addr);
+static int openSocket(int port);
+static void subscribeStale(int socketDescriptor, long long nowNs);
+static void receiveBlocks(int socketDescriptor);
+static bool answerQueries(int socketDescriptor);
+static int answerStats(char* text, int textLen, long long nowNs);
+static void sendLines(int socketDescriptor, const struct sockaddr_in* addr, const char* text, int length);
+
+int main(int argc, char* argv[])
+{
+    int queryPort = QUERY_PORT;
+    Fleet_init(&fleet, getTimeInNs());
+    parseArguments(argc, argv, &queryPort);
+
+    // Blocks arrive on an ephemeral port; queries on the well-known one
+    int boardSocket = openSocket(0);
+    int querySocket = openSocket(queryPort);
+    printf("Collecting from %d boards; queries on UDP port %d\n", fleet.numBoards, queryPort);
+
+    struct pollfd fds[2] = {
+        {.fd = boardSocket, .events = POLLIN},
+        {.fd = querySocket, .events = POLLIN},
+    };
+    bool isRunning = true;
+    while (isRunning){
+        subscribeStale(boardSocket, getTimeInNs());
+        if (poll(fds, 2, POLL_TIMEOUT_MS) < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            perror("Collector poll failed");
+            exit(-1);
+        }
+        if (fds[0].revents & POLLIN){
+            receiveBlocks(boardSocket);
+        }
+        if (fds[1].revents & POLLIN){
+            isRunning = answerQueries(querySocket);
+        }
+    }
+
+    // Stop the boards' streams before leaving
+    for (int b = 0; b < fleet.numBoards; b++){
+        sendto(boardSocket, "unsubscribe", strlen("unsubscribe"), 0,
+                (struct sockaddr*)&fleet.boards[b].addr, sizeof(fleet.boards[b].addr));
+    }
+    close(boardSocket);
+    close(querySocket);
+    return 0;
+}
+
+static void parseArguments(int argc, char* argv[], int* queryPort)
+{
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc){
+            *queryPort = atoi(argv[++i]);
+            continue;
+        }
+        struct sockaddr_in addr;
+        if (!resolveBoard(argv[i], &addr)){
+            printf("ERROR: expected host:port, got '%s'\n", argv[i]);
+            exit(-1);
+        }
+        if (!Fleet_addBoard(&fleet, &addr)){
+            printf("WARNING: skipping %s (duplicate, or more than %d boards)\n", argv[i], FLEET_MAX_BOARDS);
+        }
+    }
+    if (fleet.numBoards == 0){
+        printf("Usage: %s [--port P] host:port [host:port ...]\n", argv[0]);
+        exit(-1);
+    }
+}
+
+static bool resolveBoard(const char* spec, struct sockaddr_in* addr)
+{
+    char host[256];
+    const char* colon = strrchr(spec, ':');
+    if (!colon || colon == spec || (size_t)(colon - spec) >= sizeof(host)){
+        return false;
+    }
+    memcpy(host, spec, colon - spec);
+    host[colon - spec] = 0;
+
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_DGRAM};
+    struct addrinfo* found;
+    if (getaddrinfo(host, colon + 1, &hints, &found) != 0){
+        return false;
+    }
+    *addr = *(struct sockaddr_in*)found->ai_addr;
+    freeaddrinfo(found);
+    return true;
+}
+
+static int openSocket(int port)
+{
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port = htons(port);
+
+    int socketDescriptor = socket(PF_INET, SOCK_DGRAM, 0);
+    if (socketDescriptor < 0 || bind(socketDescriptor, (struct sockaddr*)&sin, sizeof(sin)) < 0){
+        perror("Unable to open collector socket");
+        exit(-1);
+    }
+    // A large receive buffer absorbs bursts from many boards between polls
+    int bufferBytes = SOCKET_BUFFER_BYTES;
+    setsockopt(socketDescriptor, SOL_SOCKET, SO_RCVBUF, &bufferBytes, sizeof(bufferBytes));
+    return socketDescriptor;
+}
+
+// (Re)subscribe to every board we have not heard from lately, and renew the
+// subscription of the others before it lapses
+static void subscribeStale(int socketDescriptor, long long nowNs)
+{
+    char message[32];
+    int length = snprintf(message, sizeof(message), "subscribe %d", SUBSCRIBE_BLOCK_SAMPLES);
+    for (int b = 0; b < fleet.numBoards; b++){
+        Fleet_board_t* board = &fleet.boards[b];
+        long long sinceNs = nowNs - board->lastSubscribeNs;
+        if (sinceNs < (Fleet_isStale(board, nowNs) ? RESUBSCRIBE_NS : RENEW_NS)){
+            continue;
+        }
+        sendto(socketDescriptor, message, length, 0, (struct sockaddr*)&board->addr, sizeof(board->addr));
+        board->lastSubscribeNs = nowNs;
+    }
+}
+
+// Drain every queued datagram without blocking
+static void receiveBlocks(int socketDescriptor)
+{
+    char datagram[MAX_DATAGRAM];
+    while (true){
+        struct sockaddr_in sinRemote;
+        socklen_t sinLen = sizeof(sinRemote);
+        int bytesRx = recvfrom(socketDescriptor, datagram, sizeof(datagram) - 1, MSG_DONTWAIT,
+                (struct sockaddr*)&sinRemote, &sinLen);
+        if (bytesRx < 0){
+            return;
+        }
+        datagram[bytesRx] = 0;
+        long long rxNs = getTimeInNs();
+        Fleet_board_t* board = Fleet_findBoard(&fleet, &sinRemote);
+        if (!board){
+            fleet.unknownSenders++;
+            continue;
+        }
+        // Command replies (e.g. "subscribed: ...") are not blocks
+        if (strncmp(datagram, "#block", strlen("#block")) != 0){
+            continue;
+        }
+        Fleet_ingest(&fleet, board, datagram, bytesRx, rxNs);
+        ingestNs += getTimeInNs() - rxNs;
+        numIngested++;
+    }
+}
+
+// Answer queued queries; returns false once asked to stop
+static bool answerQueries(int socketDescriptor)
+{
+    static char reply[REPLY_BUFFER_SIZE];
+    char messageRx[MAX_DATAGRAM];
+    while (true){
+        struct sockaddr_in sinRemote;
+        socklen_t sinLen = sizeof(sinRemote);
+        int bytesRx = recvfrom(socketDescriptor, messageRx, sizeof(messageRx) - 1, MSG_DONTWAIT,
+                (struct sockaddr*)&sinRemote, &sinLen);
+        if (bytesRx < 0){
+            return true;
+        }
+        messageRx[bytesRx] = 0;
+        long long nowNs = getTimeInNs();
+        int length = FleetQuery_answer(&fleet, messageRx, nowNs, reply, sizeof(reply));
+        if (length >= 0){
+            // Answered by the fleet
+        } else if (strncmp(messageRx, "stats", strlen("stats")) == 0){
+            length = answerStats(reply, sizeof(reply), nowNs);
+        } else if (strncmp(messageRx, "help", strlen("help")) == 0 || strncmp(messageRx, "?", strlen("?")) == 0){
+            length = snprintf(reply, sizeof(reply), "%s", HELP_MSG);
+        } else if (strncmp(messageRx, "stop", strlen("stop")) == 0){
+            length = snprintf(reply, sizeof(reply), "Program terminating.\n");
+            sendLines(socketDescriptor, &sinRemote, reply, length);
+            return false;
+        } else {
+            length = snprintf(reply, sizeof(reply), "Unknown command. Type 'help' for command list.\n");
+        }
+        sendLines(socketDescriptor, &sinRemote, reply, length);
+    }
+}
+
+static int answerStats(char* text, int textLen, long long nowNs)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double cpuMs = usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0
+            + usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+    long long samples = 0;
+    long long lost = 0;
+    for (int b = 0; b < fleet.numBoards; b++){
+        samples += fleet.boards[b].samples;
+        lost += fleet.boards[b].lostBlocks;
+    }
+    return snprintf(text, textLen,
+            "uptime %lldms, boards %d, datagrams %lld, samples %lld, lost blocks %lld\n"
+            "parse errors %lld, unknown senders %lld, ingest %.0fns per datagram, cpu %.0fms\n",
+            (nowNs - fleet.startNs) / NS_PER_MS, fleet.numBoards, fleet.datagrams, samples, lost,
+            fleet.parseErrors, fleet.unknownSenders,
+            numIngested > 0 ? (double)ingestNs / numIngested : 0.0, cpuMs);
+}
+
+// Send `text` in datagrams of at most MAX_REPLY_DATAGRAM bytes, split between lines
+static void sendLines(int socketDescriptor, const struct sockaddr_in* addr, const char* text, int length)
+{
+    int start = 0;
+    while (start < length){
+        int end = length - start > MAX_REPLY_DATAGRAM ? start + MAX_REPLY_DATAGRAM : length;
+        if (end < length){
+            int split = end;
+            while (split > start && text[split - 1] != '\n'){
+                split--;
+            }
+            // A single line longer than a datagram is cut where it has to be
+            end = split > start ? split : end;
+        }
+        sendto(socketDescriptor, text + start, end - start, 0, (const struct sockaddr*)addr, sizeof(*addr));
+        start = end;
+    }
+}
@@ -0,0 +1,68 @@
+// blockQueue.h
+// Module for a lock-free, single-producer broadcast queue of sample blocks.
+//
+// The producer (the sampling thread) publishes fixed-size blocks into a ring;
+// any number of consumers read them independently, each with its own cursor.
+// The producer never waits: when a consumer falls more than
+// BLOCK_QUEUE_CAPACITY blocks behind, its oldest blocks are overwritten and
+// the consumer skips ahead, seeing the loss as a jump in block sequence numbers.
+// Each slot is guarded by a seqlock-style version so readers never see a
+// half-written block. Publishing also bumps an eventfd that consumers can
+// poll() to wake as soon as a block is ready.
+
+#ifndef _BLOCK_QUEUE_H_
+#define _BLOCK_QUEUE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Samples per published block
+#define SAMPLE_BLOCK_SAMPLES 10
+// Blocks kept in the ring (a consumer may lag this many before losing data)
+#define BLOCK_QUEUE_CAPACITY 64
+
+typedef struct {
+    long long sequence;          // block number since start, from 0
+    long long firstSampleNumber; // index of samples[0] among all samples taken
+    long long newestSampleNs;    // acquisition time of the last sample (getTimeInNs clock)
+    int numDips;                 // dips detected within this block
+    double samples[SAMPLE_BLOCK_SAMPLES];
+} SampleBlock_t;
+
+typedef struct {
+    SampleBlock_t slots[BLOCK_QUEUE_CAPACITY];
+    atomic_llong versions[BLOCK_QUEUE_CAPACITY];
+    atomic_llong nextSequence;
+    int notifyFd;
+} BlockQueue_t;
+
+typedef enum {
+    BLOCK_QUEUE_OK,      // block copied out, cursor advanced
+    BLOCK_QUEUE_EMPTY,   // nothing new yet
+} BlockQueue_result_t;
+
+// Create/destroy the queue (and its eventfd).
+void BlockQueue_init(BlockQueue_t* queue);
+void BlockQueue_cleanup(BlockQueue_t* queue);
+
+// Producer only: publish `block`, assigning its sequence number. Never blocks.
+void BlockQueue_publish(BlockQueue_t* queue, const SampleBlock_t* block);
+
+// Sequence number the next published block will get (a new consumer's starting cursor).
+long long BlockQueue_nextSequence(BlockQueue_t* queue);
+
+// Consumer: copy the block at *cursor into `block` and advance the cursor.
+// If that block was already overwritten, the cursor first jumps to the oldest
+// block still held; compare block->sequence with the previous one to detect gaps.
+BlockQueue_result_t BlockQueue_read(BlockQueue_t* queue, long long* cursor, SampleBlock_t* block);
+
+// Copy a block field by field with relaxed atomics (see relaxedCopy.h); used
+// inside the seqlocks here and in sampleShm.c.
+void BlockQueue_copyBlockRelaxed(SampleBlock_t* to, const SampleBlock_t* from);
+
+// File descriptor that becomes readable when blocks are published; call
+// BlockQueue_clearNotify() after waking to reset it.
+int BlockQueue_notifyFd(BlockQueue_t* queue);
+void BlockQueue_clearNotify(BlockQueue_t* queue);
+
+#endif
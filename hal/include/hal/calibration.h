@@ -0,0 +1,93 @@
+// calibration.h
+// Module to convert raw 12-bit A2D counts to volts and to lux, one table
+// lookup per conversion.
+//
+// The light sensor is a photoresistor in a voltage divider, so lux is far from
+// linear in the count. A board's curve is loaded from a text file (see
+// Calibration_loadCurve) and precomputed into a CALIBRATION_TABLE_SIZE-entry
+// volts table and lux table, indexed by count. There are two table sets. A
+// rebuild fills the one not in use and then swaps it in with a single atomic
+// store, so readers never see a half-built table and never take a lock.
+// Before a rebuild reuses the retired set, it waits CALIBRATION_GRACE_MS after
+// the previous swap, and then until nobody holds that set. Single lookups
+// rely on the grace period alone. Code that keeps a table across several
+// lookups, such as a reply, takes it with Calibration_holdTable() and
+// releases it when done.
+//
+// LIGHT_SAMPLER_CALIBRATION names the board's curve file; without it the
+// default curve below is used. Other curves can only be loaded by name from
+// the LIGHT_SAMPLER_CALIBRATION_DIR directory (see the `calibrate` command).
+
+#ifndef _CALIBRATION_H_
+#define _CALIBRATION_H_
+
+#include <stdbool.h>
+
+#define CALIBRATION_TABLE_SIZE 4096     // one entry per 12-bit count
+#define CALIBRATION_MAX_POINTS 32
+#define CALIBRATION_MAX_LUX 100000.0
+#define CALIBRATION_GRACE_MS 100
+#define CALIBRATION_SOURCE_LEN 128
+#define CALIBRATION_FILE_ENV "LIGHT_SAMPLER_CALIBRATION"
+#define CALIBRATION_DIR_ENV "LIGHT_SAMPLER_CALIBRATION_DIR"
+
+// Photoresistor R = ohmsAt10Lux * (lux / 10)^-gamma, in series with fixedOhms
+// across supplyVolts; the A2D reads the junction against refVolts full scale.
+// With two or more measured points, lux is instead interpolated between them
+// (linearly in log lux) and held at the end values beyond them.
+typedef struct {
+    double refVolts;            // A2D full-scale voltage
+    double supplyVolts;         // voltage across the divider
+    double fixedOhms;
+    double ohmsAt10Lux;
+    double gamma;
+    bool photoresistorOnTop;    // between the supply and the A2D pin (more light, more volts)
+    int numPoints;              // measured (count, lux) pairs, in increasing count order
+    int pointCounts[CALIBRATION_MAX_POINTS];
+    double pointLux[CALIBRATION_MAX_POINTS];
+    char source[CALIBRATION_SOURCE_LEN];    // file it came from, or "default"
+} Calibration_curve_t;
+
+typedef struct {
+    double volts[CALIBRATION_TABLE_SIZE];   // count / 4095 * refVolts, exactly
+    float lux[CALIBRATION_TABLE_SIZE];
+    Calibration_curve_t curve;
+    double countsPerVolt;       // to find the count nearest a voltage
+    long long generation;       // 1 for the table built at init, +1 per rebuild
+    long long buildNs;          // time taken to fill the table
+} Calibration_table_t;
+
+// Build the table from LIGHT_SAMPLER_CALIBRATION, or the default curve if it is
+// unset. A file that cannot be used is reported and the default curve used instead.
+void Calibration_init(void);
+void Calibration_cleanup(void);
+
+// A 1.8V A2D reading a GL5528-style photoresistor (10k at 10 lux, gamma 0.7)
+// on top of a 10k resistor, across 1.8V.
+void Calibration_defaultCurve(Calibration_curve_t* curve);
+
+// Read a curve file: "key value" lines for ref_volts, supply_volts,
+// fixed_ohms, ohms_at_10_lux, gamma and "photoresistor top|bottom"; measured
+// points as "point COUNT LUX" lines; '#' starts a comment. Keys not given
+// keep their default values. Returns false with a reason in `error` if the
+// file cannot be read or is inconsistent.
+bool Calibration_loadCurve(const char* path, Calibration_curve_t* curve, char* error, int errorLen);
+
+// Rebuild the table set from `curve` and swap it in. Rebuilds are serialized.
+void Calibration_apply(const Calibration_curve_t* curve);
+
+// The table in use, for a single lookup or field read (see above).
+const Calibration_table_t* Calibration_getTable(void);
+// The table in use, kept from being rebuilt until Calibration_releaseTable().
+// Never call Calibration_apply() while holding one: the rebuild may wait on it.
+const Calibration_table_t* Calibration_holdTable(void);
+void Calibration_releaseTable(const Calibration_table_t* table);
+
+// One lookup each; counts outside 0..4095 are clamped.
+double Calibration_countToVolts(int count);
+double Calibration_countToLux(int count);
+// Lux at a voltage from the sample pipeline (possibly filtered, so between
+// counts): the count nearest `volts`, looked up in `table`.
+double Calibration_voltsToLux(const Calibration_table_t* table, double volts);
+
+#endif
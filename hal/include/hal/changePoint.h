@@ -0,0 +1,107 @@
+// changePoint.h
+// Module for incremental change-point detection on the light level: steps and
+// slow fades that the dip threshold (see dipDetector.h) is not meant to catch.
+//
+// Samples are averaged over CHANGE_POINT_BLOCK_SAMPLES (10ms at 1kHz) to damp
+// sensor noise, and each block mean feeds two independent detectors:
+//   CUSUM        -- two-sided cumulative sum of the deviation from a reference
+//                   level, the mean of the first CHANGE_POINT_WARMUP_BLOCKS
+//                   blocks after the last reset. Deviations smaller than
+//                   `cusumSlack` do not accumulate.
+//   Page-Hinkley -- cumulative deviation from the running mean since the last
+//                   reset, compared with its own extreme so far. It adapts as
+//                   the level wanders, so it favours sharper changes.
+// A detector raises an event once its statistic passes its threshold, and
+// then resets and learns the new level. The onset is estimated as the block
+// where the statistic last started to grow. So the event also gives the time
+// taken to detect the change. Work is O(1) per sample and memory is constant.
+// The caller owns the ChangePoint_t and is responsible for any locking.
+
+#ifndef _CHANGE_POINT_H_
+#define _CHANGE_POINT_H_
+
+#include <stdbool.h>
+
+#define CHANGE_POINT_BLOCK_SAMPLES 10
+#define CHANGE_POINT_WARMUP_BLOCKS 20
+#define CHANGE_POINT_MAX_EVENTS 32
+
+typedef enum {
+    CHANGE_POINT_CUSUM,
+    CHANGE_POINT_PAGE_HINKLEY,
+    CHANGE_POINT_NUM_METHODS,
+} ChangePoint_method_t;
+
+typedef struct {
+    double cusumSlack;          // V; deviation per block ignored by CUSUM
+    double cusumThreshold;      // V x blocks; CUSUM alarm level
+    double pageHinkleyDelta;    // V; deviation per block ignored by Page-Hinkley
+    double pageHinkleyLambda;   // V x blocks; Page-Hinkley alarm level
+} ChangePoint_config_t;
+
+typedef struct {
+    long long id;                   // event number since start, from 0
+    ChangePoint_method_t method;
+    int direction;                  // +1 the level rose, -1 it fell
+    long long onsetSampleNumber;    // first sample of the block where the change began
+    long long onsetTimeMs;
+    long long detectedSampleNumber; // sample that completed the alarming block
+    long long detectedTimeMs;
+    long long detectedNs;           // its acquisition time (getTimeInNs clock)
+    double levelBefore;             // reference level the change departed from
+    double levelAfter;              // mean level from the onset to detection
+} ChangePoint_event_t;
+
+// One direction of one detector
+typedef struct {
+    double statistic;
+    double extreme;                 // Page-Hinkley: the minimum of `statistic` so far
+    long long onsetSampleNumber;
+    long long onsetTimeMs;
+    double levelAtOnset;            // reference level when the change began
+    double sumSinceOnset;           // block means from the onset on
+    int blocksSinceOnset;
+} ChangePoint_side_t;
+
+typedef struct {
+    ChangePoint_method_t method;
+    double referenceSum;            // block means since the last reset
+    long long referenceBlocks;
+    ChangePoint_side_t rise;
+    ChangePoint_side_t fall;
+} ChangePoint_detector_t;
+
+typedef struct {
+    ChangePoint_config_t config;
+    // Block being accumulated
+    double blockSum;
+    int blockCount;
+    long long blockFirstSample;
+    long long blockFirstTimeMs;
+    ChangePoint_detector_t detectors[CHANGE_POINT_NUM_METHODS];
+    // Most recent events, a ring indexed by id
+    ChangePoint_event_t events[CHANGE_POINT_MAX_EVENTS];
+    long long nextId;
+} ChangePoint_t;
+
+// Thresholds tuned for the light sensor: a 0.1V step is found by CUSUM in
+// about 0.3s, a 0.1V fade over 10s in a few seconds, and ordinary dips
+// (tens of ms) are ignored.
+ChangePoint_config_t ChangePoint_defaultConfig(void);
+
+// Start with no reference level and no events.
+void ChangePoint_init(ChangePoint_t* changePoint, const ChangePoint_config_t* config);
+
+// Feed one sample. Returns the number of events it raised (0 except on the
+// last sample of a block); they are the newest in the event list.
+int ChangePoint_addSample(ChangePoint_t* changePoint, double volts, long long sampleNumber,
+        long long sampleTimeMs, long long acquiredNs);
+
+// Copy the held events, newest first, into `events`. Returns the number
+// copied (at most `maxEvents`).
+int ChangePoint_list(const ChangePoint_t* changePoint, ChangePoint_event_t* events, int maxEvents);
+
+// "cusum" or "page-hinkley".
+const char* ChangePoint_methodName(ChangePoint_method_t method);
+
+#endif
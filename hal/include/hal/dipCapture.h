@@ -0,0 +1,66 @@
+// dipCapture.h
+// Module for oscilloscope-style captures of the light level around each dip.
+//
+// Every sample goes into a pre-trigger ring of DIP_CAPTURE_PRE_SAMPLES. When
+// a sample triggers (a dip starts), the ring is copied into a capture slot,
+// followed by that sample and the next DIP_CAPTURE_POST_SAMPLES - 1 samples.
+// Slots come from a fixed pool, reused oldest first, so capturing never
+// allocates. Captures may overlap: a dip during another capture's
+// post-trigger samples opens a slot of its own.
+// The caller owns the pool and is responsible for any locking.
+
+#ifndef _DIP_CAPTURE_H_
+#define _DIP_CAPTURE_H_
+
+#include <stdbool.h>
+
+#define DIP_CAPTURE_PRE_SAMPLES 200
+#define DIP_CAPTURE_POST_SAMPLES 300
+#define DIP_CAPTURE_SAMPLES (DIP_CAPTURE_PRE_SAMPLES + DIP_CAPTURE_POST_SAMPLES)
+#define DIP_CAPTURE_SLOTS 16
+
+typedef struct {
+    long long id;                   // capture number since start, from 0
+    long long triggerSampleNumber;  // index of the trigger sample among all samples taken
+    long long triggerTimeMs;
+    long long triggerNs;            // acquisition time of the trigger sample (getTimeInNs clock)
+    double triggerVolts;
+    double thresholdVolts;          // level the trigger sample fell below
+    int numPre;                     // samples before the trigger (fewer just after start)
+    int numPost;                    // samples from the trigger on, so far
+    bool complete;                  // all DIP_CAPTURE_POST_SAMPLES taken
+} DipCapture_info_t;
+
+typedef struct {
+    DipCapture_info_t info;
+    // numPre pre-trigger samples, then numPost from the trigger on; the
+    // trigger sample is samples[numPre]
+    double samples[DIP_CAPTURE_SAMPLES];
+} DipCapture_t;
+
+typedef struct {
+    double preRing[DIP_CAPTURE_PRE_SAMPLES];
+    int preNext;
+    int preCount;
+    DipCapture_t slots[DIP_CAPTURE_SLOTS];
+    int numOpen;                    // slots still taking post-trigger samples
+    long long nextId;
+    long long overwrittenOpen;      // captures reused before they completed
+} DipCapture_pool_t;
+
+// Empty the pool and the pre-trigger ring.
+void DipCapture_init(DipCapture_pool_t* pool);
+
+// Feed one sample. If `isTrigger`, a capture opens around it, recording the
+// given sample number, times and threshold.
+void DipCapture_addSample(DipCapture_pool_t* pool, double volts, bool isTrigger, long long sampleNumber,
+        long long sampleTimeMs, long long acquiredNs, double thresholdVolts);
+
+// Copy the headers of the held captures, newest first, into `infos`.
+// Returns the number copied (at most `maxInfos`).
+int DipCapture_list(const DipCapture_pool_t* pool, DipCapture_info_t* infos, int maxInfos);
+
+// Copy capture `id` (id -1 for the newest). Returns false if it is no longer held.
+bool DipCapture_get(const DipCapture_pool_t* pool, long long id, DipCapture_t* capture);
+
+#endif
@@ -0,0 +1,50 @@
+// dipDetector.h
+// Module for the light-dip detector: an exponentially smoothed light level and
+// a hysteresis test against it, one sample at a time.
+//
+// A dip starts on a sample at or below (average - thresholdVolts) and ends once
+// a sample is back at or above (average - hysteresisVolts); only the start is
+// reported, so a dip is counted once however long it lasts. Each sample is
+// tested against the average of the samples before it, then folded into it.
+// The sampler and the offline analyzer share this code, so recorded data gives
+// the same dips in both. The caller owns the DipDetector_t and any locking.
+
+#ifndef _DIP_DETECTOR_H_
+#define _DIP_DETECTOR_H_
+
+#include <stdbool.h>
+
+#define DIP_DETECTOR_DEFAULT_THRESHOLD 0.1
+#define DIP_DETECTOR_DEFAULT_HYSTERESIS 0.07
+#define DIP_DETECTOR_DEFAULT_SMOOTHING 0.999
+
+typedef struct {
+    double thresholdVolts;      // a dip starts this far below the average
+    double hysteresisVolts;     // and ends once back within this of it
+    double smoothingWeight;     // weight of the previous average in each update
+} DipDetector_config_t;
+
+typedef struct {
+    DipDetector_config_t config;
+    double average;
+    bool dipAllowed;            // false while inside a dip
+} DipDetector_t;
+
+// The sampler's settings.
+DipDetector_config_t DipDetector_defaultConfig(void);
+
+// Start with the average at `initialAverage`, outside any dip.
+void DipDetector_init(DipDetector_t* detector, const DipDetector_config_t* config, double initialAverage);
+
+// Test one sample, then fold it into the average. Returns true if a dip starts on it.
+bool DipDetector_update(DipDetector_t* detector, double volts);
+
+// Level at or below which the next sample starts a dip.
+double DipDetector_getTriggerVolts(const DipDetector_t* detector);
+
+// Fold `numSamples` samples into `average` without testing for dips and return
+// the result. Bit-identical to the averages DipDetector_update() reaches, so a
+// batch can find the exact average at any point and start a detector there.
+double DipDetector_advanceAverage(const DipDetector_config_t* config, double average, const double* volts, int numSamples);
+
+#endif
@@ -0,0 +1,90 @@
+// filterChain.h
+// Module for a chain of block-based digital filters applied to light samples
+//
+// Stages run one after another over a block of samples:
+//   ma:N          moving average over N samples
+//   median:N      running median over N samples (N odd, <= FILTER_MAX_WINDOW)
+//   lowpass:HZ    2nd-order Butterworth low-pass biquad (transposed direct form II)
+//   fir:T:D[:HZ]  T-tap windowed-sinc low-pass FIR (Hamming), keeping every Dth
+//                 output; cutoff defaults to 80% of the output Nyquist rate
+// All coefficients are computed when the stage is added. FIR taps are kept
+// reversed in a doubled delay line so each output is one contiguous dot
+// product, split over independent accumulators so it vectorizes/pipelines.
+//
+// Decimating stages emit one sample per D inputs; feed the chain blocks
+// whose length is a multiple of FilterChain_getDecimation() so output k of a
+// block always corresponds to input ((k+1) * decimation - 1).
+//
+// Each stage counts its input/output samples and the time it spends in
+// metrics counters, so per-stage cost can be read (or registered with
+// hal/metrics.h) while the chain runs on another thread.
+
+#ifndef _FILTER_CHAIN_H_
+#define _FILTER_CHAIN_H_
+
+#include "hal/metrics.h"
+#include <stdbool.h>
+
+#define FILTER_MAX_STAGES 4
+#define FILTER_MAX_TAPS 64
+#define FILTER_MAX_WINDOW 31
+#define FILTER_MAX_DECIMATION 16
+#define FILTER_MAX_BLOCK 256
+#define FILTER_MAX_DESCRIPTION_LEN 48
+
+typedef enum {
+    FILTER_MOVING_AVERAGE,
+    FILTER_MEDIAN,
+    FILTER_BIQUAD,
+    FILTER_FIR,
+} FilterStage_type_t;
+
+typedef struct {
+    FilterStage_type_t type;
+    char description[FILTER_MAX_DESCRIPTION_LEN];
+    int length;         // window length or (padded) tap count
+    int decimation;     // 1 except for FIR
+    int phase;          // inputs since the last decimated output
+    int position;       // next write index into the delay line
+    int filled;         // samples seen, until the window is full
+    double sum;         // moving average running sum
+    double coefficients[FILTER_MAX_TAPS];   // FIR taps (reversed) or b0 b1 b2 a1 a2
+    double delay[2 * FILTER_MAX_TAPS];      // FIR delay line, written twice
+    double window[FILTER_MAX_WINDOW];       // MA/median ring of recent inputs
+    double sorted[FILTER_MAX_WINDOW];       // median window kept in order
+    double z1, z2;                          // biquad state
+    Metrics_counter_t samplesIn;
+    Metrics_counter_t samplesOut;
+    Metrics_counter_t costNs;
+} FilterStage_t;
+
+typedef struct {
+    int numStages;
+    int decimation;     // product of all stage decimations
+    FilterStage_t stages[FILTER_MAX_STAGES];
+} FilterChain_t;
+
+// Start an empty chain (passes samples through unchanged).
+void FilterChain_init(FilterChain_t* chain);
+
+// Append a stage; each returns false if the parameters or chain size are out of range.
+// `sampleRateHz` is the rate of the samples reaching that stage; a FIR `cutoffHz`
+// of 0 selects the default.
+bool FilterChain_addMovingAverage(FilterChain_t* chain, int length);
+bool FilterChain_addMedian(FilterChain_t* chain, int length);
+bool FilterChain_addLowPassBiquad(FilterChain_t* chain, double sampleRateHz, double cutoffHz);
+bool FilterChain_addFir(FilterChain_t* chain, int taps, int decimation, double sampleRateHz, double cutoffHz);
+
+// Build a chain from a comma-separated spec, e.g. "median:5,fir:32:10,lowpass:50".
+// `outputRateHz` is the rate leaving the chain; stage rates are derived from it.
+// Returns false (leaving an empty chain) if the spec is invalid.
+bool FilterChain_parse(FilterChain_t* chain, const char* spec, double outputRateHz);
+
+int FilterChain_getNumStages(FilterChain_t* chain);
+int FilterChain_getDecimation(FilterChain_t* chain);
+
+// Filter `numInputs` samples (<= FILTER_MAX_BLOCK) into `output`; returns the
+// number of outputs. `output` may be the same array as `input`.
+int FilterChain_process(FilterChain_t* chain, const double* input, int numInputs, double* output);
+
+#endif
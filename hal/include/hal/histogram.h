@@ -0,0 +1,37 @@
+// histogram.h
+// Module for lock-free, log2-bucketed histograms of non-negative values
+// (e.g. latencies in microseconds).
+//
+// Bucket 0 counts values <= 0; bucket b (b >= 1) counts values in [2^(b-1), 2^b - 1].
+// Recording is a handful of relaxed atomic adds, so any thread may record
+// while another reads; a reader may see a record counted in `count` but not
+// yet in its bucket, which only matters for exact accounting.
+
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stdatomic.h>
+
+#define HISTOGRAM_NUM_BUCKETS 40
+
+typedef struct {
+    atomic_llong buckets[HISTOGRAM_NUM_BUCKETS];
+    atomic_llong count;
+    atomic_llong sum;
+    atomic_llong max;
+} Histogram_t;
+
+// Zero all counters.
+void Histogram_init(Histogram_t* histogram);
+
+// Count one value.
+void Histogram_record(Histogram_t* histogram, long long value);
+
+// Largest value that falls into `bucket`.
+long long Histogram_bucketUpperBound(int bucket);
+
+// Upper bound of the bucket holding the given fraction (0..1) of the records,
+// or 0 if nothing has been recorded.
+long long Histogram_percentile(Histogram_t* histogram, double fraction);
+
+#endif
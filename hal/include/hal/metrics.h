@@ -0,0 +1,52 @@
+// metrics.h
+// Registry of lock-free counters, gauges and histograms shared by all modules
+//
+// Modules own their metric storage (usually a static) and register it by name
+// during init, unregistering during cleanup. Updates are single relaxed atomic
+// operations, so hot threads never take a lock and values never tear (also on
+// 32-bit ARM). Metrics_format() renders every registered metric in the
+// Prometheus text exposition format:
+//   # HELP <name> <help>
+//   # TYPE <name> counter|gauge|histogram
+//   <name> <value>
+// Histograms (see histogram.h) are rendered as cumulative `_bucket{le=...}`
+// series plus `_sum` and `_count`.
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include "hal/histogram.h"
+#include <stdatomic.h>
+
+#define METRICS_MAX_METRICS 64
+
+// Monotonically increasing count
+typedef struct {
+    atomic_llong value;
+} Metrics_counter_t;
+
+// Value that goes up and down; stored as the bit pattern of a double
+typedef struct {
+    atomic_ullong bits;
+} Metrics_gauge_t;
+
+// Register `metric` (zeroing it) under `name`. `name` and `help` must outlive
+// the registration (string literals). Exits if the registry is full.
+void Metrics_registerCounter(Metrics_counter_t* counter, const char* name, const char* help);
+void Metrics_registerGauge(Metrics_gauge_t* gauge, const char* name, const char* help);
+void Metrics_registerHistogram(Histogram_t* histogram, const char* name, const char* help);
+
+// Remove a registration; the storage may be reused once this returns.
+void Metrics_unregister(const void* metric);
+
+// Updates and reads; safe from any thread.
+void Metrics_counterAdd(Metrics_counter_t* counter, long long amount);
+long long Metrics_counterGet(Metrics_counter_t* counter);
+void Metrics_gaugeSet(Metrics_gauge_t* gauge, double value);
+double Metrics_gaugeGet(Metrics_gauge_t* gauge);
+
+// Render all registered metrics into `buffer`; returns the length written.
+// Output is cut at a line boundary if it does not fit.
+int Metrics_format(char* buffer, int bufferLen);
+
+#endif
@@ -0,0 +1,39 @@
+// pinConfig.h
+// Module to set header pin modes (what `config-pin p9_21 pwm` does) without
+// spawning a shell.
+//
+// A pin's mode is its pinmux helper's state attribute,
+// /sys/devices/platform/ocp/ocp:P9_21_pinmux/state. Requests are queued and
+// applied by a background thread, so pin setup overlaps the rest of init.
+// A pin already in the requested mode is only read, not written. Modules
+// queue their pins in their init, and call PinConfig_waitForPins() from
+// their own thread before they touch the hardware.
+// In a simulated tree (see sysfs.h) the state files are plain files. A
+// missing one counts as unconfigured and is created on the first write.
+
+#ifndef _PIN_CONFIG_H_
+#define _PIN_CONFIG_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define PIN_CONFIG_MAX_PINS 16
+#define PIN_CONFIG_MAX_NAME_LEN 16
+
+// Begin/end the background thread which applies pin requests.
+void PinConfig_init(void);
+void PinConfig_cleanup(void);
+
+// Queue `pin` (config-pin name, e.g. "p9_21") to be put in `mode` (e.g. "pwm", "i2c").
+void PinConfig_request(const char* pin, const char* mode);
+
+// Block until every pin queued so far is configured. Gives up, returning
+// false, once the caller's `isRunning` flag clears (its cleanup has begun) or
+// pin configuration stops, so a stalled pin can't hang shutdown.
+bool PinConfig_waitForPins(atomic_bool* isRunning);
+
+// Pins whose state was written / already in the requested mode.
+long long PinConfig_getNumWritten(void);
+long long PinConfig_getNumSkipped(void);
+
+#endif
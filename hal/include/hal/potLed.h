@@ -9,7 +9,7 @@
 #include <stdbool.h>
 
 // Begin/end the background thread which drives the LED with PWM
-// Also sets necessary config pins
+// Also requests the necessary pin modes (needs PinConfig_init() first)
 void PotLed_init(void);
 void PotLed_cleanup(void);
 
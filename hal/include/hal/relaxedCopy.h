@@ -0,0 +1,19 @@
+// relaxedCopy.h
+// Field-by-field copies for the data inside a seqlock (blockQueue.h, sampleShm.h)
+//
+// A seqlock reader may copy a slot while the writer rewrites it; the version
+// check then discards the copy. Under C11 the overlapping plain accesses are
+// still a data race, so both sides copy each field with relaxed atomic
+// loads and stores instead of a struct assignment or memcpy.
+
+#ifndef _RELAXED_COPY_H_
+#define _RELAXED_COPY_H_
+
+// Copy one field with relaxed atomic accesses (any size up to 8 bytes)
+#define COPY_RELAXED(to, from, field) do { \
+        __typeof__((to)->field) value; \
+        __atomic_load(&(from)->field, &value, __ATOMIC_RELAXED); \
+        __atomic_store(&(to)->field, &value, __ATOMIC_RELAXED); \
+    } while (0)
+
+#endif
@@ -0,0 +1,52 @@
+// sampleArchive.h
+// Module to keep the last SAMPLE_ARCHIVE_CAPACITY samples (about 8.7 minutes
+// at 1kHz) in a compact form for bulk export.
+//
+// Each sample is stored as a float32, in host byte order (little-endian on
+// the board), at index sampleNumber % SAMPLE_ARCHIVE_CAPACITY. Sample numbers
+// are the same ones that captures and change points use. A contiguous run of
+// samples is at most two spans of the ring, so an exporter can hand the spans
+// straight to writev(). The writer stores the sample before it publishes the
+// count. Readers take no locks. After copying a range out, a reader calls
+// SampleArchive_isIntact() to check that the writer did not wrap over the
+// range while it was being copied.
+// Single producer (the sampler); any number of readers.
+
+#ifndef _SAMPLE_ARCHIVE_H_
+#define _SAMPLE_ARCHIVE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+// A power of two, so the index is a mask
+#define SAMPLE_ARCHIVE_CAPACITY (1 << 19)
+// The oldest samples are about to be overwritten, so they are not offered to
+// readers (about 4s of slack for a slow transfer)
+#define SAMPLE_ARCHIVE_GUARD_SAMPLES 4096
+
+typedef struct {
+    atomic_llong written;   // samples appended since start
+    float samples[SAMPLE_ARCHIVE_CAPACITY];
+} SampleArchive_t;
+
+void SampleArchive_init(SampleArchive_t* archive);
+
+// Producer only: store the next sample. Never blocks.
+void SampleArchive_append(SampleArchive_t* archive, double volts);
+
+// Number of the next sample to be appended (one past the newest held).
+long long SampleArchive_getWritten(const SampleArchive_t* archive);
+
+// Oldest sample number offered to readers.
+long long SampleArchive_getOldest(const SampleArchive_t* archive);
+
+// Point `spans` at samples first .. first + count - 1, which must be held.
+// Returns the number of spans used (1, or 2 when the range wraps).
+int SampleArchive_getSpans(const SampleArchive_t* archive, long long first, long long count, struct iovec spans[2]);
+
+// True if samples from `first` on are still held, so a copy that has just
+// finished read them intact.
+bool SampleArchive_isIntact(const SampleArchive_t* archive, long long first);
+
+#endif
@@ -0,0 +1,109 @@
+// sampleShm.h
+// Module to export the live sample blocks and summary stats through POSIX
+// shared memory, for other processes on the board.
+//
+// The sampler creates the segment (shm_open + mmap) and publishes into it
+// with the same protocol as blockQueue.h. There is a ring of SampleBlock_t,
+// and each slot carries a seqlock version. The summary has a seqlock of its
+// own. Readers map the segment read-only and poll it. They take no locks and
+// make no syscalls after opening, and the writer does no per-reader work.
+// A reader that falls more than SAMPLE_SHM_CAPACITY blocks behind skips
+// ahead, and sees the loss as a jump in block sequence numbers.
+//
+// The layout has fixed-size fields only. Readers check the magic, the version
+// and the segment size before use. The writer marks the segment closed when
+// it shuts down, and unlinks the name, so a reader that still has it mapped
+// can tell that no more blocks will arrive.
+
+#ifndef _SAMPLE_SHM_H_
+#define _SAMPLE_SHM_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "hal/blockQueue.h"
+#include "hal/sampleWindow.h"
+
+#define SAMPLE_SHM_MAGIC "LSSHM\0\0\0"
+#define SAMPLE_SHM_VERSION 2
+// Default segment name; the sampler uses LIGHT_SAMPLER_SHM if set ("off" disables export)
+#define SAMPLE_SHM_DEFAULT_NAME "/light_sampler"
+#define SAMPLE_SHM_NAME_ENV "LIGHT_SAMPLER_SHM"
+// Blocks kept in the ring: about 10s at 1kHz
+#define SAMPLE_SHM_CAPACITY 1024
+#define SAMPLE_SHM_MAX_WINDOWS 8
+
+// Summary stats, rewritten with every published block
+typedef struct {
+    long long updatedNs;        // getTimeInNs() clock of the last update
+    long long updatedWallNs;    // the same instant on the wall clock (Unix epoch ns)
+    long long samplesTaken;
+    long long dipsTotal;
+    double averageVolts;        // exponentially smoothed light level
+    int historySize;            // samples in the previous complete second
+    int historyDips;
+    long long historyNewestNs;  // acquisition of the history's last sample
+    int numWindows;
+    SampleWindow_stats_t windows[SAMPLE_SHM_MAX_WINDOWS];
+} SampleShm_summary_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t segmentSize;       // sizeof(SampleShm_segment_t) of the writer
+    uint32_t capacity;
+    uint32_t blockSamples;
+    atomic_int closed;          // set when the writer shuts down
+    int32_t writerPid;
+    atomic_llong summaryVersion;
+    SampleShm_summary_t summary;
+    atomic_llong nextSequence;
+    atomic_llong versions[SAMPLE_SHM_CAPACITY];
+    SampleBlock_t slots[SAMPLE_SHM_CAPACITY];
+} SampleShm_segment_t;
+
+typedef struct {
+    char name[64];
+    SampleShm_segment_t* segment;
+} SampleShm_writer_t;
+
+typedef struct {
+    const SampleShm_segment_t* segment;
+} SampleShm_reader_t;
+
+typedef enum {
+    SAMPLE_SHM_OK,      // block copied out, cursor advanced
+    SAMPLE_SHM_EMPTY,   // nothing new yet
+} SampleShm_result_t;
+
+// Writer: create the segment `name` (e.g. "/light_sampler"), replacing one
+// left by a writer that is no longer running. Returns false, with errno set,
+// if it cannot be created; errno is EEXIST if a running writer still owns it.
+bool SampleShm_create(SampleShm_writer_t* writer, const char* name);
+// Mark the segment closed, unmap it and unlink its name.
+void SampleShm_destroy(SampleShm_writer_t* writer);
+
+// Writer only: publish a block (its sequence number is assigned here) / the summary.
+void SampleShm_publishBlock(SampleShm_writer_t* writer, const SampleBlock_t* block);
+void SampleShm_publishSummary(SampleShm_writer_t* writer, const SampleShm_summary_t* summary);
+
+// Reader: map the segment `name` read-only. Returns false if it does not
+// exist or was written by an incompatible build.
+bool SampleShm_openReader(SampleShm_reader_t* reader, const char* name);
+void SampleShm_closeReader(SampleShm_reader_t* reader);
+
+// Sequence number the next published block will get (a new reader's starting cursor).
+long long SampleShm_nextSequence(const SampleShm_reader_t* reader);
+
+// Copy the block at *cursor and advance the cursor, skipping ahead to the
+// oldest block still held if it was already overwritten.
+SampleShm_result_t SampleShm_read(const SampleShm_reader_t* reader, long long* cursor, SampleBlock_t* block);
+
+// Copy a consistent summary. Returns false if the writer kept changing it
+// (retried a bounded number of times).
+bool SampleShm_readSummary(const SampleShm_reader_t* reader, SampleShm_summary_t* summary);
+
+// True once the writer has shut down (no more blocks will be published).
+bool SampleShm_isClosed(const SampleShm_reader_t* reader);
+
+#endif
@@ -0,0 +1,77 @@
+// sampleTrace.h
+// Module to record raw A2D light readings to a binary trace file and read them back
+//
+// File layout (little-endian):
+//   header: "LSTRACE1" | u32 version | u32 a2dMaxReading | i64 startNs
+//   record: varint deltaUs (since the previous record) | u16 a2d count
+// A 1ms sample period costs 4 bytes per sample. Reader times are relative
+// to the first record, so a trace replays the same wherever it is played.
+//
+// The sampler selects a trace mode from the environment:
+//   LIGHT_SAMPLER_TRACE_RECORD=<file>  sample the device and record every reading
+//   LIGHT_SAMPLER_TRACE_REPLAY=<file>  feed readings from the trace instead of the device
+//   LIGHT_SAMPLER_TRACE_SPEED=<x>|max  replay pacing (default 1 = real time)
+
+#ifndef _SAMPLE_TRACE_H_
+#define _SAMPLE_TRACE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define SAMPLE_TRACE_BUFFER_LEN 65536
+#define SAMPLE_TRACE_MAX_PATH_LEN 256
+
+typedef enum {
+    SAMPLE_TRACE_OFF,
+    SAMPLE_TRACE_RECORD,
+    SAMPLE_TRACE_REPLAY,
+} SampleTrace_mode_t;
+
+typedef struct {
+    SampleTrace_mode_t mode;
+    char path[SAMPLE_TRACE_MAX_PATH_LEN];
+    double speed;   // replay speed-up; 0 = as fast as possible
+} SampleTrace_config_t;
+
+typedef struct {
+    FILE* file;
+    long long lastNs;
+    long long numRecords;
+    atomic_llong flushedBytes;  // bytes of the file written out, header included
+    int used;
+    unsigned char buffer[SAMPLE_TRACE_BUFFER_LEN];
+} SampleTrace_writer_t;
+
+typedef struct {
+    FILE* file;
+    long long timeUs;
+    long long numRecords;
+    bool isMalformed;   // a record could not be decoded; reading stopped there
+    int used;
+    int length;
+    unsigned char buffer[SAMPLE_TRACE_BUFFER_LEN];
+} SampleTrace_reader_t;
+
+// Read the trace mode from the environment (SAMPLE_TRACE_OFF if unset).
+void SampleTrace_configFromEnvironment(SampleTrace_config_t* config);
+
+// Create `path` and write the header; returns false if it cannot be created.
+bool SampleTrace_openWriter(SampleTrace_writer_t* writer, const char* path, long long startNs);
+// Append one reading taken at `timeNs` (getTimeInNs() clock). Buffered; writes
+// to the file only when the buffer fills.
+void SampleTrace_write(SampleTrace_writer_t* writer, long long timeNs, int a2dReading);
+// Bytes of the trace already in the file (a whole number of records), safe
+// for other threads to read from it while recording goes on.
+long long SampleTrace_getFlushedBytes(SampleTrace_writer_t* writer);
+// Flush and close.
+void SampleTrace_closeWriter(SampleTrace_writer_t* writer);
+
+// Open a trace and check its header; returns false if it is missing or invalid.
+bool SampleTrace_openReader(SampleTrace_reader_t* reader, const char* path);
+// Next reading and its time in us since the first record; false at end of trace,
+// or at a record that cannot be decoded (then isMalformed is set).
+bool SampleTrace_read(SampleTrace_reader_t* reader, long long* timeUs, int* a2dReading);
+void SampleTrace_closeReader(SampleTrace_reader_t* reader);
+
+#endif
@@ -0,0 +1,66 @@
+// sampleWindow.h
+// Module to keep summary statistics (count, sum, min, max, dips) over a
+// tumbling or sliding window of light samples.
+//
+// A window spans `lengthMs` and advances every `hopMs`; use hopMs == lengthMs
+// for a tumbling window. Internally the window is a ring of hop-sized panes:
+// each sample only updates the open pane (O(1)), and the window summary is
+// rebuilt from the panes once per hop when the open pane closes.
+// The caller owns the SampleWindow_t and is responsible for any locking.
+
+#ifndef _SAMPLE_WINDOW_H_
+#define _SAMPLE_WINDOW_H_
+
+#include <stdbool.h>
+
+// Maximum number of hops that fit in one window (lengthMs / hopMs).
+#define SAMPLE_WINDOW_MAX_PANES 100
+
+typedef struct {
+    int count;
+    double sum;
+    double min;
+    double max;
+    int dips;
+} SampleWindow_pane_t;
+
+// Summary of the most recently completed window.
+typedef struct {
+    int lengthMs;
+    int hopMs;
+    long long startTimeMs;
+    long long endTimeMs;
+    long long windowNumber;
+    int count;
+    double sum;
+    double min;
+    double max;
+    int dips;
+} SampleWindow_stats_t;
+
+typedef struct {
+    int lengthMs;
+    int hopMs;
+    int numPanes;
+    long long openPaneStartMs;
+    SampleWindow_pane_t openPane;
+    SampleWindow_pane_t panes[SAMPLE_WINDOW_MAX_PANES];
+    int nextPane;
+    int panesFilled;
+    SampleWindow_stats_t latest;
+} SampleWindow_t;
+
+// Set up a window starting at `startTimeMs`.
+// Returns false if the length/hop combination is not supported
+// (hop must be positive, divide the length, and give at most SAMPLE_WINDOW_MAX_PANES panes).
+bool SampleWindow_init(SampleWindow_t* window, int lengthMs, int hopMs, long long startTimeMs);
+
+// Add one sample taken at `timeMs`; `isDip` marks the sample on which a dip was detected.
+// Closes any panes whose hop has elapsed before accounting for the sample.
+// Returns true if at least one window completed (i.e. `latest` was updated).
+bool SampleWindow_addSample(SampleWindow_t* window, double value, bool isDip, long long timeMs);
+
+// Copy out the summary of the most recently completed window.
+void SampleWindow_getStats(const SampleWindow_t* window, SampleWindow_stats_t* stats);
+
+#endif
@@ -7,25 +7,77 @@
 //
 // The application will do a number of actions each second which must
 // be synchronized (such as computing dips and printing to the screen).
-// To make easy to work with the data, the app must call
-// Sampler_moveCurrentDataToHistory() each second to trigger this
-// module to move the current samples into the history.
+// The sampling thread rolls the current samples into the history as soon
+// as a sample lands past the 1s boundary; Sampler_moveCurrentDataToHistory()
+// can still be called to force an early rollover.
+//
+// Alongside the history it maintains a set of tumbling/sliding analysis
+// windows (see sampleWindow.h), updated incrementally on every sample.
+// By default: 100ms tumbling, 1s tumbling, and 10s sliding by 1s.
 
 #ifndef _SAMPLER_H_
 #define _SAMPLER_H_
 
 #include <stdbool.h>
 #include <pthread.h>
+#include "hal/sampleWindow.h"
+#include "hal/blockQueue.h"
+#include "hal/filterChain.h"
+#include "hal/spectrum.h"
+#include "hal/dipCapture.h"
+#include "hal/changePoint.h"
+#include "hal/sampleArchive.h"
+
+// Maximum number of samples kept for one second of history
+#define SAMPLER_HISTORY_CAPACITY 1000
+
+// FFT length used for the spectrum of each second (the ~1000 samples are
+// windowed over the whole second, then zero-padded)
+#define SAMPLER_SPECTRUM_SIZE 1024
+
+// Maximum number of window definitions maintained at once
+#define SAMPLER_MAX_WINDOWS 8
+
+// Timestamps (getTimeInNs() clock) attached to published data, used to
+// measure how stale the data is by the time it reaches a client.
+typedef struct {
+    long long oldestSampleNs;   // acquisition of the first sample (history only; 0 for windows)
+    long long newestSampleNs;   // acquisition of the last sample
+    long long publishedNs;      // when the data became readable
+} Sampler_stamp_t;
 
 // Begin/end the background thread which samples light levels.
+// Readings are converted with the calibration table, so Calibration_init() comes first.
 void Sampler_init(void);
 void Sampler_cleanup(void);
 
-// Must be called once every 1s.
+// Initialize without starting any threads (for benchmarks and tools).
+// The caller drives the module by feeding readings to Sampler_recordSample();
+// the running average starts at `initialAverage`. Pair with Sampler_cleanup().
+void Sampler_initManual(double initialAverage);
+
+// Apply the per-sample update (history rollover, dip detection, windows,
+// running average) to one voltage reading taken at `sampleTimeMs`.
+// Used by the sampling thread for every A2D reading.
+void Sampler_recordSample(double voltageReading, long long sampleTimeMs);
+
 // Moves the samples that it has been collecting this second into
 // the history, which makes the samples available for reads (below).
+// Called automatically by the sampling thread at every 1s boundary.
 void Sampler_moveCurrentDataToHistory(void);
 
+// Add another window definition (hopMs == lengthMs for tumbling).
+// Returns the new window's id, or -1 if the definition is unsupported
+// or SAMPLER_MAX_WINDOWS are already in use.
+int Sampler_addWindow(int lengthMs, int hopMs);
+
+// Get the number of window definitions currently maintained (ids are 0..n-1).
+int Sampler_getNumWindows(void);
+
+// Fill `stats` with the most recently completed instance of window `id`.
+// Returns false if no such window exists.
+bool Sampler_getWindowStats(int id, SampleWindow_stats_t* stats);
+
 // Get the number of samples collected during the previous complete second.
 int Sampler_getHistorySize(void);
 
@@ -36,6 +88,68 @@ int Sampler_getHistorySize(void);
 // Note: It provides both data and size to ensure consistency.
 double* Sampler_getHistory(int* size);
 
+// Copy the sample history into caller-provided storage without allocating.
+// Copies at most `maxSize` samples and returns the number copied.
+// Takes the history mutex itself, so the copy is always a consistent second.
+int Sampler_copyHistory(double* dest, int maxSize);
+
+// Get the history epoch: the number of seconds rolled into the history so far.
+// Anything derived from the history stays valid while the epoch is unchanged;
+// it is bumped under the history mutex, so read it before copying the history.
+long long Sampler_getHistoryEpoch(void);
+
+// Get the stamp of the current history / of the latest instance of window `id`.
+// Sampler_getWindowStamp returns false if no such window exists.
+void Sampler_getHistoryStamp(Sampler_stamp_t* stamp);
+bool Sampler_getWindowStamp(int id, Sampler_stamp_t* stamp);
+
+// Get the acquisition time (getTimeInNs() clock) of the most recent sample.
+long long Sampler_getLastSampleNs(void);
+
+// Get the queue into which every SAMPLE_BLOCK_SAMPLES consecutive samples are
+// published as soon as they are taken (for low-latency streaming consumers).
+// Consumers read it lock-free; a slow consumer never delays sampling.
+BlockQueue_t* Sampler_getBlockQueue(void);
+
+// Get the archive holding the last SAMPLE_ARCHIVE_CAPACITY samples (see
+// sampleArchive.h), indexed by sample number. Readers need no lock.
+SampleArchive_t* Sampler_getArchive(void);
+
+// Get the path of the trace being recorded or replayed (see sampleTrace.h),
+// or NULL if there is none. `availableBytes` is how much of a recording is in
+// the file so far, or -1 for a replayed trace, which is complete.
+const char* Sampler_getTracePath(long long* availableBytes);
+
+// Get the spectrum (see spectrum.h) of the previous complete second, computed
+// by the background thread after each rollover. The band energy is measured
+// within 2Hz of the LED frequency set at that time, so a band holding most of
+// the energy confirms the LED flicker shows up in the light signal.
+// `secondNumber` counts analysed seconds. Returns false until one is ready.
+bool Sampler_getSpectrum(Spectrum_result_t* result, long long* secondNumber);
+
+// Get the headers of the dip captures still held (see dipCapture.h), newest
+// first; a capture is held until DIP_CAPTURE_SLOTS newer dips have replaced it.
+// Returns the number copied (at most `maxInfos`).
+int Sampler_listCaptures(DipCapture_info_t* infos, int maxInfos);
+
+// Get the level changes still held (see changePoint.h), newest first; each
+// gives its estimated onset and when it was detected. Returns the number
+// copied (at most `maxEvents`).
+int Sampler_listChangePoints(ChangePoint_event_t* events, int maxEvents);
+
+// Copy the samples around dip capture `id` (-1 for the newest). A capture that
+// is still taking post-trigger samples is copied as far as it has got.
+// Returns false if it is no longer held.
+bool Sampler_getCapture(long long id, DipCapture_t* capture);
+
+// Get the filter chain run between acquisition and dip detection. It is built
+// by Sampler_init() from LIGHT_SAMPLER_FILTER (see filterChain.h for the stage
+// syntax, e.g. "median:5,fir:32:10") and is empty when the variable is unset.
+// With a decimating chain the device is sampled `decimation` times per ms and
+// everything downstream (history, dips, windows, blocks) sees the 1kHz output.
+// Read-only for callers; stage counters may be read at any time.
+FilterChain_t* Sampler_getFilterChain(void);
+
 // Get the average light level (not tied to the history).
 double Sampler_getAverageReading(void);
 
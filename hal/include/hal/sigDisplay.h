@@ -9,11 +9,15 @@
 #include <stdbool.h>
 
 // Begin/end the background thread which drives the 14-sig display
-// Also sets necessary config pins
+// Also requests the necessary pin modes (needs PinConfig_init() first)
 void SigDisplay_init(void);
 void SigDisplay_cleanup(void);
 
 // Setter function for the number displayed by the 14-sig display
 void SigDisplay_setNumber(int newValue);
 
+// Draw one frame of both digits immediately (the display thread does this
+// continuously; exposed for benchmarking the refresh cost)
+void SigDisplay_refresh(void);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,66 @@
+// spectrum.h
+// Module for a fixed-size real FFT of a window of light samples
+//
+// An N-point real FFT is computed as an N/2-point complex radix-2 FFT plus a
+// split step. Twiddles, the bit-reversal permutation and the Hann window are
+// computed once by Spectrum_init(); Spectrum_analyze() only works inside the
+// Spectrum_t, so a window costs no allocation and no trig calls.
+//
+// The mean is removed before windowing, so the DC level never counts as a
+// peak. Magnitudes are single-sided amplitudes in volts (a sine of amplitude
+// A reads as about A); energies are sums of squared magnitudes.
+// The caller owns the Spectrum_t and is responsible for any locking.
+
+#ifndef _SPECTRUM_H_
+#define _SPECTRUM_H_
+
+#include <stdbool.h>
+
+#define SPECTRUM_MIN_SIZE 8
+#define SPECTRUM_MAX_SIZE 4096
+#define SPECTRUM_MAX_PEAKS 5
+
+typedef struct {
+    double frequencyHz;
+    double magnitude;
+} Spectrum_peak_t;
+
+typedef struct {
+    int size;               // FFT length
+    int numSamples;         // samples analysed (the newest `size` if more were given)
+    double sampleRateHz;
+    double resolutionHz;    // bin spacing
+    double dominantHz;      // strongest peak (interpolated between bins)
+    double dominantMagnitude;
+    double bandLowHz;
+    double bandHighHz;
+    double bandEnergy;      // energy of the bins inside [bandLowHz, bandHighHz]
+    double totalEnergy;     // energy of all bins above DC
+    int numPeaks;           // strongest local maxima, strongest first
+    Spectrum_peak_t peaks[SPECTRUM_MAX_PEAKS];
+} Spectrum_result_t;
+
+typedef struct {
+    int size;
+    int half;
+    double windowGain;
+    double twiddleRe[SPECTRUM_MAX_SIZE / 2];
+    double twiddleIm[SPECTRUM_MAX_SIZE / 2];
+    int bitReverse[SPECTRUM_MAX_SIZE / 2];
+    double window[SPECTRUM_MAX_SIZE];
+    double re[SPECTRUM_MAX_SIZE / 2 + 1];
+    double im[SPECTRUM_MAX_SIZE / 2 + 1];
+    double magnitude[SPECTRUM_MAX_SIZE / 2 + 1];
+} Spectrum_t;
+
+// Prepare tables for an FFT of `size` points (a power of two within
+// SPECTRUM_MIN_SIZE..SPECTRUM_MAX_SIZE). Returns false otherwise.
+bool Spectrum_init(Spectrum_t* spectrum, int size);
+
+// Analyse the newest `size` of `numSamples` samples taken at `sampleRateHz`;
+// fewer samples are zero-padded. Energy between bandLowHz and bandHighHz is
+// reported separately (pass 0, 0 to skip).
+void Spectrum_analyze(Spectrum_t* spectrum, const double* samples, int numSamples, double sampleRateHz,
+        double bandLowHz, double bandHighHz, Spectrum_result_t* result);
+
+#endif
@@ -0,0 +1,46 @@
+// statusLog.h
+// Module to print status output to the terminal without blocking time-critical threads
+//
+// Any thread posts compact binary records into a lock-free ring; a dedicated
+// low-priority writer thread formats them and writes them out in batches with
+// writev(). If the console falls behind and the ring is full, new records are
+// dropped (never waited on) and counted; the writer reports the count.
+
+#ifndef _STATUS_LOG_H_
+#define _STATUS_LOG_H_
+
+#include <stdbool.h>
+
+#define STATUS_LOG_PREVIEW_SAMPLES 10
+#define STATUS_LOG_TEXT_LEN 96
+
+// One second of sampler status (the two-line summary printed each second)
+typedef struct {
+    int historySize;
+    int potReading;
+    int frequency;
+    double avgVoltage;
+    int dips;
+    double minPeriodMs;
+    double maxPeriodMs;
+    double avgPeriodMs;
+    int numPeriodSamples;
+    int numPreview;
+    int previewIndex[STATUS_LOG_PREVIEW_SAMPLES];
+    double previewValue[STATUS_LOG_PREVIEW_SAMPLES];
+} StatusLog_second_t;
+
+// Begin/end the writer thread. Cleanup flushes whatever is queued.
+void StatusLog_init(void);
+void StatusLog_cleanup(void);
+
+// Queue a record; returns false (and counts a drop) if the ring is full
+// or the module is not running. Never blocks.
+bool StatusLog_postSecond(const StatusLog_second_t* second);
+bool StatusLog_postText(const char* text);
+
+// Records written / dropped since start.
+long long StatusLog_getWritten(void);
+long long StatusLog_getDropped(void);
+
+#endif
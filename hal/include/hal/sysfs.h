@@ -0,0 +1,45 @@
+// sysfs.h
+// Module for reading and writing the device files (sysfs, /dev) used by the HAL
+//
+// Every path is resolved against a root directory. The root is empty (the real
+// board) unless the LIGHT_SAMPLER_SYSFS_ROOT environment variable or
+// Sysfs_setRoot() points it at a simulated device tree. In a simulated tree,
+// missing files read as SYSFS_SIM_DEFAULT_READING and writes create the file
+// (and its parent directories), so a bare directory is a working device.
+
+#ifndef _SYSFS_H_
+#define _SYSFS_H_
+
+#include <stdbool.h>
+
+#define SYSFS_MAX_PATH_LEN 256
+#define SYSFS_SIM_DEFAULT_READING 2048
+
+// Use `root` as the simulated device tree (NULL or "" for the real device).
+// Must be called before any module opens a device file.
+void Sysfs_setRoot(const char* root);
+
+// True when running against a simulated device tree.
+bool Sysfs_isSimulated(void);
+
+// Resolve a device path against the root into `buffer`; returns `buffer`.
+const char* Sysfs_resolve(const char* path, char* buffer, int bufferLen);
+
+// Read a single integer (e.g. an A2D count). Exits on error, like the rest of the HAL.
+int Sysfs_readInt(const char* path);
+
+// Read the first line of a text attribute (e.g. a pin's mode), without the
+// newline, into `buffer`. In a simulated tree a missing file reads as ""
+// and returns false; on the board a missing file is an error (exits).
+bool Sysfs_readString(const char* path, char* buffer, int bufferLen);
+
+// open() a device node (e.g. an I2C bus). In a simulated tree the node is a
+// plain file that is created if needed and appended to on writes.
+// Returns the file descriptor, or -1 on error.
+int Sysfs_openDevice(const char* path, int flags);
+
+// Write a value to a device attribute. Exits on error.
+void Sysfs_writeInt(const char* path, int value);
+void Sysfs_writeString(const char* path, const char* value);
+
+#endif
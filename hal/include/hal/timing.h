@@ -1,13 +1,53 @@
 // timing.h
 //
 // Custom module for timing-related tasks
+//
+// Every thread takes its time from this module, on one monotonic clock
+// (CLOCK_MONOTONIC, read through the vDSO): an NTP step or a settimeofday()
+// does not move it, so periods and windows measured against it stay correct.
+// Wall-clock time is only for timestamps shown outside the process; convert
+// with monotonicToWallNs().
+//
+// Short intervals on hot paths can use the raw tick counter instead: the
+// CPU's invariant cycle counter where the kernel trusts it (x86-64 TSC when
+// it is the clocksource, the ARMv8 virtual counter), else CLOCK_MONOTONIC
+// itself. LIGHT_SAMPLER_CLOCK=monotonic forces the latter.
 
 #ifndef _TIMING_H_
 #define _TIMING_H_
 
 #include <time.h>
 
+#define TIMING_CLOCK_ENV "LIGHT_SAMPLER_CLOCK"
+
+typedef enum {
+    TIMING_TICKS_MONOTONIC,     // clock_gettime(CLOCK_MONOTONIC); a tick is 1ns
+    TIMING_TICKS_CYCLES,        // CPU cycle counter, calibrated lazily against CLOCK_MONOTONIC
+} Timing_tickSource_t;
+
+// Monotonic time in ms (same clock as getTimeInNs())
 long long getTimeInMs(void);
+// Monotonic time in ns (not affected by wall-clock changes); use for latency stamps
+long long getTimeInNs(void);
+// getTimeInNs() when the process started (recorded before main() runs)
+long long getProcessStartNs(void);
 void sleepForMs(long long delayInMs);
+// Sleep until getTimeInNs() reaches `timeNs` (returns at once if it has passed)
+void sleepUntilNs(long long timeNs);
+
+// Raw tick count; only differences are meaningful. Convert them with ticksToNs().
+long long readTicks(void);
+long long ticksToNs(long long ticks);
+Timing_tickSource_t getTickSource(void);
+// "monotonic" or "cycles"
+const char* getTickSourceName(void);
+// Ticks per us, calibrated on first use (1000 for the monotonic source)
+double getTicksPerUs(void);
+
+// Current CLOCK_REALTIME - CLOCK_MONOTONIC in ns. Read afresh on every call,
+// so it follows wall-clock steps.
+long long getWallClockOffsetNs(void);
+// Wall-clock (Unix epoch) ns of a getTimeInNs() stamp, by the current offset
+long long monotonicToWallNs(long long monotonicNs);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,72 @@
+// workPool.h
+// Module for a fixed pool of worker threads that share tasks by work stealing.
+//
+// Each worker owns a deque of tasks. Tasks submitted from outside the pool are
+// dealt round-robin onto the deques. A worker takes the newest task from its
+// own deque and, once that is empty, steals the oldest task from another
+// worker's deque. Uneven tasks therefore spread out without a central queue.
+// A pool-wide count of queued tasks lets idle workers sleep instead of spinning.
+// Tasks are submitted from one thread at a time (typically the pool's owner).
+
+#ifndef _WORK_POOL_H_
+#define _WORK_POOL_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#define WORK_POOL_MAX_THREADS 64
+#define WORK_POOL_DEQUE_CAPACITY 256
+
+typedef void (*WorkPool_function_t)(void* arg);
+
+typedef struct {
+    WorkPool_function_t function;
+    void* arg;
+} WorkPool_task_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    WorkPool_task_t tasks[WORK_POOL_DEQUE_CAPACITY];
+    long long top;          // oldest task (thieves take from here)
+    long long bottom;       // one past the newest task (the owner takes from here)
+    long long executed;     // written only by the owning worker
+    long long stolen;       // tasks this worker took from other deques
+    void* pool;             // owning pool and index, for the worker thread
+    int index;
+} WorkPool_deque_t;
+
+typedef struct {
+    int numThreads;
+    pthread_t threads[WORK_POOL_MAX_THREADS];
+    WorkPool_deque_t deques[WORK_POOL_MAX_THREADS];
+    // Guards the counts below and the sleeping workers / waiters
+    pthread_mutex_t countLock;
+    pthread_cond_t taskQueued;
+    pthread_cond_t allDone;
+    int queued;             // submitted and not yet claimed by a worker
+    int unfinished;         // submitted and not yet finished
+    int nextDeque;
+    bool isStopping;
+} WorkPool_t;
+
+// Start `numThreads` workers (clamped to 1..WORK_POOL_MAX_THREADS).
+void WorkPool_init(WorkPool_t* pool, int numThreads);
+
+// Queue `function(arg)`. If every deque is full, the caller runs queued tasks
+// itself until there is room.
+void WorkPool_submit(WorkPool_t* pool, WorkPool_function_t function, void* arg);
+
+// Wait until every submitted task has finished.
+void WorkPool_wait(WorkPool_t* pool);
+
+// Totals over all workers since init (read after WorkPool_wait()).
+long long WorkPool_getExecuted(WorkPool_t* pool);
+long long WorkPool_getStolen(WorkPool_t* pool);
+
+// Finish queued tasks, then stop and join the workers.
+void WorkPool_cleanup(WorkPool_t* pool);
+
+// Number of online CPUs (at least 1).
+int WorkPool_getNumCpus(void);
+
+#endif
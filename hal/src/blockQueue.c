@@ -0,0 +1,111 @@
+// blockQueue.c
+// Lock-free broadcast ring of sample blocks (see blockQueue.h)
+//
+// Slot versions: 2*seq+1 while block `seq` is being written, 2*seq+2 once complete.
+// A reader may copy a slot while the producer rewrites it (the versions tell it
+// to discard the copy), so the slot contents are accessed with relaxed atomics:
+// the race is then benign by the C11 model and ThreadSanitizer agrees.
+
+#include "hal/blockQueue.h"
+#include "hal/relaxedCopy.h"
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+void BlockQueue_copyBlockRelaxed(SampleBlock_t* to, const SampleBlock_t* from)
+{
+    COPY_RELAXED(to, from, sequence);
+    COPY_RELAXED(to, from, firstSampleNumber);
+    COPY_RELAXED(to, from, newestSampleNs);
+    COPY_RELAXED(to, from, numDips);
+    for (int i = 0; i < SAMPLE_BLOCK_SAMPLES; i++){
+        COPY_RELAXED(to, from, samples[i]);
+    }
+}
+
+void BlockQueue_init(BlockQueue_t* queue)
+{
+    memset(queue->slots, 0, sizeof(queue->slots));
+    for (int i = 0; i < BLOCK_QUEUE_CAPACITY; i++){
+        atomic_init(&queue->versions[i], 0);
+    }
+    atomic_init(&queue->nextSequence, 0);
+    queue->notifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+void BlockQueue_cleanup(BlockQueue_t* queue)
+{
+    if (queue->notifyFd >= 0){
+        close(queue->notifyFd);
+        queue->notifyFd = -1;
+    }
+}
+
+void BlockQueue_publish(BlockQueue_t* queue, const SampleBlock_t* block)
+{
+    long long sequence = atomic_load_explicit(&queue->nextSequence, memory_order_relaxed);
+    int index = sequence % BLOCK_QUEUE_CAPACITY;
+
+    atomic_store_explicit(&queue->versions[index], 2 * sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    SampleBlock_t numbered = *block;
+    numbered.sequence = sequence;
+    BlockQueue_copyBlockRelaxed(&queue->slots[index], &numbered);
+    atomic_store_explicit(&queue->versions[index], 2 * sequence + 2, memory_order_release);
+    atomic_store_explicit(&queue->nextSequence, sequence + 1, memory_order_release);
+
+    if (queue->notifyFd >= 0){
+        uint64_t one = 1;
+        // Non-blocking; a full counter just means consumers already have a wakeup pending
+        if (write(queue->notifyFd, &one, sizeof(one)) < 0){
+            // ignore
+        }
+    }
+}
+
+long long BlockQueue_nextSequence(BlockQueue_t* queue)
+{
+    return atomic_load_explicit(&queue->nextSequence, memory_order_acquire);
+}
+
+BlockQueue_result_t BlockQueue_read(BlockQueue_t* queue, long long* cursor, SampleBlock_t* block)
+{
+    while (true){
+        long long next = atomic_load_explicit(&queue->nextSequence, memory_order_acquire);
+        if (*cursor >= next){
+            return BLOCK_QUEUE_EMPTY;
+        }
+        if (next - *cursor > BLOCK_QUEUE_CAPACITY){
+            // Fell behind: resume at the oldest block still in the ring
+            *cursor = next - BLOCK_QUEUE_CAPACITY;
+        }
+        int index = *cursor % BLOCK_QUEUE_CAPACITY;
+        long long expected = 2 * *cursor + 2;
+        long long before = atomic_load_explicit(&queue->versions[index], memory_order_acquire);
+        if (before == expected){
+            BlockQueue_copyBlockRelaxed(block, &queue->slots[index]);
+            atomic_thread_fence(memory_order_acquire);
+            long long after = atomic_load_explicit(&queue->versions[index], memory_order_relaxed);
+            if (after == expected){
+                (*cursor)++;
+                return BLOCK_QUEUE_OK;
+            }
+        }
+        // The slot was overwritten while we looked; retry from the new oldest block
+        (*cursor)++;
+    }
+}
+
+int BlockQueue_notifyFd(BlockQueue_t* queue)
+{
+    return queue->notifyFd;
+}
+
+void BlockQueue_clearNotify(BlockQueue_t* queue)
+{
+    uint64_t count;
+    if (read(queue->notifyFd, &count, sizeof(count)) < 0){
+        // nothing pending
+    }
+}
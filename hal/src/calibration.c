@@ -0,0 +1,258 @@
+// calibration.c
+// Count to volts/lux lookup tables, rebuilt and swapped atomically (see calibration.h)
+
+#include "hal/calibration.h"
+#include "hal/timing.h"
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define A2D_MAX_READING (CALIBRATION_TABLE_SIZE - 1)
+#define LINE_MAX_LEN 256
+#define NS_PER_MS 1000000
+// How often a rebuild rechecks a retired table that is still held
+#define HOLD_POLL_MS 1
+
+#define DEFAULT_REF_VOLTS 1.8
+#define DEFAULT_SUPPLY_VOLTS 1.8
+#define DEFAULT_FIXED_OHMS 10000.0
+#define DEFAULT_OHMS_AT_10_LUX 10000.0
+#define DEFAULT_GAMMA 0.7
+
+static Calibration_table_t tables[2];
+static _Atomic(Calibration_table_t*) activeTable = NULL;
+static pthread_mutex_t rebuildMutex = PTHREAD_MUTEX_INITIALIZER;
+static long long lastSwapNs = 0;
+// Calibration_holdTable() holders of each table set
+static atomic_int numHolders[2];
+static bool is_initialized = false;
+
+static double modelLux(const Calibration_curve_t* curve, double volts);
+static double pointsLux(const Calibration_curve_t* curve, int count);
+static bool checkCurve(const Calibration_curve_t* curve, char* error, int errorLen);
+
+void Calibration_init(void)
+{
+    assert(!is_initialized);
+    is_initialized = true;
+    Calibration_curve_t curve;
+    Calibration_defaultCurve(&curve);
+    const char* path = getenv(CALIBRATION_FILE_ENV);
+    if (path && path[0]){
+        char error[LINE_MAX_LEN];
+        if (!Calibration_loadCurve(path, &curve, error, sizeof(error))){
+            printf("WARNING: calibration %s not used (%s); using the default curve.\n", path, error);
+            Calibration_defaultCurve(&curve);
+        }
+    }
+    Calibration_apply(&curve);
+}
+
+void Calibration_cleanup(void)
+{
+    assert(is_initialized);
+    is_initialized = false;
+}
+
+void Calibration_defaultCurve(Calibration_curve_t* curve)
+{
+    memset(curve, 0, sizeof(*curve));
+    curve->refVolts = DEFAULT_REF_VOLTS;
+    curve->supplyVolts = DEFAULT_SUPPLY_VOLTS;
+    curve->fixedOhms = DEFAULT_FIXED_OHMS;
+    curve->ohmsAt10Lux = DEFAULT_OHMS_AT_10_LUX;
+    curve->gamma = DEFAULT_GAMMA;
+    curve->photoresistorOnTop = true;
+    snprintf(curve->source, sizeof(curve->source), "default");
+}
+
+bool Calibration_loadCurve(const char* path, Calibration_curve_t* curve, char* error, int errorLen)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL){
+        snprintf(error, errorLen, "unable to open %s", path);
+        return false;
+    }
+    Calibration_defaultCurve(curve);
+    snprintf(curve->source, sizeof(curve->source), "%s", path);
+    char line[LINE_MAX_LEN];
+    int lineNumber = 0;
+    bool isValid = true;
+    while (isValid && fgets(line, sizeof(line), file)){
+        lineNumber++;
+        char* comment = strchr(line, '#');
+        if (comment){
+            *comment = 0;
+        }
+        char key[32];
+        char text[32];
+        double value = 0;
+        int count = 0;
+        if (sscanf(line, "%31s", key) != 1){
+            continue;
+        }
+        if (strcmp(key, "point") == 0){
+            if (curve->numPoints >= CALIBRATION_MAX_POINTS || sscanf(line, "%*s %d %lf", &count, &value) != 2){
+                isValid = false;
+            } else {
+                curve->pointCounts[curve->numPoints] = count;
+                curve->pointLux[curve->numPoints] = value;
+                curve->numPoints++;
+            }
+        } else if (strcmp(key, "photoresistor") == 0 && sscanf(line, "%*s %31s", text) == 1
+                && (strcmp(text, "top") == 0 || strcmp(text, "bottom") == 0)){
+            curve->photoresistorOnTop = strcmp(text, "top") == 0;
+        } else if (sscanf(line, "%*s %lf", &value) != 1){
+            isValid = false;
+        } else if (strcmp(key, "ref_volts") == 0){
+            curve->refVolts = value;
+        } else if (strcmp(key, "supply_volts") == 0){
+            curve->supplyVolts = value;
+        } else if (strcmp(key, "fixed_ohms") == 0){
+            curve->fixedOhms = value;
+        } else if (strcmp(key, "ohms_at_10_lux") == 0){
+            curve->ohmsAt10Lux = value;
+        } else if (strcmp(key, "gamma") == 0){
+            curve->gamma = value;
+        } else {
+            isValid = false;
+        }
+    }
+    fclose(file);
+    if (!isValid){
+        snprintf(error, errorLen, "line %d not understood", lineNumber);
+        return false;
+    }
+    return checkCurve(curve, error, errorLen);
+}
+
+void Calibration_apply(const Calibration_curve_t* curve)
+{
+    pthread_mutex_lock(&rebuildMutex);
+    Calibration_table_t* current = atomic_load_explicit(&activeTable, memory_order_relaxed);
+    Calibration_table_t* next = current == &tables[0] ? &tables[1] : &tables[0];
+    // Readers of the table retired by the last swap have had time to finish
+    long long waitNs = lastSwapNs + (long long)CALIBRATION_GRACE_MS * NS_PER_MS - getTimeInNs();
+    if (current && waitNs > 0){
+        sleepForMs(waitNs / NS_PER_MS + 1);
+    }
+    // A reply may hold it for longer; the swap was seq_cst, so any new holder sees it and moves on
+    while (current && atomic_load(&numHolders[next - tables]) > 0){
+        sleepForMs(HOLD_POLL_MS);
+    }
+
+    long long startNs = getTimeInNs();
+    next->curve = *curve;
+    next->countsPerVolt = A2D_MAX_READING / curve->refVolts;
+    for (int count = 0; count < CALIBRATION_TABLE_SIZE; count++){
+        // The sampler's original conversion, so default-curve volts are unchanged to the bit
+        double volts = ((double)count / (double)A2D_MAX_READING) * curve->refVolts;
+        double lux = curve->numPoints >= 2 ? pointsLux(curve, count) : modelLux(curve, volts);
+        next->volts[count] = volts;
+        next->lux[count] = (float)lux;
+    }
+    next->generation = current ? current->generation + 1 : 1;
+    next->buildNs = getTimeInNs() - startNs;
+
+    atomic_store(&activeTable, next);
+    lastSwapNs = getTimeInNs();
+    pthread_mutex_unlock(&rebuildMutex);
+}
+
+const Calibration_table_t* Calibration_getTable(void)
+{
+    return atomic_load_explicit(&activeTable, memory_order_acquire);
+}
+
+const Calibration_table_t* Calibration_holdTable(void)
+{
+    while (true){
+        Calibration_table_t* table = atomic_load(&activeTable);
+        atomic_fetch_add(&numHolders[table - tables], 1);
+        // Still active after counting ourselves in: a rebuild cannot start on it now
+        if (atomic_load(&activeTable) == table){
+            return table;
+        }
+        atomic_fetch_sub(&numHolders[table - tables], 1);
+    }
+}
+
+void Calibration_releaseTable(const Calibration_table_t* table)
+{
+    atomic_fetch_sub(&numHolders[table - tables], 1);
+}
+
+double Calibration_countToVolts(int count)
+{
+    count = count < 0 ? 0 : count > A2D_MAX_READING ? A2D_MAX_READING : count;
+    return Calibration_getTable()->volts[count];
+}
+
+double Calibration_countToLux(int count)
+{
+    count = count < 0 ? 0 : count > A2D_MAX_READING ? A2D_MAX_READING : count;
+    return Calibration_getTable()->lux[count];
+}
+
+double Calibration_voltsToLux(const Calibration_table_t* table, double volts)
+{
+    int count = (int)(volts * table->countsPerVolt + 0.5);
+    count = count < 0 ? 0 : count > A2D_MAX_READING ? A2D_MAX_READING : count;
+    return table->lux[count];
+}
+
+// Divider model: photoresistance from the junction voltage, then lux from the power law
+static double modelLux(const Calibration_curve_t* curve, double volts)
+{
+    double supply = curve->supplyVolts;
+    if (volts <= 0){
+        return curve->photoresistorOnTop ? 0 : CALIBRATION_MAX_LUX;
+    }
+    if (volts >= supply){
+        return curve->photoresistorOnTop ? CALIBRATION_MAX_LUX : 0;
+    }
+    double ohms = curve->photoresistorOnTop
+            ? curve->fixedOhms * (supply - volts) / volts
+            : curve->fixedOhms * volts / (supply - volts);
+    double lux = 10 * pow(ohms / curve->ohmsAt10Lux, -1 / curve->gamma);
+    return lux < CALIBRATION_MAX_LUX ? lux : CALIBRATION_MAX_LUX;
+}
+
+// Measured points: linear in log lux between neighbours, flat beyond the ends
+static double pointsLux(const Calibration_curve_t* curve, int count)
+{
+    int last = curve->numPoints - 1;
+    if (count <= curve->pointCounts[0]){
+        return curve->pointLux[0];
+    }
+    if (count >= curve->pointCounts[last]){
+        return curve->pointLux[last];
+    }
+    int i = 0;
+    while (count > curve->pointCounts[i + 1]){
+        i++;
+    }
+    double fraction = (double)(count - curve->pointCounts[i]) / (curve->pointCounts[i + 1] - curve->pointCounts[i]);
+    return exp(log(curve->pointLux[i]) + fraction * (log(curve->pointLux[i + 1]) - log(curve->pointLux[i])));
+}
+
+static bool checkCurve(const Calibration_curve_t* curve, char* error, int errorLen)
+{
+    if (curve->refVolts <= 0 || curve->supplyVolts <= 0 || curve->fixedOhms <= 0
+            || curve->ohmsAt10Lux <= 0 || curve->gamma <= 0){
+        snprintf(error, errorLen, "volts, ohms and gamma must be positive");
+        return false;
+    }
+    for (int i = 0; i < curve->numPoints; i++){
+        if (curve->pointLux[i] <= 0 || curve->pointCounts[i] < 0 || curve->pointCounts[i] > A2D_MAX_READING
+                || (i > 0 && curve->pointCounts[i] <= curve->pointCounts[i - 1])){
+            snprintf(error, errorLen, "points need counts 0-%d in increasing order and lux > 0", A2D_MAX_READING);
+            return false;
+        }
+    }
+    return true;
+}
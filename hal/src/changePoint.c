@@ -0,0 +1,184 @@
+// changePoint.c
+// CUSUM and Page-Hinkley change-point detection on 10-sample block means (see changePoint.h)
+
+#include "hal/changePoint.h"
+#include <string.h>
+
+#define DEFAULT_CUSUM_SLACK 0.02
+#define DEFAULT_CUSUM_THRESHOLD 2.5
+#define DEFAULT_PAGE_HINKLEY_DELTA 0.01
+#define DEFAULT_PAGE_HINKLEY_LAMBDA 1.5
+
+static int addBlock(ChangePoint_t* changePoint, double mean, long long sampleNumber,
+        long long sampleTimeMs, long long acquiredNs);
+static bool updateCusum(const ChangePoint_t* changePoint, ChangePoint_detector_t* detector, double mean);
+static bool updatePageHinkley(const ChangePoint_t* changePoint, ChangePoint_detector_t* detector, double mean);
+static void startOnset(const ChangePoint_t* changePoint, ChangePoint_side_t* side, double level);
+static void resetDetector(ChangePoint_detector_t* detector);
+
+ChangePoint_config_t ChangePoint_defaultConfig(void)
+{
+    ChangePoint_config_t config = {
+        .cusumSlack = DEFAULT_CUSUM_SLACK,
+        .cusumThreshold = DEFAULT_CUSUM_THRESHOLD,
+        .pageHinkleyDelta = DEFAULT_PAGE_HINKLEY_DELTA,
+        .pageHinkleyLambda = DEFAULT_PAGE_HINKLEY_LAMBDA,
+    };
+    return config;
+}
+
+void ChangePoint_init(ChangePoint_t* changePoint, const ChangePoint_config_t* config)
+{
+    memset(changePoint, 0, sizeof(*changePoint));
+    changePoint->config = *config;
+    for (int m = 0; m < CHANGE_POINT_NUM_METHODS; m++){
+        changePoint->detectors[m].method = m;
+        resetDetector(&changePoint->detectors[m]);
+    }
+}
+
+int ChangePoint_addSample(ChangePoint_t* changePoint, double volts, long long sampleNumber,
+        long long sampleTimeMs, long long acquiredNs)
+{
+    if (changePoint->blockCount == 0){
+        changePoint->blockFirstSample = sampleNumber;
+        changePoint->blockFirstTimeMs = sampleTimeMs;
+        changePoint->blockSum = 0;
+    }
+    changePoint->blockSum += volts;
+    changePoint->blockCount++;
+    if (changePoint->blockCount < CHANGE_POINT_BLOCK_SAMPLES){
+        return 0;
+    }
+    changePoint->blockCount = 0;
+    return addBlock(changePoint, changePoint->blockSum / CHANGE_POINT_BLOCK_SAMPLES, sampleNumber, sampleTimeMs, acquiredNs);
+}
+
+int ChangePoint_list(const ChangePoint_t* changePoint, ChangePoint_event_t* events, int maxEvents)
+{
+    int count = 0;
+    for (long long id = changePoint->nextId - 1;
+            id >= 0 && id >= changePoint->nextId - CHANGE_POINT_MAX_EVENTS && count < maxEvents; id--){
+        events[count++] = changePoint->events[id % CHANGE_POINT_MAX_EVENTS];
+    }
+    return count;
+}
+
+const char* ChangePoint_methodName(ChangePoint_method_t method)
+{
+    return method == CHANGE_POINT_CUSUM ? "cusum" : "page-hinkley";
+}
+
+// Run every detector on a completed block; record and reset those that alarm
+static int addBlock(ChangePoint_t* changePoint, double mean, long long sampleNumber,
+        long long sampleTimeMs, long long acquiredNs)
+{
+    int numEvents = 0;
+    for (int m = 0; m < CHANGE_POINT_NUM_METHODS; m++){
+        ChangePoint_detector_t* detector = &changePoint->detectors[m];
+        bool isAlarm = m == CHANGE_POINT_CUSUM
+                ? updateCusum(changePoint, detector, mean)
+                : updatePageHinkley(changePoint, detector, mean);
+        if (!isAlarm){
+            continue;
+        }
+        // Report the side further past its start; both alarming at once is a
+        // sign of a noisy reference and either will do
+        bool isRise = detector->rise.statistic - detector->rise.extreme
+                >= detector->fall.statistic - detector->fall.extreme;
+        const ChangePoint_side_t* side = isRise ? &detector->rise : &detector->fall;
+        ChangePoint_event_t* event = &changePoint->events[changePoint->nextId % CHANGE_POINT_MAX_EVENTS];
+        event->id = changePoint->nextId++;
+        event->method = detector->method;
+        event->direction = isRise ? 1 : -1;
+        event->onsetSampleNumber = side->onsetSampleNumber;
+        event->onsetTimeMs = side->onsetTimeMs;
+        event->detectedSampleNumber = sampleNumber;
+        event->detectedTimeMs = sampleTimeMs;
+        event->detectedNs = acquiredNs;
+        event->levelBefore = side->levelAtOnset;
+        event->levelAfter = side->blocksSinceOnset > 0 ? side->sumSinceOnset / side->blocksSinceOnset : mean;
+        resetDetector(detector);
+        numEvents++;
+    }
+    return numEvents;
+}
+
+// CUSUM against the level of the warm-up blocks. Returns true on an alarm.
+static bool updateCusum(const ChangePoint_t* changePoint, ChangePoint_detector_t* detector, double mean)
+{
+    if (detector->referenceBlocks < CHANGE_POINT_WARMUP_BLOCKS){
+        detector->referenceSum += mean;
+        detector->referenceBlocks++;
+        return false;
+    }
+    double reference = detector->referenceSum / detector->referenceBlocks;
+    double slack = changePoint->config.cusumSlack;
+    ChangePoint_side_t* sides[2] = {&detector->rise, &detector->fall};
+    double deviations[2] = {mean - reference - slack, reference - mean - slack};
+    for (int s = 0; s < 2; s++){
+        ChangePoint_side_t* side = sides[s];
+        double next = side->statistic + deviations[s];
+        if (next <= 0){
+            side->statistic = 0;
+            continue;
+        }
+        if (side->statistic == 0){
+            // Growing from zero: the change (if it is one) starts here
+            startOnset(changePoint, side, reference);
+        }
+        side->statistic = next;
+        side->sumSinceOnset += mean;
+        side->blocksSinceOnset++;
+    }
+    return detector->rise.statistic > changePoint->config.cusumThreshold
+            || detector->fall.statistic > changePoint->config.cusumThreshold;
+}
+
+// Page-Hinkley against the running mean since the last reset. Each side's
+// statistic only ever accumulates; its minimum so far marks the onset.
+static bool updatePageHinkley(const ChangePoint_t* changePoint, ChangePoint_detector_t* detector, double mean)
+{
+    detector->referenceSum += mean;
+    detector->referenceBlocks++;
+    double runningMean = detector->referenceSum / detector->referenceBlocks;
+    if (detector->referenceBlocks <= CHANGE_POINT_WARMUP_BLOCKS){
+        return false;
+    }
+    double delta = changePoint->config.pageHinkleyDelta;
+    ChangePoint_side_t* sides[2] = {&detector->rise, &detector->fall};
+    double deviations[2] = {mean - runningMean - delta, runningMean - mean - delta};
+    for (int s = 0; s < 2; s++){
+        ChangePoint_side_t* side = sides[s];
+        side->statistic += deviations[s];
+        if (side->statistic <= side->extreme){
+            side->extreme = side->statistic;
+            startOnset(changePoint, side, runningMean);
+        } else {
+            side->sumSinceOnset += mean;
+            side->blocksSinceOnset++;
+        }
+    }
+    double lambda = changePoint->config.pageHinkleyLambda;
+    return detector->rise.statistic - detector->rise.extreme > lambda
+            || detector->fall.statistic - detector->fall.extreme > lambda;
+}
+
+// Mark the block just completed as where a change began
+static void startOnset(const ChangePoint_t* changePoint, ChangePoint_side_t* side, double level)
+{
+    side->onsetSampleNumber = changePoint->blockFirstSample;
+    side->onsetTimeMs = changePoint->blockFirstTimeMs;
+    side->levelAtOnset = level;
+    side->sumSinceOnset = 0;
+    side->blocksSinceOnset = 0;
+}
+
+// Forget the reference level; the next blocks learn the new one
+static void resetDetector(ChangePoint_detector_t* detector)
+{
+    detector->referenceSum = 0;
+    detector->referenceBlocks = 0;
+    memset(&detector->rise, 0, sizeof(detector->rise));
+    memset(&detector->fall, 0, sizeof(detector->fall));
+}
@@ -0,0 +1,86 @@
+// dipCapture.c
+// Pre/post-trigger captures in a fixed slot pool (see dipCapture.h)
+//
+// Capture `id` always lives in slot id % DIP_CAPTURE_SLOTS, so the oldest
+// capture is the one reused and lookups by id need no search.
+
+#include "hal/dipCapture.h"
+#include <string.h>
+
+void DipCapture_init(DipCapture_pool_t* pool)
+{
+    memset(pool, 0, sizeof(*pool));
+}
+
+void DipCapture_addSample(DipCapture_pool_t* pool, double volts, bool isTrigger, long long sampleNumber,
+        long long sampleTimeMs, long long acquiredNs, double thresholdVolts)
+{
+    // Extend the captures still open (the trigger sample of a new one is added below)
+    for (int i = 0; i < DIP_CAPTURE_SLOTS && pool->numOpen > 0; i++){
+        DipCapture_t* capture = &pool->slots[i];
+        if (capture->info.numPost == 0 || capture->info.complete){
+            continue;
+        }
+        capture->samples[capture->info.numPre + capture->info.numPost++] = volts;
+        if (capture->info.numPost == DIP_CAPTURE_POST_SAMPLES){
+            capture->info.complete = true;
+            pool->numOpen--;
+        }
+    }
+
+    if (isTrigger){
+        DipCapture_t* capture = &pool->slots[pool->nextId % DIP_CAPTURE_SLOTS];
+        if (capture->info.numPost > 0 && !capture->info.complete){
+            pool->overwrittenOpen++;
+            pool->numOpen--;
+        }
+        capture->info.id = pool->nextId++;
+        capture->info.triggerSampleNumber = sampleNumber;
+        capture->info.triggerTimeMs = sampleTimeMs;
+        capture->info.triggerNs = acquiredNs;
+        capture->info.triggerVolts = volts;
+        capture->info.thresholdVolts = thresholdVolts;
+        // Unroll the ring, oldest first, in at most two copies
+        int numPre = pool->preCount;
+        int oldest = (pool->preNext - numPre + DIP_CAPTURE_PRE_SAMPLES) % DIP_CAPTURE_PRE_SAMPLES;
+        int firstPart = numPre < DIP_CAPTURE_PRE_SAMPLES - oldest ? numPre : DIP_CAPTURE_PRE_SAMPLES - oldest;
+        memcpy(capture->samples, &pool->preRing[oldest], sizeof(double) * firstPart);
+        memcpy(capture->samples + firstPart, pool->preRing, sizeof(double) * (numPre - firstPart));
+        capture->info.numPre = numPre;
+        capture->samples[numPre] = volts;
+        capture->info.numPost = 1;
+        capture->info.complete = DIP_CAPTURE_POST_SAMPLES == 1;
+        if (!capture->info.complete){
+            pool->numOpen++;
+        }
+    }
+
+    pool->preRing[pool->preNext] = volts;
+    pool->preNext = (pool->preNext + 1) % DIP_CAPTURE_PRE_SAMPLES;
+    if (pool->preCount < DIP_CAPTURE_PRE_SAMPLES){
+        pool->preCount++;
+    }
+}
+
+int DipCapture_list(const DipCapture_pool_t* pool, DipCapture_info_t* infos, int maxInfos)
+{
+    int count = 0;
+    for (long long id = pool->nextId - 1; id >= 0 && id >= pool->nextId - DIP_CAPTURE_SLOTS && count < maxInfos; id--){
+        infos[count++] = pool->slots[id % DIP_CAPTURE_SLOTS].info;
+    }
+    return count;
+}
+
+bool DipCapture_get(const DipCapture_pool_t* pool, long long id, DipCapture_t* capture)
+{
+    if (id < 0){
+        id = pool->nextId - 1;
+    }
+    if (id < 0 || id >= pool->nextId || id < pool->nextId - DIP_CAPTURE_SLOTS){
+        return false;
+    }
+    const DipCapture_t* slot = &pool->slots[id % DIP_CAPTURE_SLOTS];
+    capture->info = slot->info;
+    memcpy(capture->samples, slot->samples, sizeof(double) * (slot->info.numPre + slot->info.numPost));
+    return true;
+}
@@ -0,0 +1,59 @@
+// dipDetector.c
+// Smoothed-average dip detection with hysteresis (see dipDetector.h)
+
+#include "hal/dipDetector.h"
+
+static double smooth(const DipDetector_config_t* config, double average, double volts);
+
+DipDetector_config_t DipDetector_defaultConfig(void)
+{
+    DipDetector_config_t config = {
+        .thresholdVolts = DIP_DETECTOR_DEFAULT_THRESHOLD,
+        .hysteresisVolts = DIP_DETECTOR_DEFAULT_HYSTERESIS,
+        .smoothingWeight = DIP_DETECTOR_DEFAULT_SMOOTHING,
+    };
+    return config;
+}
+
+void DipDetector_init(DipDetector_t* detector, const DipDetector_config_t* config, double initialAverage)
+{
+    detector->config = *config;
+    detector->average = initialAverage;
+    detector->dipAllowed = true;
+}
+
+bool DipDetector_update(DipDetector_t* detector, double volts)
+{
+    bool isDip = false;
+    if (detector->dipAllowed){
+        if (volts <= detector->average - detector->config.thresholdVolts){
+            detector->dipAllowed = false;
+            isDip = true;
+        }
+    } else {
+        if (volts >= detector->average - detector->config.hysteresisVolts){
+            detector->dipAllowed = true;
+        }
+    }
+    detector->average = smooth(&detector->config, detector->average, volts);
+    return isDip;
+}
+
+double DipDetector_getTriggerVolts(const DipDetector_t* detector)
+{
+    return detector->average - detector->config.thresholdVolts;
+}
+
+double DipDetector_advanceAverage(const DipDetector_config_t* config, double average, const double* volts, int numSamples)
+{
+    for (int i = 0; i < numSamples; i++){
+        average = smooth(config, average, volts[i]);
+    }
+    return average;
+}
+
+// The one place the average is updated, so every caller rounds the same way
+static double smooth(const DipDetector_config_t* config, double average, double volts)
+{
+    return (config->smoothingWeight * average) + ((1 - config->smoothingWeight) * volts);
+}
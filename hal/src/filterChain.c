@@ -0,0 +1,371 @@
+// filterChain.c
+// Block-based FIR/IIR/median filter chain (see filterChain.h)
+
+#include "hal/filterChain.h"
+#include "hal/timing.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAP_ALIGNMENT 4
+#define DEFAULT_CUTOFF_OF_NYQUIST 0.8
+#define BUTTERWORTH_Q 0.70710678118654752
+#define MAX_SPEC_LEN 256
+
+typedef struct {
+    FilterStage_type_t type;
+    int length;
+    int decimation;
+    double cutoffHz;
+} stageSpec_t;
+
+static FilterStage_t* addStage(FilterChain_t* chain, FilterStage_type_t type, int length, int decimation);
+static int processMovingAverage(FilterStage_t* stage, double* samples, int count);
+static int processMedian(FilterStage_t* stage, double* samples, int count);
+static int processBiquad(FilterStage_t* stage, double* samples, int count);
+static int processFir(FilterStage_t* stage, double* samples, int count);
+static bool parseStage(char* token, stageSpec_t* spec);
+
+void FilterChain_init(FilterChain_t* chain)
+{
+    chain->numStages = 0;
+    chain->decimation = 1;
+}
+
+bool FilterChain_addMovingAverage(FilterChain_t* chain, int length)
+{
+    if (length < 1 || length > FILTER_MAX_WINDOW){
+        return false;
+    }
+    FilterStage_t* stage = addStage(chain, FILTER_MOVING_AVERAGE, length, 1);
+    if (!stage){
+        return false;
+    }
+    snprintf(stage->description, sizeof(stage->description), "ma:%d", length);
+    return true;
+}
+
+bool FilterChain_addMedian(FilterChain_t* chain, int length)
+{
+    if (length < 1 || length > FILTER_MAX_WINDOW || length % 2 == 0){
+        return false;
+    }
+    FilterStage_t* stage = addStage(chain, FILTER_MEDIAN, length, 1);
+    if (!stage){
+        return false;
+    }
+    snprintf(stage->description, sizeof(stage->description), "median:%d", length);
+    return true;
+}
+
+// RBJ cookbook low-pass, normalised so a0 = 1
+bool FilterChain_addLowPassBiquad(FilterChain_t* chain, double sampleRateHz, double cutoffHz)
+{
+    if (cutoffHz <= 0 || cutoffHz >= sampleRateHz / 2){
+        return false;
+    }
+    FilterStage_t* stage = addStage(chain, FILTER_BIQUAD, 0, 1);
+    if (!stage){
+        return false;
+    }
+    double w0 = 2 * M_PI * cutoffHz / sampleRateHz;
+    double alpha = sin(w0) / (2 * BUTTERWORTH_Q);
+    double cosW0 = cos(w0);
+    double a0 = 1 + alpha;
+    stage->coefficients[0] = (1 - cosW0) / 2 / a0;
+    stage->coefficients[1] = (1 - cosW0) / a0;
+    stage->coefficients[2] = (1 - cosW0) / 2 / a0;
+    stage->coefficients[3] = -2 * cosW0 / a0;
+    stage->coefficients[4] = (1 - alpha) / a0;
+    snprintf(stage->description, sizeof(stage->description), "lowpass:%g", cutoffHz);
+    return true;
+}
+
+// Hamming-windowed sinc with unity DC gain
+bool FilterChain_addFir(FilterChain_t* chain, int taps, int decimation, double sampleRateHz, double cutoffHz)
+{
+    int paddedTaps = (taps + TAP_ALIGNMENT - 1) / TAP_ALIGNMENT * TAP_ALIGNMENT;
+    if (taps < 1 || paddedTaps > FILTER_MAX_TAPS || decimation < 1
+            || chain->decimation * decimation > FILTER_MAX_DECIMATION){
+        return false;
+    }
+    if (cutoffHz <= 0){
+        cutoffHz = DEFAULT_CUTOFF_OF_NYQUIST * sampleRateHz / 2 / decimation;
+    }
+    if (cutoffHz >= sampleRateHz / 2){
+        return false;
+    }
+    FilterStage_t* stage = addStage(chain, FILTER_FIR, paddedTaps, decimation);
+    if (!stage){
+        return false;
+    }
+    double cutoff = cutoffHz / sampleRateHz;
+    double middle = (taps - 1) / 2.0;
+    double sum = 0;
+    double h[FILTER_MAX_TAPS] = {0};
+    for (int n = 0; n < taps; n++){
+        double x = n - middle;
+        double sinc = x == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x);
+        double window = taps > 1 ? 0.54 - 0.46 * cos(2 * M_PI * n / (taps - 1)) : 1;
+        h[n] = sinc * window;
+        sum += h[n];
+    }
+    // Reversed so the oldest sample in the delay line meets the last tap;
+    // the padding taps sit at the oldest end and stay zero
+    for (int n = 0; n < taps; n++){
+        stage->coefficients[paddedTaps - 1 - n] = h[n] / sum;
+    }
+    snprintf(stage->description, sizeof(stage->description), "fir:%d:%d:%g", taps, decimation, cutoffHz);
+    return true;
+}
+
+bool FilterChain_parse(FilterChain_t* chain, const char* spec, double outputRateHz)
+{
+    FilterChain_init(chain);
+    char buffer[MAX_SPEC_LEN];
+    snprintf(buffer, sizeof(buffer), "%s", spec);
+    stageSpec_t specs[FILTER_MAX_STAGES];
+    int numSpecs = 0;
+    int decimation = 1;
+    char* savePtr = NULL;
+    for (char* token = strtok_r(buffer, ",", &savePtr); token; token = strtok_r(NULL, ",", &savePtr)){
+        if (numSpecs >= FILTER_MAX_STAGES || !parseStage(token, &specs[numSpecs])){
+            return false;
+        }
+        decimation *= specs[numSpecs].decimation;
+        numSpecs++;
+    }
+    // Each stage runs at the output rate times the decimation still ahead of it
+    double rateHz = outputRateHz * decimation;
+    for (int i = 0; i < numSpecs; i++){
+        bool added = false;
+        switch (specs[i].type){
+            case FILTER_MOVING_AVERAGE:
+                added = FilterChain_addMovingAverage(chain, specs[i].length);
+                break;
+            case FILTER_MEDIAN:
+                added = FilterChain_addMedian(chain, specs[i].length);
+                break;
+            case FILTER_BIQUAD:
+                added = FilterChain_addLowPassBiquad(chain, rateHz, specs[i].cutoffHz);
+                break;
+            case FILTER_FIR:
+                added = FilterChain_addFir(chain, specs[i].length, specs[i].decimation, rateHz, specs[i].cutoffHz);
+                break;
+        }
+        if (!added){
+            FilterChain_init(chain);
+            return false;
+        }
+        rateHz /= specs[i].decimation;
+    }
+    return true;
+}
+
+int FilterChain_getNumStages(FilterChain_t* chain)
+{
+    return chain->numStages;
+}
+
+int FilterChain_getDecimation(FilterChain_t* chain)
+{
+    return chain->decimation;
+}
+
+int FilterChain_process(FilterChain_t* chain, const double* input, int numInputs, double* output)
+{
+    if (output != input){
+        memcpy(output, input, sizeof(double) * numInputs);
+    }
+    int count = numInputs;
+    for (int i = 0; i < chain->numStages && count > 0; i++){
+        FilterStage_t* stage = &chain->stages[i];
+        // Two reads per stage per block: the tick counter keeps that out of the cost it measures
+        long long startTicks = readTicks();
+        int produced = 0;
+        switch (stage->type){
+            case FILTER_MOVING_AVERAGE:
+                produced = processMovingAverage(stage, output, count);
+                break;
+            case FILTER_MEDIAN:
+                produced = processMedian(stage, output, count);
+                break;
+            case FILTER_BIQUAD:
+                produced = processBiquad(stage, output, count);
+                break;
+            case FILTER_FIR:
+                produced = processFir(stage, output, count);
+                break;
+        }
+        Metrics_counterAdd(&stage->costNs, ticksToNs(readTicks() - startTicks));
+        Metrics_counterAdd(&stage->samplesIn, count);
+        Metrics_counterAdd(&stage->samplesOut, produced);
+        count = produced;
+    }
+    return count;
+}
+
+static FilterStage_t* addStage(FilterChain_t* chain, FilterStage_type_t type, int length, int decimation)
+{
+    if (chain->numStages >= FILTER_MAX_STAGES){
+        return NULL;
+    }
+    FilterStage_t* stage = &chain->stages[chain->numStages++];
+    memset(stage, 0, sizeof(*stage));
+    stage->type = type;
+    stage->length = length;
+    stage->decimation = decimation;
+    atomic_init(&stage->samplesIn.value, 0);
+    atomic_init(&stage->samplesOut.value, 0);
+    atomic_init(&stage->costNs.value, 0);
+    chain->decimation *= decimation;
+    return stage;
+}
+
+// Until the window fills, averages over the samples seen so far
+static int processMovingAverage(FilterStage_t* stage, double* samples, int count)
+{
+    for (int i = 0; i < count; i++){
+        double x = samples[i];
+        if (stage->filled == stage->length){
+            stage->sum -= stage->window[stage->position];
+        } else {
+            stage->filled++;
+        }
+        stage->window[stage->position] = x;
+        stage->sum += x;
+        stage->position++;
+        if (stage->position == stage->length){
+            stage->position = 0;
+            // Re-add from scratch once per lap so rounding cannot drift
+            double sum = 0;
+            for (int k = 0; k < stage->filled; k++){
+                sum += stage->window[k];
+            }
+            stage->sum = sum;
+        }
+        samples[i] = stage->sum / stage->filled;
+    }
+    return count;
+}
+
+// Keeps the window sorted: drop the oldest value, insert the newest, read the middle
+static int processMedian(FilterStage_t* stage, double* samples, int count)
+{
+    for (int i = 0; i < count; i++){
+        double x = samples[i];
+        int size = stage->filled;
+        if (size == stage->length){
+            double oldest = stage->window[stage->position];
+            int k = 0;
+            while (k < size - 1 && stage->sorted[k] != oldest){
+                k++;
+            }
+            memmove(&stage->sorted[k], &stage->sorted[k + 1], sizeof(double) * (size - 1 - k));
+            size--;
+        } else {
+            stage->filled++;
+        }
+        int k = size;
+        while (k > 0 && stage->sorted[k - 1] > x){
+            stage->sorted[k] = stage->sorted[k - 1];
+            k--;
+        }
+        stage->sorted[k] = x;
+        stage->window[stage->position] = x;
+        stage->position = (stage->position + 1) % stage->length;
+        samples[i] = stage->sorted[stage->filled / 2];
+    }
+    return count;
+}
+
+// Transposed direct form II; state starts settled at the first input so there is no start-up dip
+static int processBiquad(FilterStage_t* stage, double* samples, int count)
+{
+    const double b0 = stage->coefficients[0];
+    const double b1 = stage->coefficients[1];
+    const double b2 = stage->coefficients[2];
+    const double a1 = stage->coefficients[3];
+    const double a2 = stage->coefficients[4];
+    double z1 = stage->z1;
+    double z2 = stage->z2;
+    if (stage->filled == 0 && count > 0){
+        z1 = (1 - b0) * samples[0];
+        z2 = (b2 - a2) * samples[0];
+        stage->filled = 1;
+    }
+    for (int i = 0; i < count; i++){
+        double x = samples[i];
+        double y = b0 * x + z1;
+        z1 = b1 * x - a1 * y + z2;
+        z2 = b2 * x - a2 * y;
+        samples[i] = y;
+    }
+    stage->z1 = z1;
+    stage->z2 = z2;
+    return count;
+}
+
+// Every input enters the doubled delay line; a dot product is only computed
+// for the inputs that survive decimation
+static int processFir(FilterStage_t* stage, double* samples, int count)
+{
+    const int taps = stage->length;
+    if (stage->filled == 0 && count > 0){
+        for (int k = 0; k < 2 * taps; k++){
+            stage->delay[k] = samples[0];
+        }
+        stage->filled = 1;
+    }
+    int produced = 0;
+    for (int i = 0; i < count; i++){
+        stage->delay[stage->position] = samples[i];
+        stage->delay[stage->position + taps] = samples[i];
+        stage->position = stage->position + 1 == taps ? 0 : stage->position + 1;
+        stage->phase++;
+        if (stage->phase < stage->decimation){
+            continue;
+        }
+        stage->phase = 0;
+        // delay[position .. position + taps - 1] runs oldest to newest
+        const double* window = &stage->delay[stage->position];
+        const double* c = stage->coefficients;
+        double acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+        for (int k = 0; k < taps; k += TAP_ALIGNMENT){
+            acc0 += c[k] * window[k];
+            acc1 += c[k + 1] * window[k + 1];
+            acc2 += c[k + 2] * window[k + 2];
+            acc3 += c[k + 3] * window[k + 3];
+        }
+        samples[produced++] = (acc0 + acc1) + (acc2 + acc3);
+    }
+    return produced;
+}
+
+// "ma:N", "median:N", "lowpass:HZ", "fir:T:D[:HZ]"
+static bool parseStage(char* token, stageSpec_t* spec)
+{
+    char name[16];
+    double a = 0, b = 1, c = 0;
+    int numFields = sscanf(token, " %15[a-z]:%lf:%lf:%lf", name, &a, &b, &c);
+    spec->length = (int)a;
+    spec->decimation = 1;
+    spec->cutoffHz = 0;
+    if (numFields == 2 && strcmp(name, "ma") == 0){
+        spec->type = FILTER_MOVING_AVERAGE;
+    } else if (numFields == 2 && strcmp(name, "median") == 0){
+        spec->type = FILTER_MEDIAN;
+    } else if (numFields == 2 && strcmp(name, "lowpass") == 0){
+        spec->type = FILTER_BIQUAD;
+        spec->cutoffHz = a;
+    } else if (numFields >= 2 && strcmp(name, "fir") == 0){
+        spec->type = FILTER_FIR;
+        spec->decimation = (int)b;
+        spec->cutoffHz = numFields == 4 ? c : 0;
+        return spec->decimation >= 1;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+// histogram.c
+// Lock-free log2 histogram (see histogram.h)
+
+#include "hal/histogram.h"
+
+static int bucketFor(long long value);
+
+void Histogram_init(Histogram_t* histogram)
+{
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++){
+        atomic_init(&histogram->buckets[i], 0);
+    }
+    atomic_init(&histogram->count, 0);
+    atomic_init(&histogram->sum, 0);
+    atomic_init(&histogram->max, 0);
+}
+
+void Histogram_record(Histogram_t* histogram, long long value)
+{
+    atomic_fetch_add_explicit(&histogram->buckets[bucketFor(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+    long long max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value, memory_order_relaxed, memory_order_relaxed)){
+        // max reloaded by the failed exchange
+    }
+}
+
+long long Histogram_bucketUpperBound(int bucket)
+{
+    if (bucket <= 0){
+        return 0;
+    }
+    return (1LL << bucket) - 1;
+}
+
+long long Histogram_percentile(Histogram_t* histogram, double fraction)
+{
+    long long count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    if (count == 0){
+        return 0;
+    }
+    long long target = (long long)(fraction * count);
+    if (target < 1){
+        target = 1;
+    }
+    long long seen = 0;
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++){
+        seen += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        if (seen >= target){
+            return Histogram_bucketUpperBound(i);
+        }
+    }
+    return atomic_load_explicit(&histogram->max, memory_order_relaxed);
+}
+
+static int bucketFor(long long value)
+{
+    if (value <= 0){
+        return 0;
+    }
+    int bucket = 64 - __builtin_clzll((unsigned long long)value);
+    return bucket < HISTOGRAM_NUM_BUCKETS ? bucket : HISTOGRAM_NUM_BUCKETS - 1;
+}
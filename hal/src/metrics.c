@@ -0,0 +1,177 @@
+// metrics.c
+// Metrics registry and text exposition (see metrics.h)
+
+#include "hal/metrics.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+} metricType_t;
+
+typedef struct {
+    metricType_t type;
+    const char* name;
+    const char* help;
+    void* metric;
+} entry_t;
+
+static const char* typeNames[] = {"counter", "gauge", "histogram"};
+
+// The registry only changes at init/cleanup; the lock also keeps a metric
+// from being unregistered while a scrape is reading it
+static pthread_mutex_t registryMutex = PTHREAD_MUTEX_INITIALIZER;
+static entry_t entries[METRICS_MAX_METRICS];
+static int numEntries = 0;
+
+static void registerMetric(metricType_t type, void* metric, const char* name, const char* help);
+static int formatEntry(const entry_t* entry, char* buffer, int bufferLen);
+static int formatHistogram(const entry_t* entry, char* buffer, int bufferLen);
+
+void Metrics_registerCounter(Metrics_counter_t* counter, const char* name, const char* help)
+{
+    atomic_init(&counter->value, 0);
+    registerMetric(METRIC_COUNTER, counter, name, help);
+}
+
+void Metrics_registerGauge(Metrics_gauge_t* gauge, const char* name, const char* help)
+{
+    atomic_init(&gauge->bits, 0);
+    Metrics_gaugeSet(gauge, 0);
+    registerMetric(METRIC_GAUGE, gauge, name, help);
+}
+
+void Metrics_registerHistogram(Histogram_t* histogram, const char* name, const char* help)
+{
+    Histogram_init(histogram);
+    registerMetric(METRIC_HISTOGRAM, histogram, name, help);
+}
+
+void Metrics_unregister(const void* metric)
+{
+    pthread_mutex_lock(&registryMutex);
+    for (int i = 0; i < numEntries; i++){
+        if (entries[i].metric == metric){
+            memmove(&entries[i], &entries[i + 1], sizeof(entry_t) * (numEntries - i - 1));
+            numEntries--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registryMutex);
+}
+
+void Metrics_counterAdd(Metrics_counter_t* counter, long long amount)
+{
+    atomic_fetch_add_explicit(&counter->value, amount, memory_order_relaxed);
+}
+
+long long Metrics_counterGet(Metrics_counter_t* counter)
+{
+    return atomic_load_explicit(&counter->value, memory_order_relaxed);
+}
+
+void Metrics_gaugeSet(Metrics_gauge_t* gauge, double value)
+{
+    unsigned long long bits;
+    memcpy(&bits, &value, sizeof(bits));
+    atomic_store_explicit(&gauge->bits, bits, memory_order_relaxed);
+}
+
+double Metrics_gaugeGet(Metrics_gauge_t* gauge)
+{
+    unsigned long long bits = atomic_load_explicit(&gauge->bits, memory_order_relaxed);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+int Metrics_format(char* buffer, int bufferLen)
+{
+    int length = 0;
+    pthread_mutex_lock(&registryMutex);
+    for (int i = 0; i < numEntries; i++){
+        int entryLength = formatEntry(&entries[i], buffer + length, bufferLen - length);
+        if (entryLength < 0){
+            break;
+        }
+        length += entryLength;
+    }
+    pthread_mutex_unlock(&registryMutex);
+    return length;
+}
+
+static void registerMetric(metricType_t type, void* metric, const char* name, const char* help)
+{
+    pthread_mutex_lock(&registryMutex);
+    if (numEntries >= METRICS_MAX_METRICS){
+        printf("ERROR: metrics registry full, cannot register %s\n", name);
+        exit(-1);
+    }
+    entries[numEntries].type = type;
+    entries[numEntries].metric = metric;
+    entries[numEntries].name = name;
+    entries[numEntries].help = help;
+    numEntries++;
+    pthread_mutex_unlock(&registryMutex);
+}
+
+// Format one metric with its HELP/TYPE lines; returns -1 if it does not fit
+static int formatEntry(const entry_t* entry, char* buffer, int bufferLen)
+{
+    int length = snprintf(buffer, bufferLen, "# HELP %s %s\n# TYPE %s %s\n",
+            entry->name, entry->help, entry->name, typeNames[entry->type]);
+    if (length >= bufferLen){
+        return -1;
+    }
+    int valueLength = 0;
+    switch (entry->type){
+        case METRIC_COUNTER:
+            valueLength = snprintf(buffer + length, bufferLen - length, "%s %lld\n",
+                    entry->name, Metrics_counterGet(entry->metric));
+            break;
+        case METRIC_GAUGE:
+            valueLength = snprintf(buffer + length, bufferLen - length, "%s %.9g\n",
+                    entry->name, Metrics_gaugeGet(entry->metric));
+            break;
+        case METRIC_HISTOGRAM:
+            valueLength = formatHistogram(entry, buffer + length, bufferLen - length);
+            break;
+    }
+    if (valueLength < 0 || valueLength >= bufferLen - length){
+        return -1;
+    }
+    return length + valueLength;
+}
+
+// Cumulative buckets up to the highest non-empty one, then +Inf, _sum and _count
+static int formatHistogram(const entry_t* entry, char* buffer, int bufferLen)
+{
+    Histogram_t* histogram = entry->metric;
+    long long counts[HISTOGRAM_NUM_BUCKETS];
+    int lastBucket = 0;
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++){
+        counts[i] = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        if (counts[i] > 0){
+            lastBucket = i;
+        }
+    }
+    int length = 0;
+    long long cumulative = 0;
+    for (int i = 0; i <= lastBucket && length < bufferLen; i++){
+        cumulative += counts[i];
+        length += snprintf(buffer + length, bufferLen - length, "%s_bucket{le=\"%lld\"} %lld\n",
+                entry->name, Histogram_bucketUpperBound(i), cumulative);
+    }
+    if (length < bufferLen){
+        // Bucket totals are the count here, so the series stays consistent mid-update
+        length += snprintf(buffer + length, bufferLen - length, "%s_bucket{le=\"+Inf\"} %lld\n%s_sum %lld\n%s_count %lld\n",
+                entry->name, cumulative,
+                entry->name, atomic_load_explicit(&histogram->sum, memory_order_relaxed),
+                entry->name, cumulative);
+    }
+    return length < bufferLen ? length : -1;
+}
@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "hal/periodTimer.h"
+#include "hal/timing.h"
 
 // Written by Brian Fraser
 
@@ -30,7 +31,6 @@ static void updateStats(
     timestamps_t *pData, 
     Period_statistics_t *pStats
 );
-static long long getTimeInNanoS(void);
 
 
 void Period_init(void)
@@ -53,7 +53,7 @@ void Period_markEvent(enum Period_whichEvent whichEvent)
     pthread_mutex_lock(&s_lock);
     {
         if (pData->timestampCount < MAX_EVENT_TIMESTAMPS) {
-            pData->timestampsInNs[pData->timestampCount] = getTimeInNanoS();
+            pData->timestampsInNs[pData->timestampCount] = getTimeInNs();
             pData->timestampCount++;
         } else {
             printf("WARNING: No sample space for event collection on %d\n", whichEvent);
@@ -129,23 +129,3 @@ static void updateStats(
     pStats->avgPeriodInMs = avgNs / MS_PER_NS;
     pStats->numSamples = pData->timestampCount;
 }
-
-
-
-
-
-// Timing function
-static long long getTimeInNanoS(void) 
-{
-    struct timespec spec;
-    clock_gettime(CLOCK_BOOTTIME, &spec);
-    long long seconds = spec.tv_sec;
-    long long nanoSeconds = spec.tv_nsec + seconds * 1000*1000*1000;
-	assert(nanoSeconds > 0);
-    
-    static long long lastTimeHack = 0;
-    assert(nanoSeconds > lastTimeHack);
-    lastTimeHack = nanoSeconds;
-
-    return nanoSeconds;
-}
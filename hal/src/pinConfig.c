@@ -0,0 +1,174 @@
+// pinConfig.c
+// Background pin-mode configuration through the pinmux state attributes (see pinConfig.h)
+
+#define _GNU_SOURCE     // pthread_timedjoin_np
+#include "hal/pinConfig.h"
+#include "hal/sysfs.h"
+#include "hal/metrics.h"
+#include "hal/timing.h"
+#include <assert.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PINMUX_STATE_PATH "/sys/devices/platform/ocp/ocp:%s_pinmux/state"
+#define NS_PER_US 1000
+#define NS_PER_MS 1000000
+#define NS_PER_SECOND 1000000000LL
+// How often a waiter rechecks its own isRunning flag
+#define WAIT_POLL_MS 50
+// Cleanup leaves the thread behind if a pin write is stuck for longer
+#define JOIN_TIMEOUT_MS 1000
+
+typedef struct {
+    char pin[PIN_CONFIG_MAX_NAME_LEN];
+    char mode[PIN_CONFIG_MAX_NAME_LEN];
+} pinRequest_t;
+
+static bool is_initialized = false;
+static atomic_bool isRunning = true;
+static pthread_t thread;
+static pthread_mutex_t mutexPins = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condRequested = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t condDone;
+static pinRequest_t requests[PIN_CONFIG_MAX_PINS];
+static int numRequested = 0;
+static int numDone = 0;
+
+static Metrics_counter_t pinsWritten;
+static Metrics_counter_t pinsSkipped;
+static Histogram_t pinCostHistogram;
+
+static void* configurePins();
+static void configurePin(const pinRequest_t* request);
+
+void PinConfig_init(void)
+{
+    assert(!is_initialized);
+    is_initialized = true;
+    atomic_store(&isRunning, true);
+    numRequested = 0;
+    numDone = 0;
+    // Timed waits on condDone are against getTimeInNs()
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&condDone, &attr);
+    pthread_condattr_destroy(&attr);
+    Metrics_registerCounter(&pinsWritten, "light_sampler_pins_written_total", "Pin modes set by writing the pinmux state.");
+    Metrics_registerCounter(&pinsSkipped, "light_sampler_pins_skipped_total", "Pins already in the requested mode.");
+    Metrics_registerHistogram(&pinCostHistogram, "light_sampler_pin_config_us", "Time to check and set one pin's mode.");
+    pthread_create(&thread, NULL, configurePins, NULL);
+}
+
+void PinConfig_cleanup(void)
+{
+    assert(is_initialized);
+    is_initialized = false;
+    pthread_mutex_lock(&mutexPins);
+    atomic_store(&isRunning, false);
+    pthread_cond_signal(&condRequested);
+    pthread_mutex_unlock(&mutexPins);
+    // The thread may be blocked in a pinmux write that never returns
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    long long deadlineNs = deadline.tv_nsec + JOIN_TIMEOUT_MS * NS_PER_MS;
+    deadline.tv_sec += deadlineNs / NS_PER_SECOND;
+    deadline.tv_nsec = deadlineNs % NS_PER_SECOND;
+    if (pthread_timedjoin_np(thread, NULL, &deadline) != 0){
+        printf("WARNING: pin configuration still busy after %dms; not waiting for it\n", JOIN_TIMEOUT_MS);
+        pthread_detach(thread);
+    } else {
+        pthread_cond_destroy(&condDone);
+    }
+    Metrics_unregister(&pinsWritten);
+    Metrics_unregister(&pinsSkipped);
+    Metrics_unregister(&pinCostHistogram);
+}
+
+void PinConfig_request(const char* pin, const char* mode)
+{
+    assert(is_initialized);
+    pthread_mutex_lock(&mutexPins);
+    if (numRequested >= PIN_CONFIG_MAX_PINS){
+        printf("ERROR: more than %d pins requested.\n", PIN_CONFIG_MAX_PINS);
+        exit(-1);
+    }
+    pinRequest_t* request = &requests[numRequested];
+    // The pinmux helpers are named after the upper-case pin (P9_21)
+    int i = 0;
+    for (; pin[i] && i < PIN_CONFIG_MAX_NAME_LEN - 1; i++){
+        request->pin[i] = toupper((unsigned char)pin[i]);
+    }
+    request->pin[i] = 0;
+    snprintf(request->mode, sizeof(request->mode), "%s", mode);
+    numRequested++;
+    pthread_cond_signal(&condRequested);
+    pthread_mutex_unlock(&mutexPins);
+}
+
+bool PinConfig_waitForPins(atomic_bool* callerRunning)
+{
+    pthread_mutex_lock(&mutexPins);
+    int target = numRequested;
+    while (numDone < target && atomic_load(&isRunning) && atomic_load(callerRunning)){
+        long long deadlineNs = getTimeInNs() + WAIT_POLL_MS * NS_PER_MS;
+        struct timespec deadline = {deadlineNs / NS_PER_SECOND, deadlineNs % NS_PER_SECOND};
+        pthread_cond_timedwait(&condDone, &mutexPins, &deadline);
+    }
+    bool isDone = numDone >= target;
+    pthread_mutex_unlock(&mutexPins);
+    return isDone;
+}
+
+long long PinConfig_getNumWritten(void)
+{
+    return Metrics_counterGet(&pinsWritten);
+}
+
+long long PinConfig_getNumSkipped(void)
+{
+    return Metrics_counterGet(&pinsSkipped);
+}
+
+// Thread function: applies requests in order as they are queued
+static void* configurePins()
+{
+    pthread_mutex_lock(&mutexPins);
+    while (atomic_load(&isRunning)){
+        if (numDone == numRequested){
+            pthread_cond_wait(&condRequested, &mutexPins);
+            continue;
+        }
+        pinRequest_t request = requests[numDone];
+        pthread_mutex_unlock(&mutexPins);
+        configurePin(&request);
+        pthread_mutex_lock(&mutexPins);
+        numDone++;
+        pthread_cond_broadcast(&condDone);
+    }
+    // Release any waiters; nothing more will be configured
+    pthread_cond_broadcast(&condDone);
+    pthread_mutex_unlock(&mutexPins);
+    pthread_exit(NULL);
+}
+
+// Read the pin's current mode and write the new one only if it differs
+static void configurePin(const pinRequest_t* request)
+{
+    long long startNs = getTimeInNs();
+    char path[SYSFS_MAX_PATH_LEN];
+    char state[PIN_CONFIG_MAX_NAME_LEN];
+    snprintf(path, sizeof(path), PINMUX_STATE_PATH, request->pin);
+    Sysfs_readString(path, state, sizeof(state));
+    if (strcmp(state, request->mode) == 0){
+        Metrics_counterAdd(&pinsSkipped, 1);
+    } else {
+        Sysfs_writeString(path, request->mode);
+        Metrics_counterAdd(&pinsWritten, 1);
+    }
+    Histogram_record(&pinCostHistogram, (getTimeInNs() - startNs) / NS_PER_US);
+}
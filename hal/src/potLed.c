@@ -1,6 +1,10 @@
 #include "hal/potLed.h"
 #include "hal/timing.h"
+#include "hal/sysfs.h"
+#include "hal/metrics.h"
+#include "hal/pinConfig.h"
 #include <assert.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -12,8 +16,19 @@
 #define A2D_VOLTAGE_REF_V 1.8
 #define A2D_MAX_READING 4095
 #define NANOSECONDS_IN_A_SECOND 1000000000
+#define NS_PER_MS 1000000
+#define NS_PER_US 1000
 #define INPUT_MAX_LEN 10
 
+// POT input stage: readings within POT_DEADBAND counts of the accepted one are
+// noise, and the frequency only changes once the reading is POT_HYSTERESIS
+// counts past the edge of the current frequency's step.
+#define POT_POLL_MS 20
+#define POT_DEADBAND 6
+#define POT_HYSTERESIS 8
+// Frequency changes arriving faster than this are coalesced into one PWM update
+#define PWM_MIN_UPDATE_MS 100
+
 #define LED_PERIOD_FILE "/dev/bone/pwm/0/b/period"
 #define LED_DUTY_CYCLE_FILE "/dev/bone/pwm/0/b/duty_cycle"
 #define LED_ENABLE_FILE "/dev/bone/pwm/0/b/enable"
@@ -21,23 +36,39 @@
 static pthread_t thread;
 
 static bool is_initialized = false;
-static int potReading = 0;
-static int currentFreq = 0;
-static bool isRunning = true;
+// Written by the PWM thread, read by others through the getters
+static Metrics_gauge_t potReadingGauge;
+static Metrics_gauge_t frequencyGauge;
+static Metrics_counter_t potPolls;
+static Metrics_counter_t pwmWrites;
+static Histogram_t pwmWriteHistogram;
+static atomic_bool isRunning = true;
+
+// PWM state as last written; periodNs 0 means unknown (not yet written by us)
+static int periodNs = 0;
 static bool ledOn = false;
 
 static int getVoltage0Reading();
 static void* updatePWM();
-static void writeValueToFile(const char* filePath, int value);
-static void runCommand(char* command);
+static int quantizeFrequency(int reading, int currentFreq);
+static void applyFrequency(int frequency);
+static void writePwm(const char* path, int value);
 
 // intialize/destroy thread(s) for this module
-// Also sets config pins
+// Also queues the LED's pin for PWM (see pinConfig.h)
 void PotLed_init(void)
 {
     assert(!is_initialized);
     is_initialized = true;
-    runCommand("config-pin p9_21 pwm");
+    atomic_store(&isRunning, true);
+    periodNs = 0;
+    ledOn = false;
+    Metrics_registerGauge(&potReadingGauge, "light_sampler_pot_reading", "Raw A2D count of the potentiometer.");
+    Metrics_registerGauge(&frequencyGauge, "light_sampler_led_frequency_hz", "Current LED flash frequency.");
+    Metrics_registerCounter(&potPolls, "light_sampler_pot_polls_total", "Potentiometer readings taken.");
+    Metrics_registerCounter(&pwmWrites, "light_sampler_pwm_writes_total", "Writes to the LED's PWM sysfs attributes.");
+    Metrics_registerHistogram(&pwmWriteHistogram, "light_sampler_pwm_write_us", "Time taken by one PWM sysfs write.");
+    PinConfig_request("p9_21", "pwm");
     pthread_create(&thread, NULL, updatePWM, NULL);
 }
 
@@ -46,113 +77,124 @@ void PotLed_cleanup(void)
 {
     assert(is_initialized);
     is_initialized = false;
-    isRunning = false;
-    writeValueToFile(LED_ENABLE_FILE, 0);
+    atomic_store(&isRunning, false);
+    // Join first so the thread cannot re-enable the LED after it is turned off
     pthread_join(thread, NULL);
+    Sysfs_writeInt(LED_ENABLE_FILE, 0);
+    Metrics_unregister(&potReadingGauge);
+    Metrics_unregister(&frequencyGauge);
+    Metrics_unregister(&potPolls);
+    Metrics_unregister(&pwmWrites);
+    Metrics_unregister(&pwmWriteHistogram);
 }
 
 // returns potentiometer reading
 int PotLed_getPOTReading(void)
 {
     assert(is_initialized);
-    return potReading;
+    return (int)Metrics_gaugeGet(&potReadingGauge);
 }
 
 // returns LED frequency
 int PotLed_getFrequency(void)
 {
     assert(is_initialized);
-    return currentFreq;
+    return (int)Metrics_gaugeGet(&frequencyGauge);
 }
 
 // Main thread function
-// Continuosly samples the a2d reading of potentiometer and adjusts frequency of led accordingly
+// Polls the potentiometer, filters out jitter, and updates the LED's PWM only
+// when the resulting frequency changes (at most once per PWM_MIN_UPDATE_MS)
 static void* updatePWM()
 {
-    long long startTime = getTimeInMs() + 100; //start to initially set the frequency
-    while (isRunning) {
-        long long currentTime = getTimeInMs();
-        if (currentTime - startTime >= 100){
-                int a2dReading = getVoltage0Reading();
-                if (a2dReading != potReading){
-                potReading = a2dReading;
-                currentFreq = potReading / FREQUENCY_DIV_FACTOR;
-                int period = NANOSECONDS_IN_A_SECOND / currentFreq;
-                int dutyCycle = period / 2;
-                if (currentFreq == 0){
-                    writeValueToFile(LED_ENABLE_FILE, 0);
-                    ledOn = false;
-                } else {
-                    writeValueToFile(LED_PERIOD_FILE, period);
-                    writeValueToFile(LED_DUTY_CYCLE_FILE, dutyCycle);
-                    if (!ledOn){
-                        writeValueToFile(LED_ENABLE_FILE, 1);
-                        ledOn = true;
-                    }
-                }
-            }
-            startTime = currentTime;
+    int acceptedReading = -1;
+    int wantedFreq = 0;
+    int appliedFreq = -1;
+    long long lastUpdateNs = 0;
+    if (!PinConfig_waitForPins(&isRunning)){
+        pthread_exit(NULL);
+    }
+    long long nextPollNs = getTimeInNs();
+    while (atomic_load(&isRunning)) {
+        long long nowNs = getTimeInNs();
+        int reading = getVoltage0Reading();
+        Metrics_counterAdd(&potPolls, 1);
+        Metrics_gaugeSet(&potReadingGauge, reading);
+        if (acceptedReading < 0){
+            acceptedReading = reading;
+            wantedFreq = reading / FREQUENCY_DIV_FACTOR;
+        } else if (abs(reading - acceptedReading) > POT_DEADBAND){
+            acceptedReading = reading;
+            wantedFreq = quantizeFrequency(acceptedReading, wantedFreq);
+        }
+        if (wantedFreq != appliedFreq && nowNs - lastUpdateNs >= (long long)PWM_MIN_UPDATE_MS * NS_PER_MS){
+            applyFrequency(wantedFreq);
+            Metrics_gaugeSet(&frequencyGauge, wantedFreq);
+            appliedFreq = wantedFreq;
+            lastUpdateNs = nowNs;
         }
+        nextPollNs += (long long)POT_POLL_MS * NS_PER_MS;
+        sleepUntilNs(nextPollNs);
     }
     pthread_exit(NULL);
 }
 
-// From A2D guide
-static int getVoltage0Reading()
+// Frequency for a POT reading, holding `currentFreq` until the reading is
+// POT_HYSTERESIS counts outside that frequency's step
+static int quantizeFrequency(int reading, int currentFreq)
 {
-    // Open file
-    FILE *f = fopen(A2D_FILE_VOLTAGE0, "r");
-    if (!f) {
-        printf("ERROR: Unable to open voltage input file. Cape loaded?\n");
-        printf(" Check /boot/uEnv.txt for correct options.\n");
-        exit(-1);
-    }
-    // Get reading
-    int a2dReading = 0;
-    int itemsRead = fscanf(f, "%d", &a2dReading);
-    if (itemsRead <= 0) {
-    printf("ERROR: Unable to read values from voltage input file.\n");
-        exit(-1);
+    int low = currentFreq * FREQUENCY_DIV_FACTOR - POT_HYSTERESIS;
+    int high = (currentFreq + 1) * FREQUENCY_DIV_FACTOR + POT_HYSTERESIS;
+    if (reading >= low && reading < high){
+        return currentFreq;
     }
-    // Close file
-    fclose(f);
-    return a2dReading;
+    return reading / FREQUENCY_DIV_FACTOR;
 }
 
-// Write integer value to pwm files for blinking LED
-static void writeValueToFile(const char* filePath, int value)
+// Reprogram the PWM for `frequency` (0 turns the LED off).
+// The kernel rejects a duty cycle longer than the period, so when the period
+// shrinks the duty cycle is written first, and when it grows the period is.
+static void applyFrequency(int frequency)
 {
-    FILE *f = fopen(filePath, "w");
-    if (!f) {
-        printf("ERROR: Unable to open file.\n");
-        exit(-1);
+    if (frequency == 0){
+        if (ledOn){
+            writePwm(LED_ENABLE_FILE, 0);
+            ledOn = false;
+        }
+        return;
+    }
+    int newPeriodNs = NANOSECONDS_IN_A_SECOND / frequency;
+    int dutyCycleNs = newPeriodNs / 2;
+    if (periodNs == 0){
+        // Unknown starting state: clear the duty cycle so either order is valid
+        writePwm(LED_DUTY_CYCLE_FILE, 0);
+        writePwm(LED_PERIOD_FILE, newPeriodNs);
+        writePwm(LED_DUTY_CYCLE_FILE, dutyCycleNs);
+    } else if (newPeriodNs < periodNs){
+        writePwm(LED_DUTY_CYCLE_FILE, dutyCycleNs);
+        writePwm(LED_PERIOD_FILE, newPeriodNs);
+    } else if (newPeriodNs > periodNs){
+        writePwm(LED_PERIOD_FILE, newPeriodNs);
+        writePwm(LED_DUTY_CYCLE_FILE, dutyCycleNs);
     }
-    int charWritten = fprintf(f, "%d", value);
-    if (charWritten <= 0) {
-        printf("ERROR WRITING DATA");
-        exit(1);
+    periodNs = newPeriodNs;
+    if (!ledOn){
+        writePwm(LED_ENABLE_FILE, 1);
+        ledOn = true;
     }
-    fclose(f);
 }
 
-// From Assignment 1
-static void runCommand(char* command)
+// One timed and counted PWM attribute write
+static void writePwm(const char* path, int value)
 {
-    // Execute the shell command (output into pipe)
-    FILE *pipe = popen(command, "r");
-    // Ignore output of the command; but consume it
-    // so we don't get an error when closing the pipe.
-    char buffer[1024];
-    while (!feof(pipe) && !ferror(pipe)) {
-        if (fgets(buffer, sizeof(buffer), pipe) == NULL)
-            break;
-        // printf("--> %s", buffer); // Uncomment for debugging
-    }
-    // Get the exit code from the pipe; non-zero is an error:
-    int exitCode = WEXITSTATUS(pclose(pipe));
-    if (exitCode != 0) {
-        perror("Unable to execute command:");
-        printf(" command: %s\n", command);
-        printf(" exit code: %d\n", exitCode);
-    }
-}
\ No newline at end of file
+    long long startNs = getTimeInNs();
+    Sysfs_writeInt(path, value);
+    Histogram_record(&pwmWriteHistogram, (getTimeInNs() - startNs) / NS_PER_US);
+    Metrics_counterAdd(&pwmWrites, 1);
+}
+
+// Raw A2D count of the potentiometer
+static int getVoltage0Reading()
+{
+    return Sysfs_readInt(A2D_FILE_VOLTAGE0);
+}
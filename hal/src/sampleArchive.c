@@ -0,0 +1,52 @@
+// sampleArchive.c
+// Ring of recent samples for bulk export (see sampleArchive.h)
+
+#include "hal/sampleArchive.h"
+#include <string.h>
+
+#define INDEX_MASK (SAMPLE_ARCHIVE_CAPACITY - 1)
+
+void SampleArchive_init(SampleArchive_t* archive)
+{
+    memset(archive->samples, 0, sizeof(archive->samples));
+    atomic_init(&archive->written, 0);
+}
+
+void SampleArchive_append(SampleArchive_t* archive, double volts)
+{
+    long long written = atomic_load_explicit(&archive->written, memory_order_relaxed);
+    archive->samples[written & INDEX_MASK] = (float)volts;
+    atomic_store_explicit(&archive->written, written + 1, memory_order_release);
+}
+
+long long SampleArchive_getWritten(const SampleArchive_t* archive)
+{
+    return atomic_load_explicit(&archive->written, memory_order_acquire);
+}
+
+long long SampleArchive_getOldest(const SampleArchive_t* archive)
+{
+    long long oldest = SampleArchive_getWritten(archive) - SAMPLE_ARCHIVE_CAPACITY + SAMPLE_ARCHIVE_GUARD_SAMPLES;
+    return oldest > 0 ? oldest : 0;
+}
+
+int SampleArchive_getSpans(const SampleArchive_t* archive, long long first, long long count, struct iovec spans[2])
+{
+    int start = first & INDEX_MASK;
+    long long firstCount = SAMPLE_ARCHIVE_CAPACITY - start < count ? SAMPLE_ARCHIVE_CAPACITY - start : count;
+    spans[0].iov_base = (void*)&archive->samples[start];
+    spans[0].iov_len = firstCount * sizeof(float);
+    if (firstCount == count){
+        return 1;
+    }
+    spans[1].iov_base = (void*)&archive->samples[0];
+    spans[1].iov_len = (count - firstCount) * sizeof(float);
+    return 2;
+}
+
+bool SampleArchive_isIntact(const SampleArchive_t* archive, long long first)
+{
+    // Sample `first` is overwritten while sample first + capacity is appended,
+    // before the count moves past it
+    return SampleArchive_getWritten(archive) < first + SAMPLE_ARCHIVE_CAPACITY;
+}
@@ -0,0 +1,240 @@
+// sampleShm.c
+// Shared-memory export of the sample ring (see sampleShm.h)
+//
+// Versions follow blockQueue.c: slot version 2*seq+1 while block `seq` is
+// being written and 2*seq+2 once it is complete. The summary version is odd
+// while the summary is being rewritten. As there, slots and the summary are
+// copied field by field with relaxed atomics (relaxedCopy.h).
+
+#include "hal/sampleShm.h"
+#include "hal/relaxedCopy.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SUMMARY_READ_ATTEMPTS 100
+
+static bool hasLiveWriter(const char* name);
+static void copySummaryRelaxed(SampleShm_summary_t* to, const SampleShm_summary_t* from);
+
+bool SampleShm_create(SampleShm_writer_t* writer, const char* name)
+{
+    snprintf(writer->name, sizeof(writer->name), "%s", name);
+    writer->segment = NULL;
+    int fd = shm_open(writer->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST){
+        // Another sampler may be exporting under this name; never take a live segment away
+        if (hasLiveWriter(writer->name)){
+            errno = EEXIST;
+            return false;
+        }
+        // Left behind by a crashed run: replace it, so new readers can't attach to it
+        shm_unlink(writer->name);
+        fd = shm_open(writer->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (fd < 0){
+        return false;
+    }
+    if (ftruncate(fd, sizeof(SampleShm_segment_t)) != 0){
+        int error = errno;
+        close(fd);
+        shm_unlink(writer->name);
+        errno = error;
+        return false;
+    }
+    void* mapping = mmap(NULL, sizeof(SampleShm_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED){
+        int error = errno;
+        shm_unlink(writer->name);
+        errno = error;
+        return false;
+    }
+    // ftruncate zero-fills, so every version and sequence starts at 0
+    SampleShm_segment_t* segment = mapping;
+    segment->version = SAMPLE_SHM_VERSION;
+    segment->segmentSize = sizeof(SampleShm_segment_t);
+    segment->capacity = SAMPLE_SHM_CAPACITY;
+    segment->blockSamples = SAMPLE_BLOCK_SAMPLES;
+    segment->writerPid = getpid();
+    atomic_store_explicit(&segment->closed, 0, memory_order_relaxed);
+    // The magic goes in last: a reader that sees it sees a complete header
+    atomic_thread_fence(memory_order_release);
+    memcpy(segment->magic, SAMPLE_SHM_MAGIC, sizeof(segment->magic));
+    writer->segment = segment;
+    return true;
+}
+
+void SampleShm_destroy(SampleShm_writer_t* writer)
+{
+    if (!writer->segment){
+        return;
+    }
+    atomic_store_explicit(&writer->segment->closed, 1, memory_order_release);
+    munmap(writer->segment, sizeof(SampleShm_segment_t));
+    shm_unlink(writer->name);
+    writer->segment = NULL;
+}
+
+void SampleShm_publishBlock(SampleShm_writer_t* writer, const SampleBlock_t* block)
+{
+    SampleShm_segment_t* segment = writer->segment;
+    long long sequence = atomic_load_explicit(&segment->nextSequence, memory_order_relaxed);
+    int index = sequence % SAMPLE_SHM_CAPACITY;
+
+    atomic_store_explicit(&segment->versions[index], 2 * sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    SampleBlock_t numbered = *block;
+    numbered.sequence = sequence;
+    BlockQueue_copyBlockRelaxed(&segment->slots[index], &numbered);
+    atomic_store_explicit(&segment->versions[index], 2 * sequence + 2, memory_order_release);
+    atomic_store_explicit(&segment->nextSequence, sequence + 1, memory_order_release);
+}
+
+void SampleShm_publishSummary(SampleShm_writer_t* writer, const SampleShm_summary_t* summary)
+{
+    SampleShm_segment_t* segment = writer->segment;
+    long long version = atomic_load_explicit(&segment->summaryVersion, memory_order_relaxed);
+    atomic_store_explicit(&segment->summaryVersion, version + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    copySummaryRelaxed(&segment->summary, summary);
+    atomic_store_explicit(&segment->summaryVersion, version + 2, memory_order_release);
+}
+
+bool SampleShm_openReader(SampleShm_reader_t* reader, const char* name)
+{
+    reader->segment = NULL;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0){
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size != (off_t)sizeof(SampleShm_segment_t)){
+        close(fd);
+        return false;
+    }
+    void* mapping = mmap(NULL, sizeof(SampleShm_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED){
+        return false;
+    }
+    const SampleShm_segment_t* segment = mapping;
+    bool valid = memcmp(segment->magic, SAMPLE_SHM_MAGIC, sizeof(segment->magic)) == 0;
+    atomic_thread_fence(memory_order_acquire);
+    if (!valid || segment->version != SAMPLE_SHM_VERSION || segment->segmentSize != sizeof(SampleShm_segment_t)
+            || segment->capacity != SAMPLE_SHM_CAPACITY || segment->blockSamples != SAMPLE_BLOCK_SAMPLES){
+        munmap(mapping, sizeof(SampleShm_segment_t));
+        return false;
+    }
+    reader->segment = segment;
+    return true;
+}
+
+void SampleShm_closeReader(SampleShm_reader_t* reader)
+{
+    if (reader->segment){
+        munmap((void*)reader->segment, sizeof(SampleShm_segment_t));
+        reader->segment = NULL;
+    }
+}
+
+long long SampleShm_nextSequence(const SampleShm_reader_t* reader)
+{
+    return atomic_load_explicit(&reader->segment->nextSequence, memory_order_acquire);
+}
+
+SampleShm_result_t SampleShm_read(const SampleShm_reader_t* reader, long long* cursor, SampleBlock_t* block)
+{
+    const SampleShm_segment_t* segment = reader->segment;
+    while (true){
+        long long next = atomic_load_explicit(&segment->nextSequence, memory_order_acquire);
+        if (*cursor >= next){
+            return SAMPLE_SHM_EMPTY;
+        }
+        if (next - *cursor > SAMPLE_SHM_CAPACITY){
+            // Fell behind: resume at the oldest block still in the ring
+            *cursor = next - SAMPLE_SHM_CAPACITY;
+        }
+        int index = *cursor % SAMPLE_SHM_CAPACITY;
+        long long expected = 2 * *cursor + 2;
+        long long before = atomic_load_explicit(&segment->versions[index], memory_order_acquire);
+        if (before == expected){
+            BlockQueue_copyBlockRelaxed(block, &segment->slots[index]);
+            atomic_thread_fence(memory_order_acquire);
+            long long after = atomic_load_explicit(&segment->versions[index], memory_order_relaxed);
+            if (after == expected){
+                (*cursor)++;
+                return SAMPLE_SHM_OK;
+            }
+        }
+        // The slot was overwritten while we looked; retry from the new oldest block
+        (*cursor)++;
+    }
+}
+
+bool SampleShm_readSummary(const SampleShm_reader_t* reader, SampleShm_summary_t* summary)
+{
+    const SampleShm_segment_t* segment = reader->segment;
+    for (int attempt = 0; attempt < SUMMARY_READ_ATTEMPTS; attempt++){
+        long long before = atomic_load_explicit(&segment->summaryVersion, memory_order_acquire);
+        if (before % 2 != 0){
+            continue;
+        }
+        copySummaryRelaxed(summary, &segment->summary);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&segment->summaryVersion, memory_order_relaxed) == before){
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SampleShm_isClosed(const SampleShm_reader_t* reader)
+{
+    return atomic_load_explicit(&reader->segment->closed, memory_order_acquire) != 0;
+}
+
+// True if `name` is a segment of this layout whose writer process is still
+// running and has not closed it. Segments this build cannot read count as stale.
+static bool hasLiveWriter(const char* name)
+{
+    SampleShm_reader_t reader;
+    if (!SampleShm_openReader(&reader, name)){
+        return false;
+    }
+    pid_t pid = reader.segment->writerPid;
+    bool live = !SampleShm_isClosed(&reader) && pid > 0 && pid != getpid()
+            && (kill(pid, 0) == 0 || errno == EPERM);
+    SampleShm_closeReader(&reader);
+    return live;
+}
+
+static void copySummaryRelaxed(SampleShm_summary_t* to, const SampleShm_summary_t* from)
+{
+    COPY_RELAXED(to, from, updatedNs);
+    COPY_RELAXED(to, from, updatedWallNs);
+    COPY_RELAXED(to, from, samplesTaken);
+    COPY_RELAXED(to, from, dipsTotal);
+    COPY_RELAXED(to, from, averageVolts);
+    COPY_RELAXED(to, from, historySize);
+    COPY_RELAXED(to, from, historyDips);
+    COPY_RELAXED(to, from, historyNewestNs);
+    COPY_RELAXED(to, from, numWindows);
+    for (int i = 0; i < SAMPLE_SHM_MAX_WINDOWS; i++){
+        COPY_RELAXED(to, from, windows[i].lengthMs);
+        COPY_RELAXED(to, from, windows[i].hopMs);
+        COPY_RELAXED(to, from, windows[i].startTimeMs);
+        COPY_RELAXED(to, from, windows[i].endTimeMs);
+        COPY_RELAXED(to, from, windows[i].windowNumber);
+        COPY_RELAXED(to, from, windows[i].count);
+        COPY_RELAXED(to, from, windows[i].sum);
+        COPY_RELAXED(to, from, windows[i].min);
+        COPY_RELAXED(to, from, windows[i].max);
+        COPY_RELAXED(to, from, windows[i].dips);
+    }
+}
@@ -0,0 +1,202 @@
+// sampleTrace.c
+// Binary A2D trace recording and playback (see sampleTrace.h)
+
+#include "hal/sampleTrace.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAGIC "LSTRACE1"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_VERSION 1
+#define TRACE_A2D_MAX_READING 4095
+#define TRACE_HEADER_LEN 24
+#define MAX_RECORD_LEN 12 // 10-byte varint + u16
+// A 64-bit delta needs at most 10 varint bytes; a longer one is corrupt
+#define MAX_VARINT_SHIFT 63
+#define NS_PER_US 1000
+
+#define RECORD_ENV "LIGHT_SAMPLER_TRACE_RECORD"
+#define REPLAY_ENV "LIGHT_SAMPLER_TRACE_REPLAY"
+#define SPEED_ENV "LIGHT_SAMPLER_TRACE_SPEED"
+
+static void putLittleEndian(unsigned char* dest, uint64_t value, int numBytes);
+static uint64_t getLittleEndian(const unsigned char* src, int numBytes);
+static void flushWriter(SampleTrace_writer_t* writer);
+static bool refillReader(SampleTrace_reader_t* reader);
+
+void SampleTrace_configFromEnvironment(SampleTrace_config_t* config)
+{
+    config->mode = SAMPLE_TRACE_OFF;
+    config->path[0] = 0;
+    config->speed = 1;
+    const char* replayPath = getenv(REPLAY_ENV);
+    const char* recordPath = getenv(RECORD_ENV);
+    if (replayPath && replayPath[0]){
+        config->mode = SAMPLE_TRACE_REPLAY;
+        snprintf(config->path, sizeof(config->path), "%s", replayPath);
+    } else if (recordPath && recordPath[0]){
+        config->mode = SAMPLE_TRACE_RECORD;
+        snprintf(config->path, sizeof(config->path), "%s", recordPath);
+    }
+    const char* speed = getenv(SPEED_ENV);
+    if (speed && strcmp(speed, "max") == 0){
+        config->speed = 0;
+    } else if (speed && atof(speed) > 0){
+        config->speed = atof(speed);
+    }
+}
+
+bool SampleTrace_openWriter(SampleTrace_writer_t* writer, const char* path, long long startNs)
+{
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL){
+        return false;
+    }
+    writer->lastNs = startNs;
+    writer->numRecords = 0;
+    atomic_init(&writer->flushedBytes, 0);
+    memcpy(writer->buffer, TRACE_MAGIC, TRACE_MAGIC_LEN);
+    putLittleEndian(writer->buffer + 8, TRACE_VERSION, 4);
+    putLittleEndian(writer->buffer + 12, TRACE_A2D_MAX_READING, 4);
+    putLittleEndian(writer->buffer + 16, (uint64_t)startNs, 8);
+    writer->used = TRACE_HEADER_LEN;
+    return true;
+}
+
+void SampleTrace_write(SampleTrace_writer_t* writer, long long timeNs, int a2dReading)
+{
+    if (writer->used + MAX_RECORD_LEN > SAMPLE_TRACE_BUFFER_LEN){
+        flushWriter(writer);
+    }
+    // Deltas between truncated absolute times, so rounding never accumulates
+    uint64_t deltaUs = 0;
+    if (writer->numRecords > 0 && timeNs > writer->lastNs){
+        deltaUs = (uint64_t)(timeNs / NS_PER_US - writer->lastNs / NS_PER_US);
+    }
+    unsigned char* dest = writer->buffer + writer->used;
+    int length = 0;
+    while (deltaUs >= 0x80){
+        dest[length++] = (unsigned char)(deltaUs | 0x80);
+        deltaUs >>= 7;
+    }
+    dest[length++] = (unsigned char)deltaUs;
+    putLittleEndian(dest + length, (uint16_t)a2dReading, 2);
+    writer->used += length + 2;
+    writer->lastNs = timeNs;
+    writer->numRecords++;
+}
+
+long long SampleTrace_getFlushedBytes(SampleTrace_writer_t* writer)
+{
+    return atomic_load_explicit(&writer->flushedBytes, memory_order_acquire);
+}
+
+void SampleTrace_closeWriter(SampleTrace_writer_t* writer)
+{
+    flushWriter(writer);
+    fclose(writer->file);
+    writer->file = NULL;
+}
+
+bool SampleTrace_openReader(SampleTrace_reader_t* reader, const char* path)
+{
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL){
+        return false;
+    }
+    unsigned char header[TRACE_HEADER_LEN];
+    if (fread(header, 1, TRACE_HEADER_LEN, reader->file) != TRACE_HEADER_LEN
+            || memcmp(header, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0
+            || getLittleEndian(header + 8, 4) != TRACE_VERSION){
+        fclose(reader->file);
+        reader->file = NULL;
+        return false;
+    }
+    reader->timeUs = 0;
+    reader->numRecords = 0;
+    reader->isMalformed = false;
+    reader->used = 0;
+    reader->length = 0;
+    return true;
+}
+
+bool SampleTrace_read(SampleTrace_reader_t* reader, long long* timeUs, int* a2dReading)
+{
+    if (reader->length - reader->used < MAX_RECORD_LEN && !refillReader(reader)){
+        return false;
+    }
+    const unsigned char* src = reader->buffer + reader->used;
+    int available = reader->length - reader->used;
+    uint64_t deltaUs = 0;
+    int length = 0;
+    int shift = 0;
+    while (length < available && (src[length] & 0x80)){
+        if (shift >= MAX_VARINT_SHIFT){
+            reader->isMalformed = true;
+            return false;
+        }
+        deltaUs |= (uint64_t)(src[length] & 0x7f) << shift;
+        shift += 7;
+        length++;
+    }
+    if (shift >= MAX_VARINT_SHIFT){
+        reader->isMalformed = true;
+        return false;
+    }
+    if (length + 3 > available){
+        // Truncated final record (e.g. recording interrupted)
+        return false;
+    }
+    deltaUs |= (uint64_t)src[length] << shift;
+    length++;
+    *a2dReading = (int)getLittleEndian(src + length, 2);
+    reader->used += length + 2;
+    reader->timeUs += (long long)deltaUs;
+    reader->numRecords++;
+    *timeUs = reader->timeUs;
+    return true;
+}
+
+void SampleTrace_closeReader(SampleTrace_reader_t* reader)
+{
+    fclose(reader->file);
+    reader->file = NULL;
+}
+
+static void flushWriter(SampleTrace_writer_t* writer)
+{
+    if (writer->used > 0 && fwrite(writer->buffer, 1, writer->used, writer->file) != (size_t)writer->used){
+        perror("Unable to write sample trace");
+    }
+    // Past stdio's buffer too, so exporters reading the file see whole records
+    fflush(writer->file);
+    atomic_fetch_add_explicit(&writer->flushedBytes, writer->used, memory_order_release);
+    writer->used = 0;
+}
+
+// Move the unread tail to the front and top the buffer up; false if nothing is left
+static bool refillReader(SampleTrace_reader_t* reader)
+{
+    int remaining = reader->length - reader->used;
+    memmove(reader->buffer, reader->buffer + reader->used, remaining);
+    reader->used = 0;
+    reader->length = remaining + fread(reader->buffer + remaining, 1, SAMPLE_TRACE_BUFFER_LEN - remaining, reader->file);
+    return reader->length > 0;
+}
+
+static void putLittleEndian(unsigned char* dest, uint64_t value, int numBytes)
+{
+    for (int i = 0; i < numBytes; i++){
+        dest[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint64_t getLittleEndian(const unsigned char* src, int numBytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < numBytes; i++){
+        value |= (uint64_t)src[i] << (8 * i);
+    }
+    return value;
+}
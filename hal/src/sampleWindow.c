@@ -0,0 +1,108 @@
+// sampleWindow.c
+// Pane-based tumbling/sliding window statistics (see sampleWindow.h)
+
+#include "hal/sampleWindow.h"
+#include <assert.h>
+#include <string.h>
+
+static void resetPane(SampleWindow_pane_t* pane);
+static void closePane(SampleWindow_t* window);
+
+bool SampleWindow_init(SampleWindow_t* window, int lengthMs, int hopMs, long long startTimeMs)
+{
+    assert(window);
+    if (hopMs <= 0 || lengthMs < hopMs || lengthMs % hopMs != 0 || lengthMs / hopMs > SAMPLE_WINDOW_MAX_PANES){
+        return false;
+    }
+    memset(window, 0, sizeof(*window));
+    window->lengthMs = lengthMs;
+    window->hopMs = hopMs;
+    window->numPanes = lengthMs / hopMs;
+    window->openPaneStartMs = startTimeMs;
+    resetPane(&window->openPane);
+    window->latest.lengthMs = lengthMs;
+    window->latest.hopMs = hopMs;
+    window->latest.startTimeMs = startTimeMs;
+    window->latest.endTimeMs = startTimeMs;
+    return true;
+}
+
+bool SampleWindow_addSample(SampleWindow_t* window, double value, bool isDip, long long timeMs)
+{
+    bool completed = false;
+    int panesClosed = 0;
+    while (timeMs >= window->openPaneStartMs + window->hopMs){
+        if (panesClosed > window->numPanes){
+            // Long gap in the samples: every pane is already empty, so jump
+            // straight to the pane containing this sample.
+            long long hops = (timeMs - window->openPaneStartMs) / window->hopMs;
+            window->openPaneStartMs += hops * window->hopMs;
+            break;
+        }
+        closePane(window);
+        panesClosed++;
+        completed = true;
+    }
+
+    SampleWindow_pane_t* pane = &window->openPane;
+    if (pane->count == 0 || value < pane->min){
+        pane->min = value;
+    }
+    if (pane->count == 0 || value > pane->max){
+        pane->max = value;
+    }
+    pane->count++;
+    pane->sum += value;
+    if (isDip){
+        pane->dips++;
+    }
+    return completed;
+}
+
+void SampleWindow_getStats(const SampleWindow_t* window, SampleWindow_stats_t* stats)
+{
+    *stats = window->latest;
+}
+
+static void resetPane(SampleWindow_pane_t* pane)
+{
+    memset(pane, 0, sizeof(*pane));
+}
+
+// Push the open pane into the ring and rebuild the window summary from the panes.
+// Runs once per hop, so its O(numPanes) cost is spread over every sample in the hop.
+static void closePane(SampleWindow_t* window)
+{
+    window->panes[window->nextPane] = window->openPane;
+    window->nextPane = (window->nextPane + 1) % window->numPanes;
+    if (window->panesFilled < window->numPanes){
+        window->panesFilled++;
+    }
+    window->openPaneStartMs += window->hopMs;
+    resetPane(&window->openPane);
+
+    SampleWindow_stats_t* stats = &window->latest;
+    stats->count = 0;
+    stats->sum = 0;
+    stats->min = 0;
+    stats->max = 0;
+    stats->dips = 0;
+    for (int i = 0; i < window->panesFilled; i++){
+        const SampleWindow_pane_t* pane = &window->panes[i];
+        if (pane->count == 0){
+            continue;
+        }
+        if (stats->count == 0 || pane->min < stats->min){
+            stats->min = pane->min;
+        }
+        if (stats->count == 0 || pane->max > stats->max){
+            stats->max = pane->max;
+        }
+        stats->count += pane->count;
+        stats->sum += pane->sum;
+        stats->dips += pane->dips;
+    }
+    stats->endTimeMs = window->openPaneStartMs;
+    stats->startTimeMs = window->openPaneStartMs - (long long)window->panesFilled * window->hopMs;
+    stats->windowNumber++;
+}
@@ -3,94 +3,280 @@
 #include "hal/potLed.h"
 #include "hal/sigDisplay.h"
 #include "hal/periodTimer.h"
+#include "hal/sampleWindow.h"
+#include "hal/sysfs.h"
+#include "hal/blockQueue.h"
+#include "hal/statusLog.h"
+#include "hal/metrics.h"
+#include "hal/sampleTrace.h"
+#include "hal/filterChain.h"
+#include "hal/spectrum.h"
+#include "hal/sampleShm.h"
+#include "hal/dipCapture.h"
+#include "hal/dipDetector.h"
+#include "hal/changePoint.h"
+#include "hal/sampleArchive.h"
+#include "hal/calibration.h"
+#include <errno.h>
 #include <assert.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <pthread.h>
 #include <string.h>
 
-#define NUM_SAMPLES 1000
+#define NUM_SAMPLES SAMPLER_HISTORY_CAPACITY
+#define HISTORY_WINDOW_MS 1000
 
 #define A2D_FILE_VOLTAGE1 "/sys/bus/iio/devices/iio:device0/in_voltage1_raw"
-#define A2D_VOLTAGE_REF_V 1.8
-#define A2D_MAX_READING 4095
-#define EXPONENTIAL_SMOOTHING_PREV_WEIGHT 0.999
-#define DIP_THRESHOLD 0.1
-#define DIP_HYSTERESIS_THRESHOLD 0.07
+#define NS_PER_US 1000
+#define NS_PER_MS 1000000
+#define OUTPUT_RATE_HZ 1000
+#define FILTER_OUTPUT_BLOCK 10
+#define FILTER_ENV "LIGHT_SAMPLER_FILTER"
+#define SPECTRUM_BAND_HALF_WIDTH_HZ 2
+#define US_PER_MS 1000
 
-static bool isRunning = true;
+static atomic_bool isRunning = true;
 static double historyBuffer[NUM_SAMPLES] = {0};
 static double currentBuffer[NUM_SAMPLES] = {0};
 static bool is_initialized = false;
-static long long numSamplesTaken = 0;
+static bool threadsStarted = false;
 static int historySize = 0;
 static int currentSize = 0;
 static int historyDips = 0;
-static double avgLightReading = 0;
 static int numDips = 0;
-static bool dipAllowed = true;
+// Smoothed light level and dip state (see dipDetector.h); under mutexHistory
+static DipDetector_t dipDetector;
+static long long historyStartTimeMs = 0;
+static bool historyReady = false;
+static SampleWindow_t windows[SAMPLER_MAX_WINDOWS];
+static int numWindows = 0;
+static Sampler_stamp_t windowStamps[SAMPLER_MAX_WINDOWS];
+static Sampler_stamp_t historyStamp;
+static long long currentOldestNs = 0;
+static long long lastSampleNs = 0;
+static BlockQueue_t blockQueue;
+static SampleBlock_t pendingBlock;
+static int pendingBlockSize = 0;
 Period_statistics_t *pStats;
 
+// Exported metrics; the getters read these so other threads never see torn values
+static Metrics_counter_t samplesTaken;
+static Metrics_counter_t dipsTotal;
+static Metrics_counter_t historyRollovers;
+static Metrics_gauge_t historySizeGauge;
+static Metrics_gauge_t historyDipsGauge;
+static Metrics_gauge_t avgVoltageGauge;
+static Metrics_gauge_t luxGauge;
+static Metrics_gauge_t samplePeriodMinGauge;
+static Metrics_gauge_t samplePeriodMaxGauge;
+static Metrics_gauge_t samplePeriodAvgGauge;
+static Metrics_gauge_t firstSampleGauge;
+
+// Trace capture/replay (see sampleTrace.h); only the sampler thread touches these after init
+static SampleTrace_config_t traceConfig;
+static SampleTrace_writer_t traceWriter;
+static SampleTrace_reader_t traceReader;
+static long long replayTimeUs = 0;
+static int replayReading = 0;
+static Metrics_gauge_t replayRateGauge;
+
+// Optional filter chain between acquisition and dip detection (see filterChain.h).
+// Raw readings are gathered into blocks of FILTER_OUTPUT_BLOCK * decimation inputs.
+static FilterChain_t filterChain;
+static double filterBlock[FILTER_MAX_BLOCK];
+static long long filterBlockMs[FILTER_MAX_BLOCK];
+static long long filterBlockNs[FILTER_MAX_BLOCK];
+static int filterBlockSize = 0;
+
+// Spectrum of each completed second, computed on the history thread.
+// spectrumInput/spectrum are history-thread only; latestSpectrum is under mutexHistory.
+static Spectrum_t spectrum;
+static double spectrumInput[NUM_SAMPLES];
+static int spectrumInputSize = 0;
+static Spectrum_result_t latestSpectrum;
+static long long latestSpectrumSecond = 0;
+static Metrics_gauge_t flickerHzGauge;
+static Metrics_gauge_t flickerVoltsGauge;
+static Metrics_gauge_t flickerBandEnergyGauge;
+static Histogram_t spectrumCostHistogram;
+
+// Pre/post-trigger captures around each dip (see dipCapture.h); under mutexHistory
+static DipCapture_pool_t capturePool;
+static Metrics_counter_t capturesTotal;
+
+// Steps and fades in the light level (see changePoint.h); under mutexHistory
+static ChangePoint_t changePoint;
+static Metrics_counter_t changePointsTotal;
+static Histogram_t changePointDelayHistogram;
+
+// Recent samples for bulk export (see sampleArchive.h); written by the sampler thread
+static SampleArchive_t archive;
+
+// Shared-memory export for local readers (see sampleShm.h); written by the sampler thread
+static SampleShm_writer_t shmWriter;
+static bool shmExporting = false;
+// Wall clock - monotonic clock for the shm summary stamps, refreshed once a
+// second by the history thread so publishing takes no extra clock reads
+static atomic_llong shmWallOffsetNs = 0;
+static const char* filterStageCostNames[FILTER_MAX_STAGES] = {
+    "light_sampler_filter_stage0_ns_total", "light_sampler_filter_stage1_ns_total",
+    "light_sampler_filter_stage2_ns_total", "light_sampler_filter_stage3_ns_total",
+};
+static const char* filterStageSampleNames[FILTER_MAX_STAGES] = {
+    "light_sampler_filter_stage0_samples_total", "light_sampler_filter_stage1_samples_total",
+    "light_sampler_filter_stage2_samples_total", "light_sampler_filter_stage3_samples_total",
+};
+
+// Windows maintained from startup: 100ms tumbling, 1s tumbling, 10s sliding by 1s
+static const int defaultWindows[][2] = {
+    {100, 100},
+    {1000, 1000},
+    {10000, 1000},
+};
+
 static void* sampleLightLevels();
+static void replayTrace(void);
+static int openTrace(void);
+static void openFilterChain(void);
+static void closeFilterChain(void);
+static void openShmExport(void);
+static void publishShmLocked(void);
+static void reportFirstSample(long long acquiredNs);
+static void reportChangePointsLocked(int numEvents);
+static void acquireSampleLocked(double voltageReading, long long sampleTimeMs, long long acquiredNs);
 static int getVoltage1Reading();
 static void* swapHistoryPeriodic();
 static double a2dToVoltage(int a2dReading);
-static void outputDataToTerminal();
+static void snapshotStatusLocked(StatusLog_second_t* status);
+static void analyzeSpectrum(int ledFrequency);
+static void outputDataToTerminal(StatusLog_second_t* status);
+static void moveCurrentDataToHistoryLocked(void);
+static void recordSampleLocked(double voltageReading, long long sampleTimeMs, long long acquiredNs);
+static void initState(double initialAverage);
+static int addWindowLocked(int lengthMs, int hopMs);
+static void registerMetrics(void);
+static void unregisterMetrics(void);
 
 static pthread_t samplerThread;
 static pthread_t historyThread;
 pthread_mutex_t mutexHistory;
+static pthread_cond_t condHistoryReady;
 
 // Begin/end the background thread which samples light levels.
 void Sampler_init(void)
 {
-    assert(!is_initialized);
-    is_initialized = true;
-
-    pthread_mutex_init(&mutexHistory, NULL);
-    pStats = (Period_statistics_t*)malloc(sizeof(Period_statistics_t));
-    avgLightReading = a2dToVoltage(getVoltage1Reading());
+    initState(a2dToVoltage(openTrace()));
+    openFilterChain();
+    openShmExport();
 
     //start the thread - will sample light level every 1ms
+    threadsStarted = true;
     pthread_create(&samplerThread, NULL, sampleLightLevels, NULL);
     pthread_create(&historyThread, NULL, swapHistoryPeriodic, NULL);
 }
 
+// Initialize without the background threads; samples arrive via Sampler_recordSample()
+void Sampler_initManual(double initialAverage)
+{
+    initState(initialAverage);
+}
+
+// Run the per-sample update for one reading taken at `sampleTimeMs`
+void Sampler_recordSample(double voltageReading, long long sampleTimeMs)
+{
+    assert(is_initialized);
+    pthread_mutex_lock(&mutexHistory);
+    recordSampleLocked(voltageReading, sampleTimeMs, getTimeInNs());
+    pthread_mutex_unlock(&mutexHistory);
+}
+
 void Sampler_cleanup(void)
 {
     //free memory, close files
     assert(is_initialized);
     is_initialized = false;
-    isRunning = false;
+    pthread_mutex_lock(&mutexHistory);
+    atomic_store(&isRunning, false);
+    pthread_cond_broadcast(&condHistoryReady);
+    pthread_mutex_unlock(&mutexHistory);
     //join thread
-    pthread_join(samplerThread, NULL);
-    pthread_join(historyThread, NULL);
+    if (threadsStarted){
+        pthread_join(samplerThread, NULL);
+        pthread_join(historyThread, NULL);
+        threadsStarted = false;
+        closeFilterChain();
+        if (shmExporting){
+            SampleShm_destroy(&shmWriter);
+            shmExporting = false;
+        }
+        if (traceConfig.mode == SAMPLE_TRACE_RECORD){
+            SampleTrace_closeWriter(&traceWriter);
+        } else if (traceConfig.mode == SAMPLE_TRACE_REPLAY){
+            SampleTrace_closeReader(&traceReader);
+            Metrics_unregister(&replayRateGauge);
+        }
+    }
     free(pStats);
+    unregisterMetrics();
+    BlockQueue_cleanup(&blockQueue);
+    pthread_cond_destroy(&condHistoryReady);
     pthread_mutex_destroy(&mutexHistory);
 }
 
-// Must be called once every 1s.
 // Moves the samples that it has been collecting this second into
 // the history, which makes the samples available for reads (below).
+// The sampler thread calls this itself at every 1s boundary.
 void Sampler_moveCurrentDataToHistory(void)
 {
     assert(is_initialized);
     pthread_mutex_lock(&mutexHistory);
-    memcpy(historyBuffer, currentBuffer, sizeof(double) * NUM_SAMPLES);
-    historySize = currentSize;
-    historyDips = numDips;
-    currentSize = 0;
-    numDips = 0;
-    dipAllowed = true;
+    moveCurrentDataToHistoryLocked();
+    historyStartTimeMs = getTimeInMs();
     pthread_mutex_unlock(&mutexHistory);
 }
 
+// Add another window definition; returns its id, or -1 if it cannot be added
+int Sampler_addWindow(int lengthMs, int hopMs)
+{
+    assert(is_initialized);
+    pthread_mutex_lock(&mutexHistory);
+    int id = addWindowLocked(lengthMs, hopMs);
+    pthread_mutex_unlock(&mutexHistory);
+    return id;
+}
+
+// Get the number of window definitions currently maintained
+int Sampler_getNumWindows(void)
+{
+    assert(is_initialized);
+    pthread_mutex_lock(&mutexHistory);
+    int count = numWindows;
+    pthread_mutex_unlock(&mutexHistory);
+    return count;
+}
+
+// Get the statistics of the most recently completed instance of window `id`
+bool Sampler_getWindowStats(int id, SampleWindow_stats_t* stats)
+{
+    assert(is_initialized);
+    bool found = false;
+    pthread_mutex_lock(&mutexHistory);
+    if (id >= 0 && id < numWindows){
+        SampleWindow_getStats(&windows[id], stats);
+        found = true;
+    }
+    pthread_mutex_unlock(&mutexHistory);
+    return found;
+}
+
 // Get the number of samples collected during the previous complete second.
 int Sampler_getHistorySize(void)
 {
     assert(is_initialized);
-    return historySize;
+    return (int)Metrics_gaugeGet(&historySizeGauge);
 }
 
 // Get a copy of the samples in the sample history.
@@ -106,99 +292,606 @@ double* Sampler_getHistory(int* size)
     return historyCopy;
 }
 
+// Get the summaries of the held dip captures, newest first
+int Sampler_listCaptures(DipCapture_info_t* infos, int maxInfos)
+{
+    assert(is_initialized);
+    pthread_mutex_lock(&mutexHistory);
+    int count = DipCapture_list(&capturePool, infos, maxInfos);
+    pthread_mutex_unlock(&mutexHistory);
+    return count;
+}
+
+// Get the recent change-point events, newest first
+int Sampler_listChangePoints(ChangePoint_event_t* events, int maxEvents)
+{
+    assert(is_initialized);
+    pthread_mutex_lock(&mutexHistory);
+    int count = ChangePoint_list(&changePoint, events, maxEvents);
+    pthread_mutex_unlock(&mutexHistory);
+    return count;
+}
+
+// Get a copy of dip capture `id`, if it is still held
+bool Sampler_getCapture(long long id, DipCapture_t* capture)
+{
+    assert(is_initialized);
+    pthread_mutex_lock(&mutexHistory);
+    bool found = DipCapture_get(&capturePool, id, capture);
+    pthread_mutex_unlock(&mutexHistory);
+    return found;
+}
+
+long long Sampler_getHistoryEpoch(void)
+{
+    assert(is_initialized);
+    return Metrics_counterGet(&historyRollovers);
+}
+
+// Get the acquisition/publication stamp of the current history
+void Sampler_getHistoryStamp(Sampler_stamp_t* stamp)
+{
+    assert(is_initialized);
+    pthread_mutex_lock(&mutexHistory);
+    *stamp = historyStamp;
+    pthread_mutex_unlock(&mutexHistory);
+}
+
+// Get the acquisition/publication stamp of the latest instance of window `id`
+bool Sampler_getWindowStamp(int id, Sampler_stamp_t* stamp)
+{
+    assert(is_initialized);
+    bool found = false;
+    pthread_mutex_lock(&mutexHistory);
+    if (id >= 0 && id < numWindows){
+        *stamp = windowStamps[id];
+        found = true;
+    }
+    pthread_mutex_unlock(&mutexHistory);
+    return found;
+}
+
+// Get the acquisition time of the most recent sample
+long long Sampler_getLastSampleNs(void)
+{
+    assert(is_initialized);
+    pthread_mutex_lock(&mutexHistory);
+    long long acquiredNs = lastSampleNs;
+    pthread_mutex_unlock(&mutexHistory);
+    return acquiredNs;
+}
+
+// Get the spectrum of the previous complete second; false until one is available
+bool Sampler_getSpectrum(Spectrum_result_t* result, long long* secondNumber)
+{
+    assert(is_initialized);
+    pthread_mutex_lock(&mutexHistory);
+    bool available = latestSpectrumSecond > 0;
+    *result = latestSpectrum;
+    *secondNumber = latestSpectrumSecond;
+    pthread_mutex_unlock(&mutexHistory);
+    return available;
+}
+
+// Get the filter chain applied before dip detection (empty when unfiltered)
+FilterChain_t* Sampler_getFilterChain(void)
+{
+    assert(is_initialized);
+    return &filterChain;
+}
+
+// Get the queue the sampler publishes sample blocks into
+BlockQueue_t* Sampler_getBlockQueue(void)
+{
+    assert(is_initialized);
+    return &blockQueue;
+}
+
+// Get the archive of recent samples, for lock-free bulk readers
+SampleArchive_t* Sampler_getArchive(void)
+{
+    assert(is_initialized);
+    return &archive;
+}
+
+// Get the trace file and how much of it can be read (all of it when replaying)
+const char* Sampler_getTracePath(long long* availableBytes)
+{
+    assert(is_initialized);
+    if (traceConfig.mode == SAMPLE_TRACE_RECORD){
+        *availableBytes = SampleTrace_getFlushedBytes(&traceWriter);
+        return traceConfig.path;
+    }
+    if (traceConfig.mode == SAMPLE_TRACE_REPLAY){
+        *availableBytes = -1;
+        return traceConfig.path;
+    }
+    return NULL;
+}
+
+// Copy the sample history into caller-provided storage without allocating.
+int Sampler_copyHistory(double* dest, int maxSize)
+{
+    assert(is_initialized);
+    pthread_mutex_lock(&mutexHistory);
+    int size = historySize < maxSize ? historySize : maxSize;
+    memcpy(dest, historyBuffer, sizeof(double) * size);
+    pthread_mutex_unlock(&mutexHistory);
+    return size;
+}
+
 // Get the average light level (not tied to the history).
 double Sampler_getAverageReading(void)
 {
     assert(is_initialized);
-    return 0;
+    return Metrics_gaugeGet(&avgVoltageGauge);
 }
 
 // Get the total number of light level samples taken so far.
 long long Sampler_getNumSamplesTaken(void)
 {
     assert(is_initialized);
-    return numSamplesTaken;
+    return Metrics_counterGet(&samplesTaken);
 }
 
 // Get the number of dips measured during the previous complete second.
 int Sampler_getHistoryNumDips(void)
 {
-    return historyDips;
+    return (int)Metrics_gaugeGet(&historyDipsGauge);
 }
 
 // Sample thread function
 // Continuously samples light level and makes necessary updates to shared data
 static void* sampleLightLevels()
 {
-    while (isRunning) {
+    if (traceConfig.mode == SAMPLE_TRACE_REPLAY){
+        replayTrace();
+        pthread_exit(NULL);
+    }
+    // A decimating filter needs its input that many times faster than the 1ms output
+    int decimation = FilterChain_getDecimation(&filterChain);
+    int readingsSinceMark = 0;
+    long long nextSampleNs = getTimeInNs();
+    bool isFirst = true;
+    while (atomic_load(&isRunning)) {
         pthread_mutex_lock(&mutexHistory);
-        double voltageReading = a2dToVoltage(getVoltage1Reading());
-        Period_markEvent(PERIOD_EVENT_SAMPLE_LIGHT);
-        currentBuffer[currentSize] = voltageReading;
-        if (dipAllowed){
-            if (voltageReading <= avgLightReading - DIP_THRESHOLD){
-                numDips++;
-                dipAllowed = false;
-            }
-        } else {
-            if (voltageReading >= avgLightReading - DIP_HYSTERESIS_THRESHOLD){
-                dipAllowed = true;
-            }
+        int a2dReading = getVoltage1Reading();
+        long long acquiredNs = getTimeInNs();
+        long long sampleTimeMs = getTimeInMs();
+        // Sampling jitter is tracked per output sample
+        readingsSinceMark++;
+        if (readingsSinceMark == decimation){
+            Period_markEvent(PERIOD_EVENT_SAMPLE_LIGHT);
+            readingsSinceMark = 0;
         }
-        numSamplesTaken++;
-        currentSize++;
-        avgLightReading = (EXPONENTIAL_SMOOTHING_PREV_WEIGHT * avgLightReading) + ((1 - EXPONENTIAL_SMOOTHING_PREV_WEIGHT) * voltageReading);
+        Metrics_gaugeSet(&luxGauge, Calibration_countToLux(a2dReading));
+        acquireSampleLocked(a2dToVoltage(a2dReading), sampleTimeMs, acquiredNs);
         pthread_mutex_unlock(&mutexHistory);
-        sleepForMs(1);
+        if (traceConfig.mode == SAMPLE_TRACE_RECORD){
+            SampleTrace_write(&traceWriter, acquiredNs, a2dReading);
+        }
+        if (isFirst){
+            reportFirstSample(acquiredNs);
+            isFirst = false;
+        }
+        if (decimation == 1){
+            sleepForMs(1);
+        } else {
+            nextSampleNs += NS_PER_MS / decimation;
+            sleepUntilNs(nextSampleNs);
+        }
     }
     pthread_exit(NULL);
 }
 
+// Startup cost as seen by users: process start to the first reading taken
+static void reportFirstSample(long long acquiredNs)
+{
+    double startupMs = (double)(acquiredNs - getProcessStartNs()) / NS_PER_MS;
+    Metrics_gaugeSet(&firstSampleGauge, startupMs);
+    char text[STATUS_LOG_TEXT_LEN];
+    snprintf(text, sizeof(text), "first sample %.1fms after start", startupMs);
+    StatusLog_postText(text);
+}
+
+// Replay thread body: feed the trace through the same per-sample update as live sampling.
+// Sample times come from the trace, so history seconds and dips match the recording
+// at any speed; only the pacing changes.
+static void replayTrace(void)
+{
+    bool isPaced = traceConfig.speed > 0;
+    long long startNs = getTimeInNs();
+    long long startMs = getTimeInMs();
+    long long numReplayed = 0;
+    bool haveReading = true;
+    while (atomic_load(&isRunning) && haveReading){
+        if (isPaced){
+            sleepUntilNs(startNs + (long long)(replayTimeUs * NS_PER_US / traceConfig.speed));
+        }
+        pthread_mutex_lock(&mutexHistory);
+        if (isPaced){
+            // Sampling jitter is meaningless when nothing waits between samples
+            Period_markEvent(PERIOD_EVENT_SAMPLE_LIGHT);
+        }
+        long long acquiredNs = getTimeInNs();
+        Metrics_gaugeSet(&luxGauge, Calibration_countToLux(replayReading));
+        acquireSampleLocked(a2dToVoltage(replayReading), startMs + replayTimeUs / US_PER_MS, acquiredNs);
+        pthread_mutex_unlock(&mutexHistory);
+        if (numReplayed == 0){
+            reportFirstSample(acquiredNs);
+        }
+        numReplayed++;
+        haveReading = SampleTrace_read(&traceReader, &replayTimeUs, &replayReading);
+    }
+    if (haveReading){
+        return;
+    }
+    if (traceReader.isMalformed){
+        char text[STATUS_LOG_TEXT_LEN];
+        snprintf(text, sizeof(text), "replay stopped: trace malformed after %lld records", traceReader.numRecords);
+        StatusLog_postText(text);
+    }
+    // Publish the final partial second so every replayed sample reaches the history
+    pthread_mutex_lock(&mutexHistory);
+    moveCurrentDataToHistoryLocked();
+    pthread_mutex_unlock(&mutexHistory);
+
+    double elapsedS = (getTimeInNs() - startNs) / 1e9;
+    double samplesPerS = elapsedS > 0 ? numReplayed / elapsedS : 0;
+    double speedUp = elapsedS > 0 ? (replayTimeUs / 1e6) / elapsedS : 0;
+    Metrics_gaugeSet(&replayRateGauge, samplesPerS);
+    char report[STATUS_LOG_TEXT_LEN];
+    snprintf(report, sizeof(report), "replay done: %lld samples in %.3fs = %.0f samples/s (%.1fx real time)",
+            numReplayed, elapsedS, samplesPerS, speedUp);
+    StatusLog_postText(report);
+}
+
+// Set up trace capture/replay from the environment; returns the first A2D reading
+static int openTrace(void)
+{
+    SampleTrace_configFromEnvironment(&traceConfig);
+    if (traceConfig.mode == SAMPLE_TRACE_REPLAY){
+        if (!SampleTrace_openReader(&traceReader, traceConfig.path)
+                || !SampleTrace_read(&traceReader, &replayTimeUs, &replayReading)){
+            printf("ERROR: Unable to replay sample trace %s.\n", traceConfig.path);
+            exit(-1);
+        }
+        Metrics_registerGauge(&replayRateGauge, "light_sampler_replay_samples_per_second", "Replay throughput, set when the trace ends.");
+        return replayReading;
+    }
+    if (traceConfig.mode == SAMPLE_TRACE_RECORD && !SampleTrace_openWriter(&traceWriter, traceConfig.path, getTimeInNs())){
+        printf("ERROR: Unable to create sample trace %s.\n", traceConfig.path);
+        exit(-1);
+    }
+    return getVoltage1Reading();
+}
+
+// Count and log the `numEvents` newest change points; mutexHistory must be held
+static void reportChangePointsLocked(int numEvents)
+{
+    ChangePoint_event_t events[CHANGE_POINT_NUM_METHODS];
+    numEvents = ChangePoint_list(&changePoint, events, numEvents);
+    for (int i = 0; i < numEvents; i++){
+        const ChangePoint_event_t* event = &events[i];
+        long long delayMs = event->detectedTimeMs - event->onsetTimeMs;
+        Metrics_counterAdd(&changePointsTotal, 1);
+        Histogram_record(&changePointDelayHistogram, delayMs);
+        char text[STATUS_LOG_TEXT_LEN];
+        snprintf(text, sizeof(text), "%s: level %s %.3fV -> %.3fV, found %lldms after onset",
+                ChangePoint_methodName(event->method), event->direction > 0 ? "rose" : "fell",
+                event->levelBefore, event->levelAfter, delayMs);
+        StatusLog_postText(text);
+    }
+}
+
+// Pass a raw reading through the filter chain (if any) on its way to recordSampleLocked().
+// Each filtered sample carries the time of the last raw reading that produced it.
+// mutexHistory must be held
+static void acquireSampleLocked(double voltageReading, long long sampleTimeMs, long long acquiredNs)
+{
+    if (filterChain.numStages == 0){
+        recordSampleLocked(voltageReading, sampleTimeMs, acquiredNs);
+        return;
+    }
+    filterBlock[filterBlockSize] = voltageReading;
+    filterBlockMs[filterBlockSize] = sampleTimeMs;
+    filterBlockNs[filterBlockSize] = acquiredNs;
+    filterBlockSize++;
+    int decimation = filterChain.decimation;
+    if (filterBlockSize < FILTER_OUTPUT_BLOCK * decimation){
+        return;
+    }
+    int numOutputs = FilterChain_process(&filterChain, filterBlock, filterBlockSize, filterBlock);
+    for (int i = 0; i < numOutputs; i++){
+        int source = (i + 1) * decimation - 1;
+        recordSampleLocked(filterBlock[i], filterBlockMs[source], filterBlockNs[source]);
+    }
+    filterBlockSize = 0;
+}
+
+// Build the filter chain from the environment; no variable means no filtering
+static void openFilterChain(void)
+{
+    const char* spec = getenv(FILTER_ENV);
+    if (spec && spec[0] && !FilterChain_parse(&filterChain, spec, OUTPUT_RATE_HZ)){
+        printf("ERROR: Invalid filter chain %s=%s.\n", FILTER_ENV, spec);
+        printf(" Use stages like ma:N, median:N, lowpass:HZ, fir:TAPS:DECIMATION.\n");
+        exit(-1);
+    }
+    for (int i = 0; i < filterChain.numStages; i++){
+        Metrics_registerCounter(&filterChain.stages[i].costNs, filterStageCostNames[i], "Time spent in this filter stage.");
+        Metrics_registerCounter(&filterChain.stages[i].samplesIn, filterStageSampleNames[i], "Samples entering this filter stage.");
+    }
+}
+
+static void closeFilterChain(void)
+{
+    for (int i = 0; i < filterChain.numStages; i++){
+        Metrics_unregister(&filterChain.stages[i].costNs);
+        Metrics_unregister(&filterChain.stages[i].samplesIn);
+    }
+}
+
+// Per-sample update: history rollover, dip detection, windows, and the running average
+// mutexHistory must be held
+static void recordSampleLocked(double voltageReading, long long sampleTimeMs, long long acquiredNs)
+{
+    // The sample belongs to the next second once the boundary has passed
+    if (sampleTimeMs - historyStartTimeMs >= HISTORY_WINDOW_MS){
+        moveCurrentDataToHistoryLocked();
+        historyStartTimeMs = sampleTimeMs;
+    }
+    if (currentSize == 0){
+        currentOldestNs = acquiredNs;
+    }
+    if (currentSize < NUM_SAMPLES){
+        currentBuffer[currentSize] = voltageReading;
+        currentSize++;
+    }
+    // Dip state carries across window boundaries so a dip is counted once,
+    // in the window where it started.
+    double triggerVolts = DipDetector_getTriggerVolts(&dipDetector);
+    bool isDip = DipDetector_update(&dipDetector, voltageReading);
+    if (isDip){
+        numDips++;
+        Metrics_counterAdd(&dipsTotal, 1);
+    }
+    DipCapture_addSample(&capturePool, voltageReading, isDip, Metrics_counterGet(&samplesTaken),
+            sampleTimeMs, acquiredNs, triggerVolts);
+    if (isDip){
+        Metrics_counterAdd(&capturesTotal, 1);
+    }
+    int numChanges = ChangePoint_addSample(&changePoint, voltageReading, Metrics_counterGet(&samplesTaken),
+            sampleTimeMs, acquiredNs);
+    if (numChanges > 0){
+        reportChangePointsLocked(numChanges);
+    }
+    for (int i = 0; i < numWindows; i++){
+        if (SampleWindow_addSample(&windows[i], voltageReading, isDip, sampleTimeMs)){
+            // This sample opened a new pane, so the completed window ended with the previous one
+            windowStamps[i].newestSampleNs = lastSampleNs;
+            windowStamps[i].publishedNs = acquiredNs;
+        }
+    }
+    lastSampleNs = acquiredNs;
+
+    // Stream the sample out in fixed-size blocks for push subscribers
+    if (pendingBlockSize == 0){
+        pendingBlock.firstSampleNumber = Metrics_counterGet(&samplesTaken);
+        pendingBlock.numDips = 0;
+    }
+    pendingBlock.samples[pendingBlockSize++] = voltageReading;
+    if (isDip){
+        pendingBlock.numDips++;
+    }
+    if (pendingBlockSize == SAMPLE_BLOCK_SAMPLES){
+        pendingBlock.newestSampleNs = acquiredNs;
+        BlockQueue_publish(&blockQueue, &pendingBlock);
+    }
+    SampleArchive_append(&archive, voltageReading);
+    Metrics_counterAdd(&samplesTaken, 1);
+    Metrics_gaugeSet(&avgVoltageGauge, dipDetector.average);
+    if (pendingBlockSize == SAMPLE_BLOCK_SAMPLES){
+        if (shmExporting){
+            publishShmLocked();
+        }
+        pendingBlockSize = 0;
+    }
+}
+
+// Create the shared-memory segment named by LIGHT_SAMPLER_SHM (default
+// SAMPLE_SHM_DEFAULT_NAME; "off" disables it). Failure only disables the export.
+static void openShmExport(void)
+{
+    const char* name = getenv(SAMPLE_SHM_NAME_ENV);
+    if (!name || name[0] == 0){
+        name = SAMPLE_SHM_DEFAULT_NAME;
+    }
+    if (strcmp(name, "off") == 0){
+        return;
+    }
+    shmExporting = SampleShm_create(&shmWriter, name);
+    atomic_store_explicit(&shmWallOffsetNs, getWallClockOffsetNs(), memory_order_relaxed);
+    if (!shmExporting && errno == EEXIST){
+        printf("WARNING: shared-memory export %s is owned by another running sampler; not exporting\n", name);
+    } else if (!shmExporting){
+        printf("WARNING: shared-memory export %s unavailable: %s\n", name, strerror(errno));
+    }
+}
+
+// Publish the block just completed, then the summary as of that block
+// mutexHistory must be held
+static void publishShmLocked(void)
+{
+    SampleShm_publishBlock(&shmWriter, &pendingBlock);
+    SampleShm_summary_t summary;
+    memset(&summary, 0, sizeof(summary));
+    summary.updatedNs = pendingBlock.newestSampleNs;
+    summary.updatedWallNs = pendingBlock.newestSampleNs + atomic_load_explicit(&shmWallOffsetNs, memory_order_relaxed);
+    summary.samplesTaken = Metrics_counterGet(&samplesTaken);
+    summary.dipsTotal = Metrics_counterGet(&dipsTotal);
+    summary.averageVolts = dipDetector.average;
+    summary.historySize = historySize;
+    summary.historyDips = historyDips;
+    summary.historyNewestNs = historyStamp.newestSampleNs;
+    summary.numWindows = numWindows < SAMPLE_SHM_MAX_WINDOWS ? numWindows : SAMPLE_SHM_MAX_WINDOWS;
+    for (int i = 0; i < summary.numWindows; i++){
+        summary.windows[i] = windows[i].latest;
+    }
+    SampleShm_publishSummary(&shmWriter, &summary);
+}
+
 // history thread function
-// reads the current buffer into history buffer every 1 second
-// also drives the terminal output, timing jitter readings, and 14-sig display updates
+// waits for the sampler thread to roll a completed second into the history
+// then drives the terminal output, timing jitter readings, and 14-sig display updates
 static void* swapHistoryPeriodic()
 {
-    long long startTime = getTimeInMs();
-    while (isRunning) {
-        long long currentTime = getTimeInMs();
-        if (currentTime - startTime >= 1000){
-            Sampler_moveCurrentDataToHistory();
-            startTime = currentTime;
-            SigDisplay_setNumber(historyDips);
+    StatusLog_second_t status;
+    while (atomic_load(&isRunning)) {
+        pthread_mutex_lock(&mutexHistory);
+        while (!historyReady && atomic_load(&isRunning)){
+            pthread_cond_wait(&condHistoryReady, &mutexHistory);
+        }
+        bool ready = historyReady;
+        historyReady = false;
+        if (ready){
+            snapshotStatusLocked(&status);
+            spectrumInputSize = historySize;
+            memcpy(spectrumInput, historyBuffer, sizeof(double) * historySize);
+        }
+        pthread_mutex_unlock(&mutexHistory);
+        if (ready){
+            SigDisplay_setNumber(status.dips);
+            analyzeSpectrum(PotLed_getFrequency());
             Period_getStatisticsAndClear(PERIOD_EVENT_SAMPLE_LIGHT, pStats);
-            outputDataToTerminal();
+            Metrics_gaugeSet(&samplePeriodMinGauge, pStats->minPeriodInMs);
+            Metrics_gaugeSet(&samplePeriodMaxGauge, pStats->maxPeriodInMs);
+            Metrics_gaugeSet(&samplePeriodAvgGauge, pStats->avgPeriodInMs);
+            outputDataToTerminal(&status);
+            if (shmExporting){
+                atomic_store_explicit(&shmWallOffsetNs, getWallClockOffsetNs(), memory_order_relaxed);
+            }
         }
     }
     pthread_exit(NULL);
 }
 
-// From A2D guide
+// Raw A2D count of the light sensor
 static int getVoltage1Reading()
 {
-    // Open file
-    FILE *f = fopen(A2D_FILE_VOLTAGE1, "r");
-    if (!f) {
-        printf("ERROR: Unable to open voltage input file. Cape loaded?\n");
-        printf(" Check /boot/uEnv.txt for correct options.\n");
-        exit(-1);
+    return Sysfs_readInt(A2D_FILE_VOLTAGE1);
+}
+
+// Transfers direct a2d reading into bbg voltage reading (the board's calibrated table)
+static double a2dToVoltage(int a2dReading)
+{
+    return Calibration_countToVolts(a2dReading);
+}
+
+// Shared setup for threaded and manual operation
+static void initState(double initialAverage)
+{
+    assert(!is_initialized);
+    is_initialized = true;
+
+    pthread_mutex_init(&mutexHistory, NULL);
+    pthread_cond_init(&condHistoryReady, NULL);
+    pStats = (Period_statistics_t*)malloc(sizeof(Period_statistics_t));
+    atomic_store(&isRunning, true);
+    BlockQueue_init(&blockQueue);
+    pendingBlockSize = 0;
+    FilterChain_init(&filterChain);
+    filterBlockSize = 0;
+    Spectrum_init(&spectrum, SAMPLER_SPECTRUM_SIZE);
+    DipCapture_init(&capturePool);
+    ChangePoint_config_t changePointConfig = ChangePoint_defaultConfig();
+    ChangePoint_init(&changePoint, &changePointConfig);
+    SampleArchive_init(&archive);
+    latestSpectrumSecond = 0;
+    registerMetrics();
+    DipDetector_config_t detectorConfig = DipDetector_defaultConfig();
+    DipDetector_init(&dipDetector, &detectorConfig, initialAverage);
+    Metrics_gaugeSet(&avgVoltageGauge, dipDetector.average);
+    historyStartTimeMs = getTimeInMs();
+    numWindows = 0;
+    for (size_t i = 0; i < sizeof(defaultWindows) / sizeof(defaultWindows[0]); i++){
+        addWindowLocked(defaultWindows[i][0], defaultWindows[i][1]);
     }
-    // Get reading
-    int a2dReading = 0;
-    int itemsRead = fscanf(f, "%d", &a2dReading);
-    if (itemsRead <= 0) {
-    printf("ERROR: Unable to read values from voltage input file.\n");
-        exit(-1);
+}
+
+// Rolls the current second into the history; mutexHistory must be held
+static void moveCurrentDataToHistoryLocked(void)
+{
+    memcpy(historyBuffer, currentBuffer, sizeof(double) * currentSize);
+    historySize = currentSize;
+    historyDips = numDips;
+    Metrics_gaugeSet(&historySizeGauge, historySize);
+    Metrics_gaugeSet(&historyDipsGauge, historyDips);
+    historyStamp.oldestSampleNs = currentOldestNs;
+    historyStamp.newestSampleNs = lastSampleNs;
+    historyStamp.publishedNs = getTimeInNs();
+    currentSize = 0;
+    numDips = 0;
+    Metrics_counterAdd(&historyRollovers, 1);
+    historyReady = true;
+    pthread_cond_signal(&condHistoryReady);
+}
+
+// Registers a new window starting now; mutexHistory must be held
+static int addWindowLocked(int lengthMs, int hopMs)
+{
+    if (numWindows >= SAMPLER_MAX_WINDOWS){
+        return -1;
     }
-    // Close file
-    fclose(f);
-    return a2dReading;
+    if (!SampleWindow_init(&windows[numWindows], lengthMs, hopMs, getTimeInMs())){
+        return -1;
+    }
+    memset(&windowStamps[numWindows], 0, sizeof(windowStamps[numWindows]));
+    return numWindows++;
 }
 
-// Transfers direct a2d reading into bbg voltage reading
-static double a2dToVoltage(int a2dReading)
+static void registerMetrics(void)
 {
-    return ((double)a2dReading / (double)A2D_MAX_READING) * (double)A2D_VOLTAGE_REF_V;
+    Metrics_registerCounter(&samplesTaken, "light_sampler_samples_total", "Light samples taken since start.");
+    Metrics_registerCounter(&dipsTotal, "light_sampler_dips_total", "Light dips detected since start.");
+    Metrics_registerCounter(&capturesTotal, "light_sampler_dip_captures_total", "Dip captures started.");
+    Metrics_registerCounter(&changePointsTotal, "light_sampler_change_points_total", "Level changes found by either change-point detector.");
+    Metrics_registerCounter(&historyRollovers, "light_sampler_history_rollovers_total", "Seconds rolled into the history.");
+    Metrics_registerGauge(&historySizeGauge, "light_sampler_history_samples", "Samples in the previous complete second.");
+    Metrics_registerGauge(&historyDipsGauge, "light_sampler_history_dips", "Dips in the previous complete second.");
+    Metrics_registerGauge(&avgVoltageGauge, "light_sampler_average_volts", "Exponentially smoothed light level.");
+    Metrics_registerGauge(&luxGauge, "light_sampler_lux", "Light level of the latest reading, from the calibration table.");
+    Metrics_registerGauge(&samplePeriodMinGauge, "light_sampler_sample_period_min_ms", "Shortest time between samples in the previous second.");
+    Metrics_registerGauge(&samplePeriodMaxGauge, "light_sampler_sample_period_max_ms", "Longest time between samples in the previous second.");
+    Metrics_registerGauge(&samplePeriodAvgGauge, "light_sampler_sample_period_avg_ms", "Mean time between samples in the previous second.");
+    Metrics_registerGauge(&firstSampleGauge, "light_sampler_startup_first_sample_ms", "Time from process start to the first sample.");
+    Metrics_registerGauge(&flickerHzGauge, "light_sampler_flicker_hz", "Dominant frequency in the previous second's light signal.");
+    Metrics_registerGauge(&flickerVoltsGauge, "light_sampler_flicker_volts", "Amplitude of the dominant frequency.");
+    Metrics_registerGauge(&flickerBandEnergyGauge, "light_sampler_flicker_band_energy", "Spectral energy within 2Hz of the LED frequency.");
+    Metrics_registerHistogram(&spectrumCostHistogram, "light_sampler_spectrum_us", "Time to compute the spectrum of one second.");
+    Metrics_registerHistogram(&changePointDelayHistogram, "light_sampler_change_point_delay_ms", "Time from a change's estimated onset to its detection.");
+}
+
+static void unregisterMetrics(void)
+{
+    Metrics_unregister(&samplesTaken);
+    Metrics_unregister(&dipsTotal);
+    Metrics_unregister(&historyRollovers);
+    Metrics_unregister(&capturesTotal);
+    Metrics_unregister(&changePointsTotal);
+    Metrics_unregister(&historySizeGauge);
+    Metrics_unregister(&historyDipsGauge);
+    Metrics_unregister(&avgVoltageGauge);
+    Metrics_unregister(&luxGauge);
+    Metrics_unregister(&samplePeriodMinGauge);
+    Metrics_unregister(&samplePeriodMaxGauge);
+    Metrics_unregister(&samplePeriodAvgGauge);
+    Metrics_unregister(&firstSampleGauge);
+    Metrics_unregister(&flickerHzGauge);
+    Metrics_unregister(&flickerVoltsGauge);
+    Metrics_unregister(&flickerBandEnergyGauge);
+    Metrics_unregister(&spectrumCostHistogram);
+    Metrics_unregister(&changePointDelayHistogram);
 }
 
 // Returns a reference to the history mutex for outside use
@@ -207,22 +900,56 @@ pthread_mutex_t* Sampler_getHistoryMutexRef(void)
     return &mutexHistory;
 }
 
-static void outputDataToTerminal()
+// FFT of the second copied into spectrumInput; the band of interest is the LED's set frequency.
+// The history spans HISTORY_WINDOW_MS, so its sample count gives the sample rate.
+static void analyzeSpectrum(int ledFrequency)
 {
-    printf("#Smpl/s = %3d    POT @ %4d => %2dHz   avg = %.3fV    dips =  %2d    Smpl ms[ %.3f,  %.3f] avg %.3f/%3d    \n",
-            historySize, PotLed_getPOTReading(), PotLed_getFrequency(), avgLightReading, historyDips, pStats->minPeriodInMs, pStats->maxPeriodInMs, pStats->avgPeriodInMs, pStats->numSamples);
-    int numSamples = 10;
+    if (spectrumInputSize < SPECTRUM_MIN_SIZE){
+        return;
+    }
+    Spectrum_result_t result;
+    long long startNs = getTimeInNs();
+    double sampleRateHz = spectrumInputSize * 1000.0 / HISTORY_WINDOW_MS;
+    double bandLowHz = ledFrequency > 0 ? ledFrequency - SPECTRUM_BAND_HALF_WIDTH_HZ : 0;
+    double bandHighHz = ledFrequency > 0 ? ledFrequency + SPECTRUM_BAND_HALF_WIDTH_HZ : 0;
+    Spectrum_analyze(&spectrum, spectrumInput, spectrumInputSize, sampleRateHz, bandLowHz, bandHighHz, &result);
+    Histogram_record(&spectrumCostHistogram, (getTimeInNs() - startNs) / NS_PER_US);
+    Metrics_gaugeSet(&flickerHzGauge, result.dominantHz);
+    Metrics_gaugeSet(&flickerVoltsGauge, result.dominantMagnitude);
+    Metrics_gaugeSet(&flickerBandEnergyGauge, result.bandEnergy);
+    pthread_mutex_lock(&mutexHistory);
+    latestSpectrum = result;
+    latestSpectrumSecond++;
+    pthread_mutex_unlock(&mutexHistory);
+}
+
+// Copies the fields of the per-second status line that live under mutexHistory
+static void snapshotStatusLocked(StatusLog_second_t* status)
+{
+    status->historySize = historySize;
+    status->avgVoltage = dipDetector.average;
+    status->dips = historyDips;
+    int numSamples = STATUS_LOG_PREVIEW_SAMPLES;
     int scalingFactor = (historySize-1) / numSamples;
     if (historySize < numSamples) {
         numSamples = historySize;
         scalingFactor = 1;
     }
+    status->numPreview = numSamples;
     for (int i = 0; i < numSamples; i++){
-        if (i == 0){
-            printf("  %d:%.3f", i*scalingFactor, historyBuffer[i]);
-        } else {
-            printf("  %3d:%.3f", i*scalingFactor, historyBuffer[i]);
-        }
+        status->previewIndex[i] = i*scalingFactor;
+        status->previewValue[i] = historyBuffer[i];
     }
-    printf("\n");
-}
\ No newline at end of file
+}
+
+// Hands the status line to the async logger; never blocks on the console
+static void outputDataToTerminal(StatusLog_second_t* status)
+{
+    status->potReading = PotLed_getPOTReading();
+    status->frequency = PotLed_getFrequency();
+    status->minPeriodMs = pStats->minPeriodInMs;
+    status->maxPeriodMs = pStats->maxPeriodInMs;
+    status->avgPeriodMs = pStats->avgPeriodInMs;
+    status->numPeriodSamples = pStats->numSamples;
+    StatusLog_postSecond(status);
+}
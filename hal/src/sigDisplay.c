@@ -1,5 +1,8 @@
 #include "hal/sigDisplay.h"
 #include "hal/timing.h"
+#include "hal/sysfs.h"
+#include "hal/metrics.h"
+#include "hal/pinConfig.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,6 +13,7 @@
 #include <linux/i2c-dev.h>
 #include <pthread.h>
 #include <string.h>
+#include <stdatomic.h>
 
 #define I2CDRV_LINUX_BUS1 "/dev/i2c-1"
 
@@ -31,39 +35,33 @@
 static pthread_t thread;
 
 static bool is_initialized = false;
-static bool isRunning = true;
+static atomic_bool isRunning = true;
 static int i2cFileDesc;
-static int currentNumber = 0;
+static atomic_int currentNumber = 0;
+// Set by the display thread once the bus and gpios are set up
+static atomic_bool busReady = false;
+static Metrics_gauge_t numberGauge;
+static Metrics_counter_t digitsDrawn;
 
 static void* displayNumber();
 static int initI2cBus(char* bus, int address);
 static void writeI2cReg(int i2cFileDesc, unsigned char regAddr, unsigned char value);
-static void writeToFile(const char* filePath, const char* input);
 static void configureLeftDigit(bool isLeft);
-static void runCommand(char* command);
+static void showDigit(bool isLeft);
 
-// initialize bus and registers, 
-// set config pins, 
-// set gpio direction, 
-// spawn thread
+// queue the I2C pins (see pinConfig.h) and spawn the thread,
+// which sets up the bus, registers and gpio direction once the pins are ready
 void SigDisplay_init(void)
 {
     assert(!is_initialized);
     is_initialized = true;
+    Metrics_registerGauge(&numberGauge, "light_sampler_display_number", "Number shown on the 14-segment display.");
+    Metrics_registerCounter(&digitsDrawn, "light_sampler_display_digits_total", "Digits drawn on the 14-segment display.");
 
-    runCommand("config-pin p9_18 i2c");
-    runCommand("config-pin p9_17 i2c");
-
-    i2cFileDesc = initI2cBus(I2CDRV_LINUX_BUS1, I2C_DEVICE_ADDRESS);
-    writeI2cReg(i2cFileDesc, REG_DIRA, 0x00);
-    writeI2cReg(i2cFileDesc, REG_DIRB, 0x00);
-
-    
-    writeToFile(LEFT_DIRECTION, "out");
-    writeToFile(RIGHT_DIRECTION, "out");
-
+    atomic_store(&busReady, false);
+    PinConfig_request("p9_18", "i2c");
+    PinConfig_request("p9_17", "i2c");
     pthread_create(&thread, NULL, displayNumber, NULL);
-
 }
 
 // General Cleanup
@@ -71,17 +69,30 @@ void SigDisplay_cleanup(void)
 {
     assert(is_initialized);
     is_initialized = false;
-    isRunning = false;
+    atomic_store(&isRunning, false);
     pthread_join(thread, NULL);
-    writeToFile(LEFT_VALUE, "0");
-    writeToFile(RIGHT_VALUE, "0");
-    close(i2cFileDesc);
+    // The thread gives up before opening the bus if its pins never got configured
+    if (atomic_load(&busReady)){
+        Sysfs_writeString(LEFT_VALUE, "0");
+        Sysfs_writeString(RIGHT_VALUE, "0");
+        close(i2cFileDesc);
+    }
+    Metrics_unregister(&numberGauge);
+    Metrics_unregister(&digitsDrawn);
 }
 
 // From I2C Guide
 static int initI2cBus(char* bus, int address)
 {
-    int i2cFileDesc = open(bus, O_RDWR);
+    int i2cFileDesc = Sysfs_openDevice(bus, O_RDWR);
+    if (Sysfs_isSimulated()) {
+        // Simulated bus: register writes just land in a plain file
+        if (i2cFileDesc < 0) {
+            perror("I2C: Unable to open simulated bus.");
+            exit(1);
+        }
+        return i2cFileDesc;
+    }
     int result = ioctl(i2cFileDesc, I2C_SLAVE, address);
     if (result < 0) {
         perror("I2C: Unable to set I2C device to slave address.");
@@ -106,47 +117,56 @@ static void writeI2cReg(int i2cFileDesc, unsigned char regAddr, unsigned char va
 // Main thread loop function
 // Utilizes algorithm from I2C guide
 // Used to display number of light dips in last second
+// Sets up the bus and digit gpios first, once the pins are in I2C mode
 static void* displayNumber()
 {
-    while (isRunning) {
-        writeToFile(LEFT_VALUE, "0");
-        writeToFile(RIGHT_VALUE, "0");
-        configureLeftDigit(true);
-        writeToFile(LEFT_VALUE, "1");
+    if (!PinConfig_waitForPins(&isRunning)){
+        pthread_exit(NULL);
+    }
+    i2cFileDesc = initI2cBus(I2CDRV_LINUX_BUS1, I2C_DEVICE_ADDRESS);
+    writeI2cReg(i2cFileDesc, REG_DIRA, 0x00);
+    writeI2cReg(i2cFileDesc, REG_DIRB, 0x00);
+    Sysfs_writeString(LEFT_DIRECTION, "out");
+    Sysfs_writeString(RIGHT_DIRECTION, "out");
+    atomic_store(&busReady, true);
+
+    while (atomic_load(&isRunning)) {
+        showDigit(true);
         sleepForMs(5);
-        writeToFile(LEFT_VALUE, "0");
-        writeToFile(RIGHT_VALUE, "0");
-        configureLeftDigit(false);
-        writeToFile(RIGHT_VALUE, "1");
+        showDigit(false);
         sleepForMs(5);
     }
     pthread_exit(NULL);
 }
 
-static void writeToFile(const char* filePath, const char* input)
+// Draw one full frame (both digits) without the multiplexing delay
+void SigDisplay_refresh(void)
 {
-    FILE *f = fopen(filePath, "w");
-    if (!f) {
-        printf("ERROR: Unable to file.\n");
-        exit(-1);
-    }
-    int charWritten = fprintf(f, "%s", input);
-    if (charWritten <= 0) {
-        printf("ERROR WRITING DATA");
-        exit(1);
+    assert(is_initialized);
+    while (!atomic_load(&busReady)){
+        sleepForMs(1);
     }
-    fclose(f);
+    showDigit(true);
+    showDigit(false);
+}
+
+// Turn both digits off, load the segments for one digit, then turn it on
+static void showDigit(bool isLeft)
+{
+    Sysfs_writeString(LEFT_VALUE, "0");
+    Sysfs_writeString(RIGHT_VALUE, "0");
+    configureLeftDigit(isLeft);
+    Sysfs_writeString(isLeft ? LEFT_VALUE : RIGHT_VALUE, "1");
+    Metrics_counterAdd(&digitsDrawn, 1);
 }
 
 // Helper function to configure bits for the 14-sig display
 // bool isLeft determines whether we model the 10s or 1s place digit of the real number
 static void configureLeftDigit(bool isLeft)
 {
-    int digitDisplayed;
-    if (currentNumber > 99){
+    int digitDisplayed = atomic_load(&currentNumber);
+    if (digitDisplayed > 99){
         digitDisplayed = 99;
-    } else {
-        digitDisplayed = currentNumber;
     }
     
     if (isLeft) {
@@ -208,27 +228,6 @@ static void configureLeftDigit(bool isLeft)
 // External function to set the number for display
 void SigDisplay_setNumber(int newValue)
 {
-    currentNumber = newValue;
+    atomic_store(&currentNumber, newValue);
+    Metrics_gaugeSet(&numberGauge, newValue);
 }
-
-// From Assignment 1
-static void runCommand(char* command)
-{
-    // Execute the shell command (output into pipe)
-    FILE *pipe = popen(command, "r");
-    // Ignore output of the command; but consume it
-    // so we don't get an error when closing the pipe.
-    char buffer[1024];
-    while (!feof(pipe) && !ferror(pipe)) {
-        if (fgets(buffer, sizeof(buffer), pipe) == NULL)
-            break;
-        // printf("--> %s", buffer); // Uncomment for debugging
-    }
-    // Get the exit code from the pipe; non-zero is an error:
-    int exitCode = WEXITSTATUS(pclose(pipe));
-    if (exitCode != 0) {
-        perror("Unable to execute command:");
-        printf(" command: %s\n", command);
-        printf(" exit code: %d\n", exitCode);
-    }
-}
\ No newline at end of file
@@ -0,0 +1,181 @@
+// spectrum.c
+// Real FFT with precomputed tables and spectrum peak picking (see spectrum.h)
+
+#include "hal/spectrum.h"
+#include <math.h>
+#include <string.h>
+
+static double windowedSample(Spectrum_t* spectrum, const double* samples, int count, double mean, int n);
+static void transform(Spectrum_t* spectrum);
+static void splitMagnitudes(Spectrum_t* spectrum);
+static void findPeaks(Spectrum_t* spectrum, Spectrum_result_t* result);
+
+bool Spectrum_init(Spectrum_t* spectrum, int size)
+{
+    if (size < SPECTRUM_MIN_SIZE || size > SPECTRUM_MAX_SIZE || (size & (size - 1)) != 0){
+        return false;
+    }
+    spectrum->size = size;
+    spectrum->half = size / 2;
+    int log2Half = 0;
+    while ((1 << log2Half) < spectrum->half){
+        log2Half++;
+    }
+    for (int k = 0; k < spectrum->half; k++){
+        // e^(-2*pi*i*k/size): the split step uses every entry, the
+        // half-size complex FFT every second one
+        spectrum->twiddleRe[k] = cos(2 * M_PI * k / size);
+        spectrum->twiddleIm[k] = -sin(2 * M_PI * k / size);
+        int reversed = 0;
+        for (int bit = 0; bit < log2Half; bit++){
+            reversed |= ((k >> bit) & 1) << (log2Half - 1 - bit);
+        }
+        spectrum->bitReverse[k] = reversed;
+    }
+    spectrum->windowGain = 0;
+    for (int n = 0; n < size; n++){
+        spectrum->window[n] = 0.5 - 0.5 * cos(2 * M_PI * n / (size - 1));
+        spectrum->windowGain += spectrum->window[n];
+    }
+    return true;
+}
+
+void Spectrum_analyze(Spectrum_t* spectrum, const double* samples, int numSamples, double sampleRateHz,
+        double bandLowHz, double bandHighHz, Spectrum_result_t* result)
+{
+    int size = spectrum->size;
+    int count = numSamples < size ? numSamples : size;
+    const double* newest = samples + (numSamples - count);
+    double mean = 0;
+    for (int n = 0; n < count; n++){
+        mean += newest[n];
+    }
+    mean = count > 0 ? mean / count : 0;
+
+    // Even samples become the real part and odd samples the imaginary part,
+    // loaded straight into bit-reversed order
+    for (int n = 0; n < spectrum->half; n++){
+        int slot = spectrum->bitReverse[n];
+        spectrum->re[slot] = windowedSample(spectrum, newest, count, mean, 2 * n);
+        spectrum->im[slot] = windowedSample(spectrum, newest, count, mean, 2 * n + 1);
+    }
+    transform(spectrum);
+    splitMagnitudes(spectrum);
+    if (count < size && count > 0){
+        // Only `count` window weights were applied; rescale to their sum
+        double gain = 0;
+        for (int n = 0; n < count; n++){
+            gain += spectrum->window[(long long)n * size / count];
+        }
+        for (int k = 0; k <= spectrum->half; k++){
+            spectrum->magnitude[k] *= spectrum->windowGain / gain;
+        }
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->size = size;
+    result->numSamples = count;
+    result->sampleRateHz = sampleRateHz;
+    result->resolutionHz = sampleRateHz / size;
+    result->bandLowHz = bandLowHz;
+    result->bandHighHz = bandHighHz;
+    for (int k = 1; k <= spectrum->half; k++){
+        double energy = spectrum->magnitude[k] * spectrum->magnitude[k];
+        double frequency = k * result->resolutionHz;
+        result->totalEnergy += energy;
+        if (frequency >= bandLowHz && frequency <= bandHighHz){
+            result->bandEnergy += energy;
+        }
+    }
+    findPeaks(spectrum, result);
+    if (result->numPeaks > 0){
+        result->dominantHz = result->peaks[0].frequencyHz;
+        result->dominantMagnitude = result->peaks[0].magnitude;
+    }
+}
+
+// Mean-removed, Hann-windowed sample n (zero past the data). With fewer
+// samples than points the window table is stretched over the data.
+static double windowedSample(Spectrum_t* spectrum, const double* samples, int count, double mean, int n)
+{
+    if (n >= count){
+        return 0;
+    }
+    int index = count == spectrum->size ? n : (int)((long long)n * spectrum->size / count);
+    return (samples[n] - mean) * spectrum->window[index];
+}
+
+// In-place iterative radix-2 complex FFT of the half-size sequence (already bit-reversed)
+static void transform(Spectrum_t* spectrum)
+{
+    int half = spectrum->half;
+    double* re = spectrum->re;
+    double* im = spectrum->im;
+    for (int length = 2; length <= half; length <<= 1){
+        int span = length / 2;
+        int stride = spectrum->size / length;
+        for (int start = 0; start < half; start += length){
+            for (int j = 0; j < span; j++){
+                double wr = spectrum->twiddleRe[j * stride];
+                double wi = spectrum->twiddleIm[j * stride];
+                int a = start + j;
+                int b = a + span;
+                double tr = re[b] * wr - im[b] * wi;
+                double ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+// Untangle the packed transform into the real signal's bins 0..size/2,
+// scaled to single-sided amplitudes
+static void splitMagnitudes(Spectrum_t* spectrum)
+{
+    int half = spectrum->half;
+    double scale = 2 / spectrum->windowGain;
+    for (int k = 0; k <= half; k++){
+        int kk = k % half;
+        int mirror = (half - k) % half;
+        double a = spectrum->re[kk], b = spectrum->im[kk];
+        double c = spectrum->re[mirror], d = spectrum->im[mirror];
+        double evenRe = (a + c) / 2, evenIm = (b - d) / 2;
+        double oddRe = (b + d) / 2, oddIm = -(a - c) / 2;
+        double wr = k < half ? spectrum->twiddleRe[k] : -1;
+        double wi = k < half ? spectrum->twiddleIm[k] : 0;
+        double xRe = evenRe + wr * oddRe - wi * oddIm;
+        double xIm = evenIm + wr * oddIm + wi * oddRe;
+        double binScale = (k == 0 || k == half) ? scale / 2 : scale;
+        spectrum->magnitude[k] = sqrt(xRe * xRe + xIm * xIm) * binScale;
+    }
+}
+
+// Strongest local maxima above DC, refined by parabolic interpolation
+static void findPeaks(Spectrum_t* spectrum, Spectrum_result_t* result)
+{
+    const double* m = spectrum->magnitude;
+    for (int k = 1; k < spectrum->half; k++){
+        if (!(m[k] > m[k - 1] && m[k] >= m[k + 1])){
+            continue;
+        }
+        double curvature = m[k - 1] - 2 * m[k] + m[k + 1];
+        double offset = curvature != 0 ? 0.5 * (m[k - 1] - m[k + 1]) / curvature : 0;
+        Spectrum_peak_t peak = {
+            (k + offset) * result->resolutionHz,
+            m[k] - 0.25 * (m[k - 1] - m[k + 1]) * offset,
+        };
+        if (result->numPeaks == SPECTRUM_MAX_PEAKS && result->peaks[SPECTRUM_MAX_PEAKS - 1].magnitude >= peak.magnitude){
+            continue;
+        }
+        // Insert in order, dropping the weakest when the list is full
+        int slot = result->numPeaks < SPECTRUM_MAX_PEAKS ? result->numPeaks++ : SPECTRUM_MAX_PEAKS - 1;
+        while (slot > 0 && result->peaks[slot - 1].magnitude < peak.magnitude){
+            result->peaks[slot] = result->peaks[slot - 1];
+            slot--;
+        }
+        result->peaks[slot] = peak;
+    }
+}
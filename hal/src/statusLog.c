@@ -0,0 +1,228 @@
+// statusLog.c
+// Lock-free status record ring with a low-priority writer thread (see statusLog.h)
+//
+// The ring is a bounded multi-producer queue: each slot carries a sequence
+// number telling producers when it is free and the writer when it is filled.
+
+#define _DEFAULT_SOURCE
+#include "hal/statusLog.h"
+#include "hal/timing.h"
+#include "hal/metrics.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define RING_CAPACITY 64 // must be a power of two
+#define WRITE_BATCH 16
+#define FORMATTED_LEN 512
+#define WRITER_IDLE_MS 20
+#define WRITER_NICE 19
+
+typedef enum {
+    RECORD_SECOND,
+    RECORD_TEXT,
+} recordType_t;
+
+typedef struct {
+    recordType_t type;
+    union {
+        StatusLog_second_t second;
+        char text[STATUS_LOG_TEXT_LEN];
+    };
+} record_t;
+
+typedef struct {
+    atomic_size_t sequence;
+    record_t record;
+} slot_t;
+
+static slot_t ring[RING_CAPACITY];
+static atomic_size_t enqueuePos;
+static size_t dequeuePos;
+static Metrics_counter_t written;
+static Metrics_counter_t dropped;
+static atomic_bool isRunning;
+static bool is_initialized = false;
+static pthread_t thread;
+
+// Formatting buffers; only touched by the writer thread
+static char formatted[WRITE_BATCH][FORMATTED_LEN];
+
+static void* writeRecords();
+static bool post(const record_t* record);
+static bool takeRecord(record_t* record);
+static int formatRecord(const record_t* record, char* buffer, int bufferLen);
+static int flushBatch(void);
+
+void StatusLog_init(void)
+{
+    assert(!is_initialized);
+    is_initialized = true;
+    for (size_t i = 0; i < RING_CAPACITY; i++){
+        atomic_init(&ring[i].sequence, i);
+    }
+    atomic_init(&enqueuePos, 0);
+    dequeuePos = 0;
+    Metrics_registerCounter(&written, "light_sampler_status_records_written_total", "Status log records written to the terminal.");
+    Metrics_registerCounter(&dropped, "light_sampler_status_records_dropped_total", "Status log records dropped because the terminal fell behind.");
+    atomic_init(&isRunning, true);
+    pthread_create(&thread, NULL, writeRecords, NULL);
+}
+
+void StatusLog_cleanup(void)
+{
+    assert(is_initialized);
+    atomic_store(&isRunning, false);
+    pthread_join(thread, NULL);
+    Metrics_unregister(&written);
+    Metrics_unregister(&dropped);
+    is_initialized = false;
+}
+
+bool StatusLog_postSecond(const StatusLog_second_t* second)
+{
+    record_t record;
+    record.type = RECORD_SECOND;
+    record.second = *second;
+    return post(&record);
+}
+
+bool StatusLog_postText(const char* text)
+{
+    record_t record;
+    record.type = RECORD_TEXT;
+    snprintf(record.text, sizeof(record.text), "%s", text);
+    return post(&record);
+}
+
+long long StatusLog_getWritten(void)
+{
+    return Metrics_counterGet(&written);
+}
+
+long long StatusLog_getDropped(void)
+{
+    return Metrics_counterGet(&dropped);
+}
+
+// Producer side: claim a free slot with a CAS on the enqueue position, fill it, publish it
+static bool post(const record_t* record)
+{
+    if (!is_initialized || !atomic_load_explicit(&isRunning, memory_order_relaxed)){
+        Metrics_counterAdd(&dropped, 1);
+        return false;
+    }
+    size_t pos = atomic_load_explicit(&enqueuePos, memory_order_relaxed);
+    slot_t* slot;
+    while (true){
+        slot = &ring[pos & (RING_CAPACITY - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        long diff = (long)sequence - (long)pos;
+        if (diff == 0){
+            if (atomic_compare_exchange_weak_explicit(&enqueuePos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)){
+                break;
+            }
+        } else if (diff < 0){
+            // Ring full: the console is behind, drop rather than wait
+            Metrics_counterAdd(&dropped, 1);
+            return false;
+        } else {
+            pos = atomic_load_explicit(&enqueuePos, memory_order_relaxed);
+        }
+    }
+    slot->record = *record;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+// Consumer side (writer thread only)
+static bool takeRecord(record_t* record)
+{
+    slot_t* slot = &ring[dequeuePos & (RING_CAPACITY - 1)];
+    size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if ((long)sequence - (long)(dequeuePos + 1) < 0){
+        return false;
+    }
+    *record = slot->record;
+    atomic_store_explicit(&slot->sequence, dequeuePos + RING_CAPACITY, memory_order_release);
+    dequeuePos++;
+    return true;
+}
+
+// Writer thread: runs at the lowest priority so console I/O never competes with sampling
+static void* writeRecords()
+{
+    if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), WRITER_NICE) != 0){
+        perror("Unable to lower status log priority");
+    }
+    long long droppedReported = 0;
+    while (true){
+        bool running = atomic_load(&isRunning);
+        int numWritten = flushBatch();
+        long long droppedNow = Metrics_counterGet(&dropped);
+        if (droppedNow != droppedReported){
+            char notice[FORMATTED_LEN];
+            int length = snprintf(notice, sizeof(notice), "[status log: %lld records dropped, console too slow]\n", droppedNow - droppedReported);
+            if (write(STDOUT_FILENO, notice, length) < 0){
+                // nowhere left to report it
+            }
+            droppedReported = droppedNow;
+        }
+        if (numWritten == 0){
+            if (!running){
+                break;
+            }
+            sleepForMs(WRITER_IDLE_MS);
+        }
+    }
+    pthread_exit(NULL);
+}
+
+// Format up to WRITE_BATCH queued records and write them with one writev(); returns the count
+static int flushBatch(void)
+{
+    struct iovec iov[WRITE_BATCH];
+    int count = 0;
+    record_t record;
+    while (count < WRITE_BATCH && takeRecord(&record)){
+        iov[count].iov_base = formatted[count];
+        iov[count].iov_len = formatRecord(&record, formatted[count], FORMATTED_LEN);
+        count++;
+    }
+    if (count > 0){
+        if (writev(STDOUT_FILENO, iov, count) < 0){
+            perror("Unable to write status log");
+        }
+        Metrics_counterAdd(&written, count);
+    }
+    return count;
+}
+
+static int formatRecord(const record_t* record, char* buffer, int bufferLen)
+{
+    int length = 0;
+    if (record->type == RECORD_TEXT){
+        length = snprintf(buffer, bufferLen, "%s\n", record->text);
+        return length < bufferLen ? length : bufferLen - 1;
+    }
+    const StatusLog_second_t* s = &record->second;
+    length = snprintf(buffer, bufferLen, "#Smpl/s = %3d    POT @ %4d => %2dHz   avg = %.3fV    dips =  %2d    Smpl ms[ %.3f,  %.3f] avg %.3f/%3d    \n",
+            s->historySize, s->potReading, s->frequency, s->avgVoltage, s->dips, s->minPeriodMs, s->maxPeriodMs, s->avgPeriodMs, s->numPeriodSamples);
+    for (int i = 0; i < s->numPreview && length < bufferLen; i++){
+        if (i == 0){
+            length += snprintf(buffer + length, bufferLen - length, "  %d:%.3f", s->previewIndex[i], s->previewValue[i]);
+        } else {
+            length += snprintf(buffer + length, bufferLen - length, "  %3d:%.3f", s->previewIndex[i], s->previewValue[i]);
+        }
+    }
+    if (length < bufferLen){
+        length += snprintf(buffer + length, bufferLen - length, "\n");
+    }
+    return length < bufferLen ? length : bufferLen - 1;
+}
@@ -0,0 +1,152 @@
+// sysfs.c
+// Device file access for the HAL, with an optional simulated device tree (see sysfs.h)
+
+#include "hal/sysfs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define SYSFS_ROOT_ENV "LIGHT_SAMPLER_SYSFS_ROOT"
+
+static char root[SYSFS_MAX_PATH_LEN];
+static bool rootLoaded = false;
+
+static const char* getRoot(void);
+static FILE* openForWrite(const char* path);
+static void makeParentDirs(const char* path);
+
+void Sysfs_setRoot(const char* newRoot)
+{
+    snprintf(root, sizeof(root), "%s", newRoot ? newRoot : "");
+    rootLoaded = true;
+}
+
+bool Sysfs_isSimulated(void)
+{
+    return getRoot()[0] != 0;
+}
+
+const char* Sysfs_resolve(const char* path, char* buffer, int bufferLen)
+{
+    snprintf(buffer, bufferLen, "%s%s", getRoot(), path);
+    return buffer;
+}
+
+// From A2D guide
+int Sysfs_readInt(const char* path)
+{
+    char resolved[SYSFS_MAX_PATH_LEN];
+    // Open file
+    FILE *f = fopen(Sysfs_resolve(path, resolved, sizeof(resolved)), "r");
+    if (!f) {
+        if (Sysfs_isSimulated()) {
+            return SYSFS_SIM_DEFAULT_READING;
+        }
+        printf("ERROR: Unable to open input file %s. Cape loaded?\n", resolved);
+        printf(" Check /boot/uEnv.txt for correct options.\n");
+        exit(-1);
+    }
+    // Get reading
+    int reading = 0;
+    int itemsRead = fscanf(f, "%d", &reading);
+    if (itemsRead <= 0) {
+        printf("ERROR: Unable to read values from input file %s.\n", resolved);
+        exit(-1);
+    }
+    // Close file
+    fclose(f);
+    return reading;
+}
+
+bool Sysfs_readString(const char* path, char* buffer, int bufferLen)
+{
+    char resolved[SYSFS_MAX_PATH_LEN];
+    buffer[0] = 0;
+    FILE *f = fopen(Sysfs_resolve(path, resolved, sizeof(resolved)), "r");
+    if (!f) {
+        if (Sysfs_isSimulated()) {
+            return false;
+        }
+        printf("ERROR: Unable to open input file %s.\n", resolved);
+        exit(-1);
+    }
+    if (!fgets(buffer, bufferLen, f)) {
+        buffer[0] = 0;
+    }
+    buffer[strcspn(buffer, "\n")] = 0;
+    fclose(f);
+    return true;
+}
+
+int Sysfs_openDevice(const char* path, int flags)
+{
+    char resolved[SYSFS_MAX_PATH_LEN];
+    Sysfs_resolve(path, resolved, sizeof(resolved));
+    if (Sysfs_isSimulated()) {
+        makeParentDirs(resolved);
+        flags |= O_CREAT | O_APPEND;
+    }
+    return open(resolved, flags, 0644);
+}
+
+void Sysfs_writeInt(const char* path, int value)
+{
+    FILE *f = openForWrite(path);
+    int charWritten = fprintf(f, "%d", value);
+    if (charWritten <= 0) {
+        printf("ERROR WRITING DATA");
+        exit(1);
+    }
+    fclose(f);
+}
+
+void Sysfs_writeString(const char* path, const char* value)
+{
+    FILE *f = openForWrite(path);
+    int charWritten = fprintf(f, "%s", value);
+    if (charWritten <= 0) {
+        printf("ERROR WRITING DATA");
+        exit(1);
+    }
+    fclose(f);
+}
+
+static const char* getRoot(void)
+{
+    if (!rootLoaded) {
+        Sysfs_setRoot(getenv(SYSFS_ROOT_ENV));
+    }
+    return root;
+}
+
+static FILE* openForWrite(const char* path)
+{
+    char resolved[SYSFS_MAX_PATH_LEN];
+    Sysfs_resolve(path, resolved, sizeof(resolved));
+    if (Sysfs_isSimulated()) {
+        makeParentDirs(resolved);
+    }
+    FILE *f = fopen(resolved, "w");
+    if (!f) {
+        printf("ERROR: Unable to open file %s.\n", resolved);
+        exit(-1);
+    }
+    return f;
+}
+
+// mkdir -p for everything above the final path component
+static void makeParentDirs(const char* path)
+{
+    char partial[SYSFS_MAX_PATH_LEN];
+    snprintf(partial, sizeof(partial), "%s", path);
+    for (char* slash = strchr(partial + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = 0;
+        if (mkdir(partial, 0755) != 0 && errno != EEXIST) {
+            perror("Unable to create simulated device directory");
+        }
+        *slash = '/';
+    }
+}
@@ -0,0 +1,206 @@
+// workPool.c
+// Worker threads with per-worker deques and work stealing (see workPool.h)
+
+#include "hal/workPool.h"
+#include <assert.h>
+#include <unistd.h>
+
+static void* runWorker(void* arg);
+static void runClaimedTask(WorkPool_t* pool, int self);
+static bool pushNewest(WorkPool_deque_t* deque, const WorkPool_task_t* task);
+static bool popNewest(WorkPool_deque_t* deque, WorkPool_task_t* task);
+static bool stealOldest(WorkPool_deque_t* deque, WorkPool_task_t* task);
+
+void WorkPool_init(WorkPool_t* pool, int numThreads)
+{
+    if (numThreads < 1){
+        numThreads = 1;
+    }
+    if (numThreads > WORK_POOL_MAX_THREADS){
+        numThreads = WORK_POOL_MAX_THREADS;
+    }
+    pool->numThreads = numThreads;
+    pool->queued = 0;
+    pool->unfinished = 0;
+    pool->nextDeque = 0;
+    pool->isStopping = false;
+    pthread_mutex_init(&pool->countLock, NULL);
+    pthread_cond_init(&pool->taskQueued, NULL);
+    pthread_cond_init(&pool->allDone, NULL);
+    for (int i = 0; i < numThreads; i++){
+        WorkPool_deque_t* deque = &pool->deques[i];
+        pthread_mutex_init(&deque->lock, NULL);
+        deque->top = 0;
+        deque->bottom = 0;
+        deque->executed = 0;
+        deque->stolen = 0;
+        deque->pool = pool;
+        deque->index = i;
+    }
+    for (int i = 0; i < numThreads; i++){
+        pthread_create(&pool->threads[i], NULL, runWorker, &pool->deques[i]);
+    }
+}
+
+void WorkPool_submit(WorkPool_t* pool, WorkPool_function_t function, void* arg)
+{
+    WorkPool_task_t task = {function, arg};
+    while (true){
+        // Deal onto the next deque with room
+        int first = pool->nextDeque;
+        pool->nextDeque = (pool->nextDeque + 1) % pool->numThreads;
+        for (int i = 0; i < pool->numThreads; i++){
+            if (pushNewest(&pool->deques[(first + i) % pool->numThreads], &task)){
+                pthread_mutex_lock(&pool->countLock);
+                pool->queued++;
+                pool->unfinished++;
+                pthread_cond_signal(&pool->taskQueued);
+                pthread_mutex_unlock(&pool->countLock);
+                return;
+            }
+        }
+        // All full: help drain them rather than wait
+        pthread_mutex_lock(&pool->countLock);
+        bool claimed = pool->queued > 0;
+        if (claimed){
+            pool->queued--;
+        }
+        pthread_mutex_unlock(&pool->countLock);
+        if (claimed){
+            runClaimedTask(pool, -1);
+        }
+    }
+}
+
+void WorkPool_wait(WorkPool_t* pool)
+{
+    pthread_mutex_lock(&pool->countLock);
+    while (pool->unfinished > 0){
+        pthread_cond_wait(&pool->allDone, &pool->countLock);
+    }
+    pthread_mutex_unlock(&pool->countLock);
+}
+
+long long WorkPool_getExecuted(WorkPool_t* pool)
+{
+    long long total = 0;
+    for (int i = 0; i < pool->numThreads; i++){
+        total += pool->deques[i].executed;
+    }
+    return total;
+}
+
+long long WorkPool_getStolen(WorkPool_t* pool)
+{
+    long long total = 0;
+    for (int i = 0; i < pool->numThreads; i++){
+        total += pool->deques[i].stolen;
+    }
+    return total;
+}
+
+void WorkPool_cleanup(WorkPool_t* pool)
+{
+    WorkPool_wait(pool);
+    pthread_mutex_lock(&pool->countLock);
+    pool->isStopping = true;
+    pthread_cond_broadcast(&pool->taskQueued);
+    pthread_mutex_unlock(&pool->countLock);
+    for (int i = 0; i < pool->numThreads; i++){
+        pthread_join(pool->threads[i], NULL);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+    pthread_mutex_destroy(&pool->countLock);
+    pthread_cond_destroy(&pool->taskQueued);
+    pthread_cond_destroy(&pool->allDone);
+}
+
+int WorkPool_getNumCpus(void)
+{
+    long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return numCpus > 0 ? (int)numCpus : 1;
+}
+
+// Worker thread body: sleep until a task is queued, claim it, run it
+static void* runWorker(void* arg)
+{
+    WorkPool_deque_t* own = arg;
+    WorkPool_t* pool = own->pool;
+    while (true){
+        pthread_mutex_lock(&pool->countLock);
+        while (pool->queued == 0 && !pool->isStopping){
+            pthread_cond_wait(&pool->taskQueued, &pool->countLock);
+        }
+        if (pool->queued == 0){
+            pthread_mutex_unlock(&pool->countLock);
+            break;
+        }
+        pool->queued--;
+        pthread_mutex_unlock(&pool->countLock);
+        runClaimedTask(pool, own->index);
+    }
+    return NULL;
+}
+
+// Find and run the task claimed by decrementing `queued`. Tasks are pushed
+// before they are counted and each claim takes exactly one, so a claimed task
+// is always somewhere in the deques. `self` is the worker's index, or -1.
+static void runClaimedTask(WorkPool_t* pool, int self)
+{
+    WorkPool_task_t task;
+    bool found = self >= 0 && popNewest(&pool->deques[self], &task);
+    bool isStolen = !found;
+    int start = self >= 0 ? self + 1 : 0;
+    for (int i = 0; !found; i++){
+        found = stealOldest(&pool->deques[(start + i) % pool->numThreads], &task);
+    }
+    task.function(task.arg);
+    if (self >= 0){
+        pool->deques[self].executed++;
+        pool->deques[self].stolen += isStolen ? 1 : 0;
+    }
+
+    pthread_mutex_lock(&pool->countLock);
+    assert(pool->unfinished > 0);
+    pool->unfinished--;
+    if (pool->unfinished == 0){
+        pthread_cond_broadcast(&pool->allDone);
+    }
+    pthread_mutex_unlock(&pool->countLock);
+}
+
+static bool pushNewest(WorkPool_deque_t* deque, const WorkPool_task_t* task)
+{
+    pthread_mutex_lock(&deque->lock);
+    bool hasRoom = deque->bottom - deque->top < WORK_POOL_DEQUE_CAPACITY;
+    if (hasRoom){
+        deque->tasks[deque->bottom % WORK_POOL_DEQUE_CAPACITY] = *task;
+        deque->bottom++;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return hasRoom;
+}
+
+static bool popNewest(WorkPool_deque_t* deque, WorkPool_task_t* task)
+{
+    pthread_mutex_lock(&deque->lock);
+    bool hasTask = deque->bottom > deque->top;
+    if (hasTask){
+        deque->bottom--;
+        *task = deque->tasks[deque->bottom % WORK_POOL_DEQUE_CAPACITY];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return hasTask;
+}
+
+static bool stealOldest(WorkPool_deque_t* deque, WorkPool_task_t* task)
+{
+    pthread_mutex_lock(&deque->lock);
+    bool hasTask = deque->bottom > deque->top;
+    if (hasTask){
+        *task = deque->tasks[deque->top % WORK_POOL_DEQUE_CAPACITY];
+        deque->top++;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return hasTask;
+}
@@ -0,0 +1,123 @@
+"""Light Sampler fleet collector load test
+
+Starts N light_sampler instances on localhost. Each one gets its own
+simulated device tree and its own command and metrics ports
+(LIGHT_SAMPLER_PORT, LIGHT_SAMPLER_METRICS_PORT). The test then runs
+light_sampler_collector against all of them. For each board count it
+reports datagrams/s and samples/s ingested, lost blocks, the collector's
+ingest cost and CPU use, and its fleet summary.
+
+RUN
+ python3 tools/collectorLoad.py path/to/light_sampler path/to/light_sampler_collector [--boards 1,4,16,64] [--seconds 5]
+"""
+
+import argparse
+import os
+import re
+import shutil
+import socket
+import subprocess
+import tempfile
+import time
+
+HOST = "127.0.0.1"
+BASE_PORT = 13000
+BASE_METRICS_PORT = 14000
+QUERY_PORT = 12400
+STATS_RE = re.compile(r"uptime (\d+)ms, boards (\d+), datagrams (\d+), samples (\d+), lost blocks (\d+)\n"
+                      r"parse errors (\d+), unknown senders (\d+), ingest (\d+)ns per datagram, cpu (\d+)ms")
+
+
+def query(command):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(1.0)
+    sock.sendto(command.encode(), (HOST, QUERY_PORT))
+    text = sock.recv(65536).decode()
+    # Long replies span several datagrams; collect until the socket goes quiet
+    sock.settimeout(0.1)
+    try:
+        while True:
+            text += sock.recv(65536).decode()
+    except socket.timeout:
+        pass
+    sock.close()
+    return text
+
+
+def stats():
+    match = STATS_RE.search(query("stats"))
+    uptime, boards, datagrams, samples, lost, errors, unknown, ingest, cpu = (int(value) for value in match.groups())
+    return {"uptime": uptime, "datagrams": datagrams, "samples": samples, "lost": lost,
+            "errors": errors, "ingest": ingest, "cpu": cpu}
+
+
+def measure(sampler, collector, numBoards, seconds):
+    simRoots = []
+    boards = []
+    collectorProcess = None
+    try:
+        for i in range(numBoards):
+            simRoot = tempfile.mkdtemp(prefix="light_sampler_sim_")
+            simRoots.append(simRoot)
+            env = dict(os.environ, LIGHT_SAMPLER_SYSFS_ROOT=simRoot, LIGHT_SAMPLER_PORT=str(BASE_PORT + i),
+                       LIGHT_SAMPLER_METRICS_PORT=str(BASE_METRICS_PORT + i), LIGHT_SAMPLER_SHM="off")
+            boards.append(subprocess.Popen([sampler], env=env, stdout=subprocess.DEVNULL))
+        time.sleep(1.5)
+        addresses = [f"{HOST}:{BASE_PORT + i}" for i in range(numBoards)]
+        collectorProcess = subprocess.Popen([collector, "--port", str(QUERY_PORT)] + addresses,
+                                            stdout=subprocess.DEVNULL)
+        time.sleep(2.5)  # subscriptions settle and the first seconds complete
+        before = stats()
+        time.sleep(seconds)
+        after = stats()
+        summary = query("fleet")
+        stragglers = query("stragglers")
+        query("stop")
+        collectorProcess.wait(timeout=5)
+    finally:
+        if collectorProcess and collectorProcess.poll() is None:
+            collectorProcess.kill()
+        for i, board in enumerate(boards):
+            control = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            control.sendto(b"stop", (HOST, BASE_PORT + i))
+        for board in boards:
+            try:
+                board.wait(timeout=5)
+            except subprocess.TimeoutExpired:
+                board.kill()
+        for simRoot in simRoots:
+            shutil.rmtree(simRoot, ignore_errors=True)
+    elapsed = (after["uptime"] - before["uptime"]) / 1000
+    return {
+        "datagrams": (after["datagrams"] - before["datagrams"]) / elapsed,
+        "samples": (after["samples"] - before["samples"]) / elapsed,
+        "lost": after["lost"] - before["lost"],
+        "errors": after["errors"],
+        "ingest": after["ingest"],
+        "cpu": 100 * (after["cpu"] - before["cpu"]) / 1000 / elapsed,
+        "summary": summary,
+        "stragglers": stragglers,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("sampler")
+    parser.add_argument("collector")
+    parser.add_argument("--boards", default="1,4,16,64")
+    parser.add_argument("--seconds", type=float, default=5)
+    parser.add_argument("--verbose", action="store_true", help="print each run's fleet summary and stragglers")
+    args = parser.parse_args()
+
+    print(f"{'boards':>7} {'datagrams/s':>12} {'samples/s':>10} {'lost':>6} {'errors':>7} {'ns/datagram':>12} {'cpu %':>6}")
+    for numBoards in (int(count) for count in args.boards.split(",")):
+        result = measure(args.sampler, args.collector, numBoards, args.seconds)
+        print(f"{numBoards:>7} {result['datagrams']:>12.0f} {result['samples']:>10.0f} {result['lost']:>6}"
+              f" {result['errors']:>7} {result['ingest']:>12} {result['cpu']:>6.1f}")
+        if args.verbose:
+            print(result["summary"] + result["stragglers"])
+
+
+if __name__ == "__main__":
+    main()
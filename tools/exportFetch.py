@@ -0,0 +1,125 @@
+# Light Sampler bulk export client
+#
+# Downloads archived samples or the trace file from the export server
+# (app/include/exportServer.h) to a file. A reply that is cut short is
+# resumed from the first sample or byte that did not arrive. With --append,
+# an existing output file is resumed in the same way, across runs.
+# Samples are written as raw little-endian float32 volts.
+#
+# RUN
+#  python3 tools/exportFetch.py samples out.f32 [--first N] [--count N]
+#  python3 tools/exportFetch.py trace out.trace [--append]
+#  ... [--host 127.0.0.1] [--port 12347] [--unix /path/to/socket]
+
+import argparse
+import os
+import socket
+import struct
+import time
+
+SAMPLE_BYTES = 4
+MAX_ATTEMPTS = 10
+
+
+def connect(args):
+    if args.unix:
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(args.unix)
+    else:
+        sock = socket.create_connection((args.host, args.port))
+    return sock
+
+
+def request(args, command, out):
+    """Send one request, stream the payload into `out`; returns (header fields, payload bytes)."""
+    with connect(args) as sock:
+        sock.sendall(command.encode())
+        data = b""
+        while b"\n" not in data:
+            chunk = sock.recv(4096)
+            if not chunk:
+                raise SystemExit(f"no reply to '{command}'")
+            data += chunk
+        line, payload = data.split(b"\n", 1)
+        fields = line.decode().split()
+        if fields[0] == "error":
+            raise SystemExit(line.decode())
+        out.write(payload)
+        received = len(payload)
+        while True:
+            chunk = sock.recv(1 << 20)
+            if not chunk:
+                break
+            out.write(chunk)
+            received += len(chunk)
+    return fields, received
+
+
+def fetch_samples(args, out):
+    first = args.first
+    remaining = args.count
+    total = 0
+    for _ in range(MAX_ATTEMPTS):
+        command = f"samples {first} {remaining}" if remaining >= 0 else f"samples {first}"
+        fields, received = request(args, command, out)
+        served_first, count = int(fields[1]), int(fields[2])
+        if total == 0:
+            print(f"first sample {served_first}")
+        elif served_first != first:
+            print(f"resumed at sample {served_first}: {served_first - first} samples were overwritten")
+        got = received // SAMPLE_BYTES
+        # A partial sample at a cut is dropped and asked for again
+        out.truncate(out.tell() - received % SAMPLE_BYTES)
+        out.seek(0, os.SEEK_END)
+        total += got
+        if got >= count:
+            return total
+        first = served_first + got
+        remaining = -1 if remaining < 0 else remaining - got
+        time.sleep(0.1)
+    raise SystemExit(f"gave up after {MAX_ATTEMPTS} attempts")
+
+
+def fetch_trace(args, out):
+    offset = out.tell()
+    for _ in range(MAX_ATTEMPTS):
+        fields, received = request(args, f"trace {offset}", out)
+        length, total = int(fields[2]), int(fields[3])
+        offset += received
+        if received >= length:
+            return offset, total
+        time.sleep(0.1)
+    raise SystemExit(f"gave up after {MAX_ATTEMPTS} attempts")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("what", choices=["samples", "trace"])
+    parser.add_argument("output")
+    parser.add_argument("--first", type=int, default=0)
+    parser.add_argument("--count", type=int, default=-1)
+    parser.add_argument("--append", action="store_true")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=12347)
+    parser.add_argument("--unix")
+    args = parser.parse_args()
+
+    mode = "ab" if args.append else "wb"
+    with open(args.output, mode) as out:
+        out.seek(0, os.SEEK_END)
+        start = time.monotonic()
+        if args.what == "samples":
+            samples = fetch_samples(args, out)
+            size = samples * SAMPLE_BYTES
+        else:
+            size, total = fetch_trace(args, out)
+        elapsed = time.monotonic() - start
+    print(f"wrote {size} bytes to {args.output} in {elapsed * 1000:.0f}ms")
+    if args.what == "samples" and samples > 0:
+        with open(args.output, "rb") as f:
+            f.seek(-SAMPLE_BYTES, os.SEEK_END)
+            print(f"last sample {struct.unpack('<f', f.read())[0]:.3f}V")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,118 @@
+"""Light Sampler end-to-end latency harness
+
+Starts light_sampler against a simulated device tree, drives it with several
+concurrent UDP clients, and reports:
+  - client round-trip time per request
+  - server-stamped data age (sample acquisition -> reply send), via `stamp on`
+  - the server's own `latency` histograms
+
+RUN
+ python3 tools/latencyHarness.py path/to/light_sampler [--clients 4] [--seconds 10]
+"""
+
+import argparse
+import os
+import re
+import shutil
+import socket
+import subprocess
+import tempfile
+import threading
+import time
+
+HOST = "127.0.0.1"
+PORT = 12345
+COMMANDS = ["history", "count", "dips", "window 0", "window 2"]
+STAMP_RE = re.compile(r"#stamp .*age_us=(-?\d+)")
+
+
+def percentile(values, fraction):
+    if not values:
+        return 0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def summarize(title, values, unit):
+    if not values:
+        print(f"{title}: no samples")
+        return
+    print(f"{title}: n={len(values)} p50={percentile(values, 0.5):.0f}{unit} "
+          f"p90={percentile(values, 0.9):.0f}{unit} p99={percentile(values, 0.99):.0f}{unit} "
+          f"max={max(values):.0f}{unit}")
+
+
+def request(sock, command, timeout=0.5):
+    """Send one command; collect datagrams until the socket goes quiet.
+    Returns the reply text and the round trip to its last datagram in us."""
+    start = time.monotonic_ns()
+    sock.sendto((command + "\n").encode(), (HOST, PORT))
+    sock.settimeout(timeout)
+    chunks = []
+    lastArrival = start
+    try:
+        while True:
+            data, _ = sock.recvfrom(4096)
+            lastArrival = time.monotonic_ns()
+            chunks.append(data.decode())
+            sock.settimeout(0.02)
+    except socket.timeout:
+        pass
+    return "".join(chunks), (lastArrival - start) / 1000
+
+
+def client(stopAt, rttUs, ageUs, lock):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    i = 0
+    while time.monotonic() < stopAt:
+        command = COMMANDS[i % len(COMMANDS)]
+        i += 1
+        reply, elapsed = request(sock, command)
+        match = STAMP_RE.search(reply)
+        with lock:
+            rttUs.append(elapsed)
+            if match:
+                ageUs.append(int(match.group(1)))
+    sock.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("binary")
+    parser.add_argument("--clients", type=int, default=4)
+    parser.add_argument("--seconds", type=float, default=10)
+    args = parser.parse_args()
+
+    simRoot = tempfile.mkdtemp(prefix="light_sampler_sim_")
+    env = dict(os.environ, LIGHT_SAMPLER_SYSFS_ROOT=simRoot)
+    server = subprocess.Popen([args.binary], env=env, stdout=subprocess.DEVNULL)
+    try:
+        time.sleep(2.5)  # let a couple of windows complete
+        control = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        request(control, "stamp on")
+
+        rttUs, ageUs, lock = [], [], threading.Lock()
+        stopAt = time.monotonic() + args.seconds
+        threads = [threading.Thread(target=client, args=(stopAt, rttUs, ageUs, lock))
+                   for _ in range(args.clients)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+
+        print(f"{args.clients} clients for {args.seconds}s "
+              f"({len(rttUs) / args.seconds:.0f} requests/s)")
+        summarize("client round trip", rttUs, "us")
+        summarize("stamped data age", ageUs, "us")
+        print(request(control, "latency")[0].rstrip())
+        request(control, "stop")
+        server.wait(timeout=5)
+    finally:
+        if server.poll() is None:
+            server.kill()
+        shutil.rmtree(simRoot, ignore_errors=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,112 @@
+"""Light Sampler reply-cache load test
+
+Starts light_sampler against a simulated device tree, with the per-second
+reply cache on and then off (LIGHT_SAMPLER_REPLY_CACHE=off). For each client
+count, several client processes poll `history`, `length` and `dips` as fast
+as the server answers. The test reports requests/s for each count, and the
+server's cache hit/miss counters from the metrics endpoint.
+
+Each client pipelines the three commands and waits for the `dips` reply.
+The server answers in order, so that reply marks the end of the cycle.
+
+RUN
+ python3 tools/replyLoad.py path/to/light_sampler [--clients 1,2,4,8] [--seconds 5]
+"""
+
+import argparse
+import multiprocessing
+import os
+import re
+import shutil
+import socket
+import subprocess
+import tempfile
+import time
+
+HOST = "127.0.0.1"
+PORT = 12345
+METRICS_PORT = 12346
+CYCLE = ["history", "length", "dips"]
+METRIC_RE = re.compile(r"^(light_sampler_reply_cache_\w+_total) (\d+)$", re.M)
+
+
+def client(stopAt, results):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(1.0)
+    cycles = 0
+    try:
+        while time.monotonic() < stopAt:
+            for command in CYCLE:
+                sock.sendto(command.encode(), (HOST, PORT))
+            while not sock.recv(4096).startswith(b"# Dips: "):
+                pass
+            cycles += 1
+    except socket.timeout:
+        pass
+    sock.close()
+    results.put(cycles * len(CYCLE))
+
+
+def run(clients, seconds):
+    results = multiprocessing.Queue()
+    stopAt = time.monotonic() + seconds
+    workers = [multiprocessing.Process(target=client, args=(stopAt, results)) for _ in range(clients)]
+    for worker in workers:
+        worker.start()
+    total = sum(results.get() for _ in workers)
+    for worker in workers:
+        worker.join()
+    return total / seconds
+
+
+def scrape():
+    with socket.create_connection((HOST, METRICS_PORT), timeout=2) as sock:
+        sock.sendall(b"\n")
+        text = b""
+        while chunk := sock.recv(65536):
+            text += chunk
+    return dict((name, int(value)) for name, value in METRIC_RE.findall(text.decode()))
+
+
+def measure(binary, cacheSetting, clientCounts, seconds):
+    simRoot = tempfile.mkdtemp(prefix="light_sampler_sim_")
+    env = dict(os.environ, LIGHT_SAMPLER_SYSFS_ROOT=simRoot, LIGHT_SAMPLER_REPLY_CACHE=cacheSetting,
+               LIGHT_SAMPLER_SHM="off")
+    server = subprocess.Popen([binary], env=env, stdout=subprocess.DEVNULL)
+    rates = []
+    try:
+        time.sleep(2.5)  # let the history fill
+        for clients in clientCounts:
+            rates.append(run(clients, seconds))
+        counters = scrape()
+        control = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        control.sendto(b"stop", (HOST, PORT))
+        server.wait(timeout=5)
+    finally:
+        if server.poll() is None:
+            server.kill()
+        shutil.rmtree(simRoot, ignore_errors=True)
+    return rates, counters
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("binary")
+    parser.add_argument("--clients", default="1,2,4,8")
+    parser.add_argument("--seconds", type=float, default=5)
+    args = parser.parse_args()
+    clientCounts = [int(count) for count in args.clients.split(",")]
+
+    cached, cachedCounters = measure(args.binary, "on", clientCounts, args.seconds)
+    uncached, _ = measure(args.binary, "off", clientCounts, args.seconds)
+    print(f"{'clients':>8} {'cache on req/s':>16} {'cache off req/s':>16} {'speedup':>8}")
+    for clients, on, off in zip(clientCounts, cached, uncached):
+        print(f"{clients:>8} {on:>16.0f} {off:>16.0f} {on / off if off else 0:>7.2f}x")
+    hits = cachedCounters.get("light_sampler_reply_cache_hits_total", 0)
+    misses = cachedCounters.get("light_sampler_reply_cache_misses_total", 0)
+    print(f"cache on: {hits} hits, {misses} misses ({100 * hits / max(1, hits + misses):.2f}% hit rate)")
+
+
+if __name__ == "__main__":
+    main()
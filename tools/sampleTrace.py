@@ -0,0 +1,148 @@
+"""Light Sampler trace tool
+
+Writes and inspects the binary A2D traces read by LIGHT_SAMPLER_TRACE_REPLAY
+(format in hal/include/hal/sampleTrace.h).
+
+  synth: a synthetic light level with regular dips, for replay without a board;
+         --step AT:VOLTS and --fade FROM:TO:VOLTS (seconds) shift the level
+  info:  sample count, duration, period spread and A2D range of a trace
+
+RUN
+ python3 tools/sampleTrace.py synth out.trace [--seconds 60] [--dips-per-second 3] [--period-us 1060]
+                                             [--flicker-hz 51] [--step 20:0.1] [--fade 40:50:-0.1]
+ python3 tools/sampleTrace.py info out.trace
+ LIGHT_SAMPLER_TRACE_REPLAY=out.trace LIGHT_SAMPLER_TRACE_SPEED=max light_sampler
+"""
+
+import argparse
+import random
+import struct
+
+MAGIC = b"LSTRACE1"
+VERSION = 1
+A2D_MAX_READING = 4095
+HEADER = struct.Struct("<8sIIq")
+
+
+def varint(value):
+    out = bytearray()
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def level_shift(args, time_us):
+    """Volts added to the base level at `time_us` by the --step and --fade options."""
+    seconds = time_us / 1e6
+    shift = 0.0
+    for step in args.step:
+        at, volts = (float(x) for x in step.split(":"))
+        if seconds >= at:
+            shift += volts
+    for fade in args.fade:
+        start, end, volts = (float(x) for x in fade.split(":"))
+        if seconds >= start:
+            shift += volts * min(1.0, (seconds - start) / (end - start))
+    return shift
+
+
+def synth(args):
+    rng = random.Random(args.seed)
+    base = int(0.9 / 1.8 * A2D_MAX_READING)
+    dip_depth = int(0.3 / 1.8 * A2D_MAX_READING)
+    flicker_depth = int(args.flicker_volts / 1.8 * A2D_MAX_READING)
+    num_samples = int(args.seconds * 1e6 / args.period_us)
+    dip_every_us = 1e6 / args.dips_per_second if args.dips_per_second > 0 else None
+    body = bytearray()
+    time_us = 0
+    for i in range(num_samples):
+        delta = 0 if i == 0 else args.period_us + rng.randint(0, args.jitter_us)
+        time_us += delta
+        reading = base + int(level_shift(args, time_us) / 1.8 * A2D_MAX_READING) + rng.randint(-10, 10)
+        if dip_every_us and time_us % dip_every_us < args.dip_length_us:
+            reading -= dip_depth
+        if args.flicker_hz > 0 and (time_us * args.flicker_hz // 500000) % 2 == 0:
+            # Square-wave LED flicker (50% duty) on top of the ambient level
+            reading += flicker_depth
+        body += varint(delta) + struct.pack("<H", max(0, min(A2D_MAX_READING, reading)))
+    with open(args.trace, "wb") as f:
+        f.write(HEADER.pack(MAGIC, VERSION, A2D_MAX_READING, 0))
+        f.write(body)
+    print(f"wrote {num_samples} samples ({time_us / 1e6:.1f}s) to {args.trace}: {HEADER.size + len(body)} bytes")
+
+
+def read_records(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version, _, _ = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise SystemExit(f"{path}: not a version {VERSION} light sampler trace")
+    pos = HEADER.size
+    time_us = 0
+    while pos < len(data):
+        delta = shift = 0
+        while pos < len(data) and data[pos] & 0x80:
+            delta |= (data[pos] & 0x7F) << shift
+            shift += 7
+            pos += 1
+        if pos + 3 > len(data):
+            break
+        delta |= data[pos] << shift
+        reading = struct.unpack_from("<H", data, pos + 1)[0]
+        pos += 3
+        time_us += delta
+        yield time_us, delta, reading
+
+
+def info(args):
+    count = 0
+    deltas = []
+    low = A2D_MAX_READING
+    high = 0
+    last_us = 0
+    for time_us, delta, reading in read_records(args.trace):
+        if count > 0:
+            deltas.append(delta)
+        count += 1
+        low = min(low, reading)
+        high = max(high, reading)
+        last_us = time_us
+    if count == 0:
+        print("empty trace")
+        return
+    deltas.sort()
+    print(f"samples={count} duration={last_us / 1e6:.3f}s a2d=[{low}, {high}]")
+    if deltas:
+        print(f"period_us min={deltas[0]} p50={deltas[len(deltas) // 2]} "
+              f"p99={deltas[int(0.99 * (len(deltas) - 1))]} max={deltas[-1]}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+    synth_parser = commands.add_parser("synth")
+    synth_parser.add_argument("trace")
+    synth_parser.add_argument("--seconds", type=float, default=60)
+    synth_parser.add_argument("--period-us", type=int, default=1060)
+    synth_parser.add_argument("--jitter-us", type=int, default=40)
+    synth_parser.add_argument("--dips-per-second", type=float, default=3)
+    synth_parser.add_argument("--dip-length-us", type=int, default=20000)
+    synth_parser.add_argument("--flicker-hz", type=float, default=0)
+    synth_parser.add_argument("--flicker-volts", type=float, default=0.05)
+    synth_parser.add_argument("--seed", type=int, default=1)
+    synth_parser.add_argument("--step", action="append", default=[], metavar="AT:VOLTS")
+    synth_parser.add_argument("--fade", action="append", default=[], metavar="FROM:TO:VOLTS")
+    info_parser = commands.add_parser("info")
+    info_parser.add_argument("trace")
+    args = parser.parse_args()
+    if args.command == "synth":
+        synth(args)
+    else:
+        info(args)
+
+
+if __name__ == "__main__":
+    main()
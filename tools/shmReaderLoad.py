@@ -0,0 +1,104 @@
+"""Light Sampler shared-memory reader test
+
+Starts light_sampler against a simulated device tree, exporting under a
+segment name of its own (LIGHT_SAMPLER_SHM). It then runs N
+light_sampler_shm_reader processes beside it for a fixed time. One more
+reader follows the export until the sampler shuts down, so the closed flag
+is covered too.
+
+A reader exits non-zero when it sees a torn or misordered block. The test
+fails if any reader exits non-zero, reports a continuity error, reads no
+blocks, or the last reader does not see the shutdown. It reports blocks
+read, blocks lost to falling behind, and publish-to-read latency per reader.
+
+RUN
+ python3 tools/shmReaderLoad.py path/to/light_sampler path/to/light_sampler_shm_reader [--readers 4] [--seconds 5]
+"""
+
+import argparse
+import os
+import re
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+
+HOST = "127.0.0.1"
+PORT = 12360
+METRICS_PORT = 12361
+EXPORT_PORT = 12362
+RESULT_RE = re.compile(r"shm reader: (\d+) blocks \(\d+ samples\), (\d+) lost, (\d+) errors; "
+                       r"publish-to-read latency p50 (\d+)us p99 (\d+)us max (\d+)us( \(sampler shut down\))?")
+
+
+def check(name, process, expectShutdown):
+    output, _ = process.communicate(timeout=10)
+    match = RESULT_RE.search(output.decode())
+    if not match:
+        return f"{name}: no result line (exit {process.returncode})"
+    blocks, lost, errors, p50, p99, worst = (int(value) for value in match.groups()[:6])
+    print(f"{name:>9} {blocks:>8} {lost:>6} {errors:>7} {p50:>8} {p99:>8} {worst:>8}")
+    if process.returncode != 0 or errors > 0:
+        return f"{name}: exit {process.returncode}, {errors} continuity errors"
+    if blocks == 0:
+        return f"{name}: read no blocks"
+    if expectShutdown and not match.group(7):
+        return f"{name}: did not see the sampler shut down"
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("sampler")
+    parser.add_argument("reader")
+    parser.add_argument("--readers", type=int, default=4)
+    parser.add_argument("--seconds", type=float, default=5)
+    args = parser.parse_args()
+
+    segment = f"/light_sampler_test_{os.getpid()}"
+    simRoot = tempfile.mkdtemp(prefix="light_sampler_sim_")
+    env = dict(os.environ, LIGHT_SAMPLER_SYSFS_ROOT=simRoot, LIGHT_SAMPLER_SHM=segment,
+               LIGHT_SAMPLER_PORT=str(PORT), LIGHT_SAMPLER_METRICS_PORT=str(METRICS_PORT),
+               LIGHT_SAMPLER_EXPORT_PORT=str(EXPORT_PORT))
+    sampler = subprocess.Popen([args.sampler], env=env, stdout=subprocess.DEVNULL)
+    readers = []
+    follower = None
+    failures = []
+    try:
+        # Readers wait for the segment to appear, so they can start with the sampler
+        for i in range(args.readers):
+            readers.append(subprocess.Popen([args.reader, "--name", segment, "--seconds", str(args.seconds), "--quiet"],
+                                            stdout=subprocess.PIPE))
+        follower = subprocess.Popen([args.reader, "--name", segment, "--quiet"], stdout=subprocess.PIPE)
+
+        print(f"{'reader':>9} {'blocks':>8} {'lost':>6} {'errors':>7} {'p50 us':>8} {'p99 us':>8} {'max us':>8}")
+        for i, reader in enumerate(readers):
+            failure = check(f"reader {i}", reader, False)
+            if failure:
+                failures.append(failure)
+
+        control = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        control.sendto(b"stop", (HOST, PORT))
+        sampler.wait(timeout=5)
+        failure = check("follower", follower, True)
+        if failure:
+            failures.append(failure)
+    finally:
+        for process in readers + [follower, sampler]:
+            if process and process.poll() is None:
+                process.kill()
+        shutil.rmtree(simRoot, ignore_errors=True)
+
+    if sampler.returncode != 0:
+        failures.append(f"sampler exited with {sampler.returncode}")
+    for failure in failures:
+        print("FAIL: " + failure)
+    if failures:
+        sys.exit(1)
+    print("PASS")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,629 @@
+// analyze.c
+// Offline dip analysis of a recorded A2D trace (see hal/sampleTrace.h) for one
+// or more detector settings, on a work-stealing pool across all cores.
+//
+// The trace is cut into seconds exactly as the sampler's history does it (a
+// second ends once a sample is 1000ms after the second's first sample), and
+// the seconds are grouped into chunks of about --chunk-samples samples. The
+// reading thread decodes the trace (the format is inherently sequential) and
+// keeps each setting's smoothed average running from chunk to chunk with
+// DipDetector_advanceAverage, which is cheap. So every chunk starts with the
+// exact average the sampler would have had there. Workers then run the
+// detector and per-second statistics, one task per chunk and setting.
+//
+// The other carried state, whether a chunk starts inside a dip, is only known
+// once the chunk before it is done. Each chunk is run as if it starts outside
+// a dip, with a second detector alongside it that starts inside one. The two
+// share the average, so once their dip states agree they agree for the rest of
+// the chunk; that is usually within a few samples. Until then, the dips they
+// count differently are recorded as adjustments. The chunks are then stitched
+// in order, applying the adjustments where a chunk did start inside a dip, so
+// the results match a single-threaded run exactly. A chunk whose starts never
+// agree, or disagree too often to record, is simply rerun while stitching.
+// --verify checks all this against a plain per-sample run.
+//
+// Settings take comma-separated lists; every combination is analyzed in the
+// same pass over the trace, e.g. --threshold 0.05,0.1,0.15 --hysteresis 0.03,0.07.
+//
+// Usage: light_sampler_analyze trace [--threads N] [--threshold V,...] [--hysteresis V,...]
+//                              [--smoothing W,...] [--chunk-samples N] [--seconds]
+//                              [--verify] [--scaling]
+
+#include "hal/calibration.h"
+#include "hal/dipDetector.h"
+#include "hal/sampleTrace.h"
+#include "hal/timing.h"
+#include "hal/workPool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define US_PER_MS 1000
+#define NS_PER_SECOND 1000000000LL
+#define HISTORY_WINDOW_MS 1000
+#define DEFAULT_CHUNK_SAMPLES 16384
+#define MAX_CONFIGS 16
+#define MAX_LIST_VALUES 16
+#define MAX_ADJUSTMENTS 8
+// Samples decoded before the finished chunks are stitched and the buffer reused
+#define SEGMENT_SAMPLES (1 << 22)
+#define SEGMENT_SECONDS 16384
+#define SEGMENT_CHUNKS 1024
+
+// One second of the trace, like a completed history second in the sampler
+typedef struct {
+    long long startMs;      // time of its first sample since the start of the trace
+    int numSamples;
+    double sum;
+    double min;
+    double max;
+} secondStats_t;
+
+// What one detector setting found in a second
+typedef struct {
+    int dips;
+    double average;         // smoothed level after the second's last sample
+} secondDips_t;
+
+typedef struct {
+    int numSeconds;
+    int capacity;
+    long long numSamples;
+    secondStats_t* seconds;
+    secondDips_t* dips[MAX_CONFIGS];
+    long long numDips[MAX_CONFIGS];
+} analysis_t;
+
+struct chunk;
+
+// A second's dip count if the chunk started inside a dip
+typedef struct {
+    int second;
+    int dips;               // added to the count of the start outside a dip
+} adjustment_t;
+
+// One detector setting over one chunk
+typedef struct {
+    struct chunk* chunk;
+    int config;
+    double startAverage;
+    bool endDipAllowed;     // state after the chunk
+    bool isMerged;          // a start inside a dip reaches the same state within the chunk
+    int numAdjustments;     // more than MAX_ADJUSTMENTS: rerun instead
+    adjustment_t adjustments[MAX_ADJUSTMENTS];
+} chunkRun_t;
+
+// A run of whole seconds
+typedef struct chunk {
+    int firstSample;        // within the segment
+    int firstSecond;        // within the segment
+    int numSeconds;
+    chunkRun_t runs[MAX_CONFIGS];
+} chunk_t;
+
+static DipDetector_config_t configs[MAX_CONFIGS];
+static int numConfigs = 0;
+static int chunkSamples = DEFAULT_CHUNK_SAMPLES;
+static double segmentVolts[SEGMENT_SAMPLES];
+static secondStats_t segmentSeconds[SEGMENT_SECONDS];
+static secondDips_t segmentDips[MAX_CONFIGS][SEGMENT_SECONDS];
+static int secondFirstSample[SEGMENT_SECONDS];
+static chunk_t chunks[SEGMENT_CHUNKS];
+
+// Reading-thread state of the parallel run
+static WorkPool_t pool;
+static int segmentUsed;
+static int numSegmentSeconds;
+static int numChunks;
+static int chunkFirstSample;
+static int chunkFirstSecond;
+static double chunkAverages[MAX_CONFIGS];
+static bool dipAllowed[MAX_CONFIGS];
+static long long numReruns;
+
+static void parseConfigs(const char* thresholds, const char* hystereses, const char* smoothings);
+static int parseList(const char* text, double* values);
+static void analyzeParallel(const char* path, int numThreads, analysis_t* analysis);
+static void analyzeSequential(const char* path, analysis_t* analysis);
+static void analyzeRun(void* arg);
+static void detectChunk(chunkRun_t* run, bool startDipAllowed);
+static void closeChunk(int endSample, int endSecond);
+static void flushSegment(int keepSecond, analysis_t* analysis);
+static void appendSecond(analysis_t* analysis, const secondStats_t* second, const secondDips_t* dips, int stride);
+static void openTrace(SampleTrace_reader_t* reader, const char* path);
+static void closeTrace(SampleTrace_reader_t* reader, const char* path);
+static double a2dToVoltage(int a2dReading);
+static bool compareAnalyses(const analysis_t* expected, const analysis_t* actual);
+static void printSeconds(const analysis_t* analysis);
+static void freeAnalysis(analysis_t* analysis);
+
+int main(int argc, char* argv[])
+{
+    const char* path = NULL;
+    const char* thresholds = NULL;
+    const char* hystereses = NULL;
+    const char* smoothings = NULL;
+    int numThreads = WorkPool_getNumCpus();
+    bool printPerSecond = false;
+    bool verify = false;
+    bool scaling = false;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc){
+            numThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc){
+            thresholds = argv[++i];
+        } else if (strcmp(argv[i], "--hysteresis") == 0 && i + 1 < argc){
+            hystereses = argv[++i];
+        } else if (strcmp(argv[i], "--smoothing") == 0 && i + 1 < argc){
+            smoothings = argv[++i];
+        } else if (strcmp(argv[i], "--chunk-samples") == 0 && i + 1 < argc){
+            chunkSamples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seconds") == 0){
+            printPerSecond = true;
+        } else if (strcmp(argv[i], "--verify") == 0){
+            verify = true;
+        } else if (strcmp(argv[i], "--scaling") == 0){
+            scaling = true;
+        } else if (argv[i][0] != '-' && !path){
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path || numThreads < 1 || chunkSamples < 1){
+        fprintf(stderr, "usage: %s trace [--threads N] [--threshold V,...] [--hysteresis V,...] [--smoothing W,...]\n"
+                        "       [--chunk-samples N] [--seconds] [--verify] [--scaling]\n", argv[0]);
+        return 2;
+    }
+    parseConfigs(thresholds, hystereses, smoothings);
+    // The board's curve (LIGHT_SAMPLER_CALIBRATION), as the sampler loads it
+    Calibration_init();
+
+    analysis_t analysis;
+    long long startNs = getTimeInNs();
+    analyzeParallel(path, numThreads, &analysis);
+    double elapsedS = (double)(getTimeInNs() - startNs) / NS_PER_SECOND;
+    if (printPerSecond){
+        printSeconds(&analysis);
+    }
+    printf("%s: %lld samples, %d seconds\n", path, analysis.numSamples, analysis.numSeconds);
+    for (int c = 0; c < numConfigs; c++){
+        printf("threshold %.3fV hysteresis %.3fV smoothing %.4f: %lld dips\n", configs[c].thresholdVolts,
+                configs[c].hysteresisVolts, configs[c].smoothingWeight, analysis.numDips[c]);
+    }
+    printf("%d threads: %.3fs, %.1fM samples/s, %lld tasks, %lld stolen, %lld rerun while stitching\n",
+            numThreads, elapsedS, elapsedS > 0 ? analysis.numSamples / elapsedS / 1e6 : 0.0,
+            WorkPool_getExecuted(&pool), WorkPool_getStolen(&pool), numReruns);
+
+    int status = 0;
+    if (verify){
+        analysis_t reference;
+        startNs = getTimeInNs();
+        analyzeSequential(path, &reference);
+        elapsedS = (double)(getTimeInNs() - startNs) / NS_PER_SECOND;
+        bool isMatch = compareAnalyses(&reference, &analysis);
+        printf("verify: single-threaded run %.3fs; results %s\n", elapsedS, isMatch ? "match exactly" : "DIFFER");
+        status = isMatch ? 0 : 1;
+        freeAnalysis(&reference);
+    }
+    if (scaling){
+        double baseS = 0;
+        printf("%8s %10s %14s %8s\n", "threads", "seconds", "Msamples/s", "speedup");
+        // 1, 2, 4, ... and then all threads
+        for (int threads = 1; ; threads = threads * 2 < numThreads ? threads * 2 : numThreads){
+            analysis_t run;
+            startNs = getTimeInNs();
+            analyzeParallel(path, threads, &run);
+            elapsedS = (double)(getTimeInNs() - startNs) / NS_PER_SECOND;
+            if (threads == 1){
+                baseS = elapsedS;
+            }
+            if (!compareAnalyses(&analysis, &run)){
+                status = 1;
+            }
+            printf("%8d %10.3f %14.1f %7.2fx\n", threads, elapsedS, run.numSamples / elapsedS / 1e6, baseS / elapsedS);
+            freeAnalysis(&run);
+            if (threads == numThreads){
+                break;
+            }
+        }
+    }
+    freeAnalysis(&analysis);
+    Calibration_cleanup();
+    return status;
+}
+
+// Every combination of the listed settings; unlisted ones are the sampler's
+static void parseConfigs(const char* thresholds, const char* hystereses, const char* smoothings)
+{
+    DipDetector_config_t defaults = DipDetector_defaultConfig();
+    double thresholdValues[MAX_LIST_VALUES] = {defaults.thresholdVolts};
+    double hysteresisValues[MAX_LIST_VALUES] = {defaults.hysteresisVolts};
+    double smoothingValues[MAX_LIST_VALUES] = {defaults.smoothingWeight};
+    int numThresholds = thresholds ? parseList(thresholds, thresholdValues) : 1;
+    int numHystereses = hystereses ? parseList(hystereses, hysteresisValues) : 1;
+    int numSmoothings = smoothings ? parseList(smoothings, smoothingValues) : 1;
+    if (numThresholds * numHystereses * numSmoothings > MAX_CONFIGS){
+        fprintf(stderr, "ERROR: at most %d combinations of settings\n", MAX_CONFIGS);
+        exit(2);
+    }
+    for (int s = 0; s < numSmoothings; s++){
+        for (int t = 0; t < numThresholds; t++){
+            for (int h = 0; h < numHystereses; h++){
+                DipDetector_config_t* config = &configs[numConfigs++];
+                config->thresholdVolts = thresholdValues[t];
+                config->hysteresisVolts = hysteresisValues[h];
+                config->smoothingWeight = smoothingValues[s];
+            }
+        }
+    }
+}
+
+static int parseList(const char* text, double* values)
+{
+    int numValues = 0;
+    char* end;
+    while (numValues < MAX_LIST_VALUES){
+        values[numValues++] = strtod(text, &end);
+        if (end == text || (*end != ',' && *end != 0)){
+            fprintf(stderr, "ERROR: expected a comma-separated list of numbers, got '%s'\n", text);
+            exit(2);
+        }
+        if (*end == 0){
+            break;
+        }
+        text = end + 1;
+    }
+    return numValues;
+}
+
+// Decode the trace on this thread, handing whole-second chunks to the pool
+static void analyzeParallel(const char* path, int numThreads, analysis_t* analysis)
+{
+    SampleTrace_reader_t* reader = malloc(sizeof(SampleTrace_reader_t));
+    openTrace(reader, path);
+    memset(analysis, 0, sizeof(*analysis));
+    WorkPool_init(&pool, numThreads);
+    segmentUsed = 0;
+    numSegmentSeconds = 0;
+    numReruns = 0;
+    numChunks = 0;
+    chunkFirstSample = 0;
+    chunkFirstSecond = 0;
+    for (int c = 0; c < numConfigs; c++){
+        dipAllowed[c] = true;
+    }
+
+    long long timeUs;
+    int a2dReading;
+    long long secondStartMs = 0;
+    bool isFirst = true;
+    while (SampleTrace_read(reader, &timeUs, &a2dReading)){
+        double volts = a2dToVoltage(a2dReading);
+        long long timeMs = timeUs / US_PER_MS;
+        if (isFirst){
+            // The sampler starts its average at the first reading
+            for (int c = 0; c < numConfigs; c++){
+                chunkAverages[c] = volts;
+            }
+        }
+        if (isFirst || timeMs - secondStartMs >= HISTORY_WINDOW_MS){
+            if (numSegmentSeconds == SEGMENT_SECONDS || numChunks >= SEGMENT_CHUNKS - 2){
+                flushSegment(numSegmentSeconds, analysis);
+            } else if (segmentUsed - chunkFirstSample >= chunkSamples){
+                closeChunk(segmentUsed, numSegmentSeconds);
+            }
+            secondStats_t* second = &segmentSeconds[numSegmentSeconds];
+            memset(second, 0, sizeof(*second));
+            second->startMs = timeMs;
+            secondFirstSample[numSegmentSeconds] = segmentUsed;
+            numSegmentSeconds++;
+            secondStartMs = timeMs;
+            isFirst = false;
+        }
+        if (segmentUsed == SEGMENT_SAMPLES){
+            // Keep the open second, which moves to the start of the buffer
+            flushSegment(numSegmentSeconds - 1, analysis);
+            if (segmentUsed == SEGMENT_SAMPLES){
+                fprintf(stderr, "ERROR: a second of %s has more than %d samples\n", path, SEGMENT_SAMPLES);
+                exit(2);
+            }
+        }
+        segmentVolts[segmentUsed++] = volts;
+        segmentSeconds[numSegmentSeconds - 1].numSamples++;
+    }
+    // Like the sampler's replay, the final partial second is published too
+    flushSegment(numSegmentSeconds, analysis);
+    WorkPool_cleanup(&pool);
+    closeTrace(reader, path);
+}
+
+// Reference: the sampler's per-sample update, one sample at a time
+static void analyzeSequential(const char* path, analysis_t* analysis)
+{
+    SampleTrace_reader_t* reader = malloc(sizeof(SampleTrace_reader_t));
+    openTrace(reader, path);
+    memset(analysis, 0, sizeof(*analysis));
+    DipDetector_t detectors[MAX_CONFIGS];
+    secondStats_t second;
+    secondDips_t dips[MAX_CONFIGS];
+    long long timeUs;
+    int a2dReading;
+    bool isFirst = true;
+    while (SampleTrace_read(reader, &timeUs, &a2dReading)){
+        double volts = a2dToVoltage(a2dReading);
+        long long timeMs = timeUs / US_PER_MS;
+        if (isFirst){
+            for (int c = 0; c < numConfigs; c++){
+                DipDetector_init(&detectors[c], &configs[c], volts);
+            }
+        }
+        if (isFirst || timeMs - second.startMs >= HISTORY_WINDOW_MS){
+            if (!isFirst){
+                appendSecond(analysis, &second, dips, 1);
+            }
+            memset(&second, 0, sizeof(second));
+            memset(dips, 0, sizeof(dips));
+            second.startMs = timeMs;
+            isFirst = false;
+        }
+        for (int c = 0; c < numConfigs; c++){
+            if (DipDetector_update(&detectors[c], volts)){
+                dips[c].dips++;
+            }
+            dips[c].average = detectors[c].average;
+        }
+        second.min = second.numSamples == 0 || volts < second.min ? volts : second.min;
+        second.max = second.numSamples == 0 || volts > second.max ? volts : second.max;
+        second.sum += volts;
+        second.numSamples++;
+    }
+    if (!isFirst){
+        appendSecond(analysis, &second, dips, 1);
+    }
+    closeTrace(reader, path);
+}
+
+// Pool task: one setting's detector over one chunk, starting outside a dip.
+// The first setting's task also fills in the seconds' level statistics.
+static void analyzeRun(void* arg)
+{
+    chunkRun_t* run = arg;
+    detectChunk(run, true);
+    if (run->config != 0){
+        return;
+    }
+    const chunk_t* chunk = run->chunk;
+    const double* volts = &segmentVolts[chunk->firstSample];
+    for (int s = chunk->firstSecond; s < chunk->firstSecond + chunk->numSeconds; s++){
+        secondStats_t* second = &segmentSeconds[s];
+        for (int i = 0; i < second->numSamples; i++){
+            double v = volts[i];
+            second->min = i == 0 || v < second->min ? v : second->min;
+            second->max = i == 0 || v > second->max ? v : second->max;
+            second->sum += v;
+        }
+        volts += second->numSamples;
+    }
+}
+
+// Run the detector over the chunk's seconds. Starting outside a dip, also
+// follow a start inside one until the two agree, recording where they differ.
+static void detectChunk(chunkRun_t* run, bool startDipAllowed)
+{
+    const chunk_t* chunk = run->chunk;
+    DipDetector_t detector;
+    DipDetector_init(&detector, &configs[run->config], run->startAverage);
+    detector.dipAllowed = startDipAllowed;
+    DipDetector_t inside = detector;
+    inside.dipAllowed = false;
+    run->isMerged = !startDipAllowed;
+    run->numAdjustments = 0;
+    const double* volts = &segmentVolts[chunk->firstSample];
+    for (int s = chunk->firstSecond; s < chunk->firstSecond + chunk->numSeconds; s++){
+        secondDips_t* dips = &segmentDips[run->config][s];
+        int numSamples = segmentSeconds[s].numSamples;
+        dips->dips = 0;
+        for (int i = 0; i < numSamples; i++){
+            bool isDip = DipDetector_update(&detector, volts[i]);
+            dips->dips += isDip ? 1 : 0;
+            if (!run->isMerged){
+                bool isInsideDip = DipDetector_update(&inside, volts[i]);
+                if (isDip != isInsideDip){
+                    int last = run->numAdjustments - 1;
+                    if (last >= 0 && last < MAX_ADJUSTMENTS && run->adjustments[last].second == s){
+                        run->adjustments[last].dips += isInsideDip - isDip;
+                    } else if (run->numAdjustments < MAX_ADJUSTMENTS){
+                        run->adjustments[run->numAdjustments++] = (adjustment_t){s, isInsideDip - isDip};
+                    } else {
+                        run->numAdjustments = MAX_ADJUSTMENTS + 1;
+                    }
+                }
+                run->isMerged = inside.dipAllowed == detector.dipAllowed;
+            }
+        }
+        dips->average = detector.average;
+        volts += numSamples;
+    }
+    run->endDipAllowed = detector.dipAllowed;
+}
+
+// Hand samples [chunkFirstSample, endSample) / seconds [chunkFirstSecond, endSecond)
+// to the pool, and carry each setting's average on to the next chunk
+static void closeChunk(int endSample, int endSecond)
+{
+    if (endSecond == chunkFirstSecond){
+        return;
+    }
+    chunk_t* chunk = &chunks[numChunks++];
+    chunk->firstSample = chunkFirstSample;
+    chunk->firstSecond = chunkFirstSecond;
+    chunk->numSeconds = endSecond - chunkFirstSecond;
+    for (int c = 0; c < numConfigs; c++){
+        chunkRun_t* run = &chunk->runs[c];
+        run->chunk = chunk;
+        run->config = c;
+        run->startAverage = chunkAverages[c];
+        WorkPool_submit(&pool, analyzeRun, run);
+    }
+    for (int c = 0; c < numConfigs; c++){
+        // Settings with the same smoothing share the average
+        int same = 0;
+        while (configs[same].smoothingWeight != configs[c].smoothingWeight){
+            same++;
+        }
+        chunkAverages[c] = same < c ? chunkAverages[same]
+                : DipDetector_advanceAverage(&configs[c], chunkAverages[c], &segmentVolts[chunkFirstSample], endSample - chunkFirstSample);
+    }
+    chunkFirstSample = endSample;
+    chunkFirstSecond = endSecond;
+}
+
+// Finish every second before `keepSecond`: analyze, stitch the dip state
+// through the chunks in order, and append them. Seconds from `keepSecond` on
+// (and their samples) move to the start of the segment.
+static void flushSegment(int keepSecond, analysis_t* analysis)
+{
+    int keepSample = keepSecond < numSegmentSeconds ? secondFirstSample[keepSecond] : segmentUsed;
+    closeChunk(keepSample, keepSecond);
+    WorkPool_wait(&pool);
+    for (int c = 0; c < numConfigs; c++){
+        for (int k = 0; k < numChunks; k++){
+            chunkRun_t* run = &chunks[k].runs[c];
+            if (!dipAllowed[c]){
+                if (run->isMerged && run->numAdjustments <= MAX_ADJUSTMENTS){
+                    for (int a = 0; a < run->numAdjustments; a++){
+                        segmentDips[c][run->adjustments[a].second].dips += run->adjustments[a].dips;
+                    }
+                } else {
+                    detectChunk(run, false);
+                    numReruns++;
+                }
+            }
+            dipAllowed[c] = run->endDipAllowed;
+        }
+    }
+    for (int s = 0; s < keepSecond; s++){
+        appendSecond(analysis, &segmentSeconds[s], &segmentDips[0][s], SEGMENT_SECONDS);
+    }
+
+    memmove(segmentVolts, &segmentVolts[keepSample], (segmentUsed - keepSample) * sizeof(double));
+    for (int s = keepSecond; s < numSegmentSeconds; s++){
+        segmentSeconds[s - keepSecond] = segmentSeconds[s];
+        secondFirstSample[s - keepSecond] = secondFirstSample[s] - keepSample;
+    }
+    segmentUsed -= keepSample;
+    numSegmentSeconds -= keepSecond;
+    numChunks = 0;
+    chunkFirstSample = 0;
+    chunkFirstSecond = 0;
+}
+
+// Append a second; setting c's result is at dips[c * stride]
+static void appendSecond(analysis_t* analysis, const secondStats_t* second, const secondDips_t* dips, int stride)
+{
+    if (analysis->numSeconds == analysis->capacity){
+        analysis->capacity = analysis->capacity ? analysis->capacity * 2 : 1024;
+        analysis->seconds = realloc(analysis->seconds, analysis->capacity * sizeof(secondStats_t));
+        bool isAllocated = analysis->seconds != NULL;
+        for (int c = 0; c < numConfigs; c++){
+            analysis->dips[c] = realloc(analysis->dips[c], analysis->capacity * sizeof(secondDips_t));
+            isAllocated = isAllocated && analysis->dips[c] != NULL;
+        }
+        if (!isAllocated){
+            fprintf(stderr, "ERROR: out of memory for %d seconds\n", analysis->capacity);
+            exit(2);
+        }
+    }
+    analysis->seconds[analysis->numSeconds] = *second;
+    for (int c = 0; c < numConfigs; c++){
+        analysis->dips[c][analysis->numSeconds] = dips[c * stride];
+        analysis->numDips[c] += dips[c * stride].dips;
+    }
+    analysis->numSeconds++;
+    analysis->numSamples += second->numSamples;
+}
+
+static void openTrace(SampleTrace_reader_t* reader, const char* path)
+{
+    if (!SampleTrace_openReader(reader, path)){
+        fprintf(stderr, "ERROR: unable to read sample trace %s\n", path);
+        exit(2);
+    }
+}
+
+// A corrupt record ends the read early; the analysis would silently cover a prefix
+static void closeTrace(SampleTrace_reader_t* reader, const char* path)
+{
+    bool isMalformed = reader->isMalformed;
+    long long numRecords = reader->numRecords;
+    SampleTrace_closeReader(reader);
+    free(reader);
+    if (isMalformed){
+        fprintf(stderr, "ERROR: sample trace %s is malformed after %lld records\n", path, numRecords);
+        exit(2);
+    }
+}
+
+// The sampler's table lookup, so replayed volts match a live replay bit for bit
+static double a2dToVoltage(int a2dReading)
+{
+    return Calibration_countToVolts(a2dReading);
+}
+
+static bool compareAnalyses(const analysis_t* expected, const analysis_t* actual)
+{
+    if (expected->numSeconds != actual->numSeconds){
+        printf("mismatch: %d seconds, expected %d\n", actual->numSeconds, expected->numSeconds);
+        return false;
+    }
+    for (int s = 0; s < expected->numSeconds; s++){
+        const secondStats_t* a = &expected->seconds[s];
+        const secondStats_t* b = &actual->seconds[s];
+        if (a->startMs != b->startMs || a->numSamples != b->numSamples
+                || a->sum != b->sum || a->min != b->min || a->max != b->max){
+            printf("mismatch in second %d (%lldms): %d samples sum %.17g, expected %d samples sum %.17g\n",
+                    s, a->startMs, b->numSamples, b->sum, a->numSamples, a->sum);
+            return false;
+        }
+        for (int c = 0; c < numConfigs; c++){
+            const secondDips_t* x = &expected->dips[c][s];
+            const secondDips_t* y = &actual->dips[c][s];
+            if (x->dips != y->dips || x->average != y->average){
+                printf("mismatch in second %d (%lldms), setting %d: %d dips avg %.17g, expected %d dips avg %.17g\n",
+                        s, a->startMs, c, y->dips, y->average, x->dips, x->average);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void printSeconds(const analysis_t* analysis)
+{
+    printf("second,start_ms,samples,avg,min,max");
+    for (int c = 0; c < numConfigs; c++){
+        printf(",dips%d,smoothed%d", c, c);
+    }
+    printf("\n");
+    for (int s = 0; s < analysis->numSeconds; s++){
+        const secondStats_t* second = &analysis->seconds[s];
+        printf("%d,%lld,%d,%.6f,%.6f,%.6f", s, second->startMs, second->numSamples,
+                second->numSamples > 0 ? second->sum / second->numSamples : 0.0, second->min, second->max);
+        for (int c = 0; c < numConfigs; c++){
+            printf(",%d,%.6f", analysis->dips[c][s].dips, analysis->dips[c][s].average);
+        }
+        printf("\n");
+    }
+}
+
+static void freeAnalysis(analysis_t* analysis)
+{
+    free(analysis->seconds);
+    analysis->seconds = NULL;
+    for (int c = 0; c < numConfigs; c++){
+        free(analysis->dips[c]);
+        analysis->dips[c] = NULL;
+    }
+}
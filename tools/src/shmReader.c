@@ -0,0 +1,128 @@
+// shmReader.c
+// Follows the sampler's shared-memory export (see hal/sampleShm.h) from a
+// separate process: prints the summary once a second and checks the block
+// stream as it goes.
+//
+// Every block read must continue the previous one (block sequence + 1 and
+// sample number + SAMPLE_BLOCK_SAMPLES) unless the reader fell behind, which
+// shows as a sequence gap and is counted as lost blocks. Any other
+// discontinuity is a torn or misordered read and makes the exit status 1.
+//
+// Usage: light_sampler_shm_reader [--name /light_sampler] [--seconds N] [--quiet]
+
+#include "hal/sampleShm.h"
+#include "hal/histogram.h"
+#include "hal/timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NS_PER_US 1000
+#define NS_PER_MS 1000000
+#define NS_PER_SECOND 1000000000LL
+#define POLL_INTERVAL_NS 1000000
+#define OPEN_TIMEOUT_NS (5 * NS_PER_SECOND)
+
+static void printSummary(const SampleShm_reader_t* reader);
+
+int main(int argc, char* argv[])
+{
+    const char* name = SAMPLE_SHM_DEFAULT_NAME;
+    double seconds = 0;
+    bool quiet = false;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--name") == 0 && i + 1 < argc){
+            name = argv[++i];
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc){
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--quiet") == 0){
+            quiet = true;
+        } else {
+            fprintf(stderr, "usage: %s [--name /light_sampler] [--seconds N] [--quiet]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // The sampler may still be starting; wait for its segment to appear
+    SampleShm_reader_t reader;
+    long long startNs = getTimeInNs();
+    while (!SampleShm_openReader(&reader, name)){
+        if (getTimeInNs() - startNs > OPEN_TIMEOUT_NS){
+            fprintf(stderr, "ERROR: no light sampler export at %s\n", name);
+            return 2;
+        }
+        sleepUntilNs(getTimeInNs() + POLL_INTERVAL_NS * 10);
+    }
+
+    static Histogram_t latencyHistogram;
+    Histogram_init(&latencyHistogram);
+    long long cursor = SampleShm_nextSequence(&reader);
+    long long blocks = 0;
+    long long lostBlocks = 0;
+    long long errors = 0;
+    SampleBlock_t block;
+    SampleBlock_t previous = {.sequence = -1};
+    long long endNs = seconds > 0 ? getTimeInNs() + (long long)(seconds * NS_PER_SECOND) : 0;
+    long long nextSummaryNs = getTimeInNs() + NS_PER_SECOND;
+    bool closed = false;
+    while (!closed && (endNs == 0 || getTimeInNs() < endNs)){
+        // Check before draining, so blocks published just before shutdown are still read
+        closed = SampleShm_isClosed(&reader);
+        while (SampleShm_read(&reader, &cursor, &block) == SAMPLE_SHM_OK){
+            Histogram_record(&latencyHistogram, (getTimeInNs() - block.newestSampleNs) / NS_PER_US);
+            if (previous.sequence >= 0){
+                long long skipped = block.sequence - previous.sequence - 1;
+                long long expectedFirst = previous.firstSampleNumber + (skipped + 1) * SAMPLE_BLOCK_SAMPLES;
+                if (skipped < 0 || block.firstSampleNumber != expectedFirst){
+                    fprintf(stderr, "ERROR: block %lld (samples from %lld) after block %lld (samples from %lld)\n",
+                            block.sequence, block.firstSampleNumber, previous.sequence, previous.firstSampleNumber);
+                    errors++;
+                } else {
+                    lostBlocks += skipped;
+                }
+            }
+            previous = block;
+            blocks++;
+        }
+        long long nowNs = getTimeInNs();
+        if (nowNs >= nextSummaryNs){
+            if (!quiet){
+                printSummary(&reader);
+            }
+            nextSummaryNs += NS_PER_SECOND;
+        }
+        sleepUntilNs(nowNs + POLL_INTERVAL_NS);
+    }
+
+    printf("shm reader: %lld blocks (%lld samples), %lld lost, %lld errors; "
+           "publish-to-read latency p50 %lldus p99 %lldus max %lldus%s\n",
+            blocks, blocks * SAMPLE_BLOCK_SAMPLES, lostBlocks, errors,
+            Histogram_percentile(&latencyHistogram, 0.5), Histogram_percentile(&latencyHistogram, 0.99),
+            atomic_load(&latencyHistogram.max), closed ? " (sampler shut down)" : "");
+    SampleShm_closeReader(&reader);
+    return errors == 0 ? 0 : 1;
+}
+
+static void printSummary(const SampleShm_reader_t* reader)
+{
+    SampleShm_summary_t summary;
+    if (!SampleShm_readSummary(reader, &summary)){
+        printf("summary busy\n");
+        return;
+    }
+    time_t wallSeconds = summary.updatedWallNs / NS_PER_SECOND;
+    struct tm wall;
+    localtime_r(&wallSeconds, &wall);
+    printf("%02d:%02d:%02d.%03lld  ", wall.tm_hour, wall.tm_min, wall.tm_sec,
+            summary.updatedWallNs % NS_PER_SECOND / NS_PER_MS);
+    printf("samples %lld  dips %lld  avg %.3fV  last second: %d samples, %d dips",
+            summary.samplesTaken, summary.dipsTotal, summary.averageVolts, summary.historySize, summary.historyDips);
+    for (int i = 0; i < summary.numWindows; i++){
+        const SampleWindow_stats_t* window = &summary.windows[i];
+        if (window->count > 0){
+            printf("  [%d/%dms %.3fV]", window->lengthMs, window->hopMs, window->sum / window->count);
+        }
+    }
+    printf("\n");
+}